@@ -5,16 +5,21 @@
  * - Account creation and storage
  * - Account retrieval and loading
  * - Account updates and deletions
- * - File-based persistence with encryption
+ * - Conversion between stored records and account objects
+ * - CSV import and export
+ *
+ * Persistence and caching are handled by the AccountStore.
  */
 
 #include "accountDatabase.h"
-#include "simpleEncryption.h"
-#include <fstream>
-#include <sstream>
+#include "accountStore.h"
+#include "accountFile.h"
+#include "accountSequence.h"
 #include <iostream>
-#include <typeinfo>
 #include <algorithm>
+#include <chrono>
+#include <thread>
+#include <random>
 #include "serviceChargeCheckingType.h"
 #include "noServiceChargeCheckingType.h"
 #include "savingsAccountType.h"
@@ -24,123 +29,183 @@
 
 using namespace std;
 
-const string FILE_NAME = "accounts.txt";
-const string ENCRYPTION_KEY = "your_secret_key_here";
+const string ACCOUNT_CSV_KEY = "your_secret_key_here";
+
+// Times a balance change is tried before a conflict is reported
+const int COMMIT_ATTEMPTS = 8;
+
+// Longest pause before the next attempt after a conflict; the pause doubles
+// from 1 ms and is picked at random below it, so sessions do not retry in lockstep
+const chrono::milliseconds COMMIT_BACKOFF_MAX(32);
 
 /**
- * Saves an account to the encrypted database file
+ * Create the account object matching a stored record
+ *
+ * Account Types Handled:
+ * - Service Charge Checking
+ * - No Service Charge Checking
+ * - Savings
+ * - High Interest Checking
+ * - High Interest Savings
+ * - Certificate of Deposit
+ *
+ * The object carries the record's lsn as its version.
+ *
+ * @param record Stored account data
+ * @return unique_ptr<bankAccountType> New account object
+ */
+static unique_ptr<bankAccountType> makeAccount(const AccountRecord& record) {
+    const string& name = record.name;
+    int accNum = record.accountNumber;
+    double bal = fromCents(record.balanceCents);
+
+    // Create the object matching the stored type tag
+    unique_ptr<bankAccountType> account;
+    switch (record.type) {
+        case AccountTypeTag::SERVICE_CHARGE_CHECKING:
+            account = make_unique<serviceChargeCheckingType>(name, accNum, bal);
+            break;
+        case AccountTypeTag::SAVINGS:
+            account = make_unique<savingsAccountType>(name, accNum, bal, 0.0);
+            break;
+        case AccountTypeTag::HIGH_INTEREST_CHECKING:
+            account = make_unique<highInterestCheckingType>(name, accNum, bal);
+            break;
+        case AccountTypeTag::HIGH_INTEREST_SAVINGS:
+            account = make_unique<highInterestSavingsType>(name, accNum, bal);
+            break;
+        case AccountTypeTag::CERTIFICATE_OF_DEPOSIT:
+            account = make_unique<certificateOfDepositType>(name, accNum, bal, 0.0, 0);
+            break;
+        default:
+            // Plain and no service charge checking share one implementation
+            account = make_unique<noServiceChargeCheckingType>(name, accNum, bal);
+            break;
+    }
+    account->setVersion(record.lsn);
+    return account;
+}
+
+/**
+ * Saves an account to the database
  * 
  * Process:
- * 1. Decrypts existing file content
- * 2. Appends new account information
- * 3. Re-encrypts the entire file
- * 
- * File Format:
- * accountNumber,name,type,balance
+ * 1. Adds the account to the in-memory store
+ * 2. The store records the new account in its log
  * 
  * Error Handling:
- * - Checks for file open/write permissions
- * - Reports errors to cerr stream
+ * - Reports duplicate account numbers to cerr stream
  * 
  * @param account The account to save
  */
 void saveAccount(const unique_ptr<bankAccountType>& account) {
-    // Decrypt existing content
-    string content;
-    content = decryptFile(FILE_NAME, simpleHash(ENCRYPTION_KEY));
-
-    // Format new account data
-    stringstream ss;
-    ss << content;
-    ss << account->getAccountNumber() << ","
-       << account->getName() << ","
-       << account->getType() << ","
-       << account->getBalance() << "\n";
-
-    content = ss.str();
-
-    // Write to temporary file before encryption
-    ofstream tempFile("temp_accounts.txt");
-    if (tempFile.is_open()) {
-        tempFile << content;
-        tempFile.close();
-    } else {
-        cerr << "Error: Unable to write to temp_accounts.txt" << endl;
+    AccountRecord record{account->getAccountNumber(), account->getName(),
+                         accountTypeTag(account->getType()), toCents(account->getBalance())};
+    if (!AccountStore::instance().insert(record)) {
+        cerr << "Error: Unable to save account " << record.accountNumber << endl;
     }
-
-    // Encrypt the final file
-    encryptFile(FILE_NAME, simpleHash(ENCRYPTION_KEY));
 }
 
 /**
- * Loads all accounts from the encrypted database file
- * 
- * Process:
- * 1. Decrypts the file
- * 2. Reads each line representing an account
- * 3. Creates appropriate account objects based on type
- * 4. Initializes account properties
+ * Loads all accounts from the database
  * 
- * Account Types Handled:
- * - Service Charge Checking
- * - No Service Charge Checking
- * - Savings
- * - High Interest Checking
- * - High Interest Savings
- * - Certificate of Deposit
+ * Creates one account object per stored account, in file order.
+ * The data itself comes from the in-memory store, so the file
+ * is not decrypted again.
  * 
  * @return vector<unique_ptr<bankAccountType>> List of all accounts
  */
 vector<unique_ptr<bankAccountType>> loadAccounts() {
     vector<unique_ptr<bankAccountType>> accounts;
+    for (const auto& record : AccountStore::instance().all()) {
+        accounts.push_back(makeAccount(record));
+    }
+    return accounts;
+}
 
-    // Decrypt file content
-    string content = decryptFile(FILE_NAME, simpleHash(ENCRYPTION_KEY));
-
-    // Process each line
-    istringstream file(content);
-    string line;
-
-    while (getline(file, line)) {
-        istringstream iss(line);
-        string accountNumber, name, type, balance;
-
-        // Parse comma-separated values
-        if (getline(iss, accountNumber, ',') &&
-            getline(iss, name, ',') &&
-            getline(iss, type, ',') &&
-            getline(iss, balance)) {
+/**
+ * Visits all accounts without loading them into a list
+ * 
+ * Each view refers to the stored account, so a full scan neither
+ * copies the book nor allocates per account. Views are only valid
+ * inside the visitor, and the visitor must not modify the database.
+ * 
+ * @param visit Called for each account in file order
+ */
+void forEachAccount(const function<void(const AccountView&)>& visit) {
+    AccountStore::instance().forEach([&visit](const AccountRecord& record) {
+        visit(AccountView(record));
+    });
+}
 
-            int accNum = stoi(accountNumber);
-            double bal = stod(balance);
+/**
+ * Visits the accounts matching a predicate
+ * 
+ * @param predicate Decides which accounts are visited
+ * @param visit Called for each accepted account in file order
+ */
+void forEachAccount(const function<bool(const AccountView&)>& predicate,
+                    const function<void(const AccountView&)>& visit) {
+    AccountStore::instance().forEach([&predicate, &visit](const AccountRecord& record) {
+        AccountView view(record);
+        if (predicate(view)) {
+            visit(view);
+        }
+    });
+}
 
-            // Create appropriate account type
-            unique_ptr<bankAccountType> account;
+/**
+ * Visits the given accounts through the index
+ * 
+ * @param accountNumbers The accounts to visit
+ * @param visit Called for each account that exists, in the order given
+ */
+void forEachAccountIn(const vector<int>& accountNumbers,
+                      const function<void(const AccountView&)>& visit) {
+    AccountStore::instance().forEach(accountNumbers, [&visit](const AccountRecord& record) {
+        visit(AccountView(record));
+    });
+}
 
-            // Determine account type and create corresponding object
-            if (type.find("ServiceChargeChecking") != string::npos) {
-                account = make_unique<serviceChargeCheckingType>(name, accNum, bal);
-            } else if (type.find("NoServiceChargeChecking") != string::npos) {
-                account = make_unique<noServiceChargeCheckingType>(name, accNum, bal);
-            } else if (type.find("Savings") != string::npos) {
-                account = make_unique<savingsAccountType>(name, accNum, bal, 0.0);
-            } else if (type.find("HighInterestChecking") != string::npos) {
-                account = make_unique<highInterestCheckingType>(name, accNum, bal);
-            } else if (type.find("HighInterestSavings") != string::npos) {
-                account = make_unique<highInterestSavingsType>(name, accNum, bal);
-            } else if (type.find("CertificateOfDeposit") != string::npos) {
-                account = make_unique<certificateOfDepositType>(name, accNum, bal, 0.0, 0);
-            } else {
-                // Default to basic account type if type unknown
-                account = make_unique<noServiceChargeCheckingType>(name, accNum, bal);
-            }
+/**
+ * Counts the accounts in the database
+ * 
+ * @return size_t Number of accounts
+ */
+size_t countAccounts() {
+    return AccountStore::instance().size();
+}
 
-            if (account) {
-                accounts.push_back(move(account));
-            }
-        }
+/**
+ * Finds a single account by number
+ * 
+ * Point lookup through the store's account number index.
+ * 
+ * @param accountNumber The account to find
+ * @return unique_ptr<bankAccountType> The account or nullptr if not found
+ */
+unique_ptr<bankAccountType> findAccountInDatabase(int accountNumber) {
+    optional<AccountRecord> record = AccountStore::instance().findAccount(accountNumber);
+    if (!record) {
+        return nullptr;
     }
+    return makeAccount(*record);
+}
 
+/**
+ * Finds several accounts by number
+ * 
+ * One index lookup per requested number; numbers that do not
+ * exist are skipped.
+ * 
+ * @param accountNumbers The accounts to find
+ * @return vector<unique_ptr<bankAccountType>> The accounts found, in the order requested
+ */
+vector<unique_ptr<bankAccountType>> findAccountsInDatabase(const vector<int>& accountNumbers) {
+    vector<unique_ptr<bankAccountType>> accounts;
+    for (const auto& record : AccountStore::instance().findAccounts(accountNumbers)) {
+        accounts.push_back(makeAccount(record));
+    }
     return accounts;
 }
 
@@ -148,28 +213,21 @@ vector<unique_ptr<bankAccountType>> loadAccounts() {
  * Generates the next available account number
  * 
  * Logic:
- * 1. Loads all existing accounts
- * 2. If no accounts exist, starts at 1000
- * 3. Otherwise, uses highest existing number + 1
+ * 1. Takes the next number from the durable account sequence
+ * 2. The first time, the sequence starts after the highest number
+ *    in the book, or at 1000 if no accounts exist
  * 
- * @return int The next available account number
+ * The account data is not read, and numbers are never reused.
+ * 
+ * @return int The next available account number, or -1 on error
  */
 int getNextAccountNumber() {
-    vector<unique_ptr<bankAccountType>> accounts = loadAccounts();
-    if (accounts.empty()) {
-        return 1000; // Start with account number 1000 if no accounts exist
-    }
-    return accounts.back()->getAccountNumber() + 1;
+    return reserveAccountNumbers(1);
 }
 
 /**
  * Removes an account from the database
  * 
- * Process:
- * 1. Loads all accounts
- * 2. Finds and removes specified account
- * 3. Rewrites remaining accounts to file
- * 
  * Error Handling:
  * - Verifies account exists before removal
  * - Ensures file operations complete successfully
@@ -178,89 +236,174 @@ int getNextAccountNumber() {
  * @return bool True if account was found and removed
  */
 bool removeAccountFromDatabase(int accountNumber) {
-    vector<unique_ptr<bankAccountType>> accounts = loadAccounts();
-    auto it = remove_if(accounts.begin(), accounts.end(),
-                        [accountNumber](const unique_ptr<bankAccountType>& account) {
-                            return account->getAccountNumber() == accountNumber;
-                        });
-
-    if (it != accounts.end()) {
-        accounts.erase(it, accounts.end());
-
-        // Rebuild file content
-        string content;
-        for (const auto& account : accounts) {
-            content += to_string(account->getAccountNumber()) + ","
-                    + account->getName() + ","
-                    + account->getType() + ","
-                    + to_string(account->getBalance()) + "\n";
-        }
-
-        ofstream tempFile("temp_accounts.txt");
-        if (tempFile.is_open()) {
-            tempFile << content;
-            tempFile.close();
-        } else {
-            cerr << "Error: Unable to write to temp_accounts.txt" << endl;
-            return false;
-        }
+    return AccountStore::instance().remove(accountNumber);
+}
 
-        encryptFile(FILE_NAME, simpleHash(ENCRYPTION_KEY));
-        return true;
+/**
+ * Maps the outcome of a store update to a commit status
+ * 
+ * @param result Outcome reported by the store
+ * @return CommitStatus The matching status
+ */
+static CommitStatus commitStatus(UpdateResult result) {
+    switch (result) {
+        case UpdateResult::UPDATED: return CommitStatus::COMMITTED;
+        case UpdateResult::NOT_FOUND: return CommitStatus::NOT_FOUND;
+        case UpdateResult::CONFLICT: return CommitStatus::CONFLICT;
+        case UpdateResult::DUPLICATE: return CommitStatus::REJECTED;
+        case UpdateResult::FAILED: break;
     }
-    return false;
+    return CommitStatus::FAILED;
 }
 
 /**
- * Updates an existing account in the database
- * 
- * Process:
- * 1. Loads all accounts
- * 2. Finds matching account
- * 3. Updates account information
- * 4. Saves all accounts back to file
+ * Updates an existing account in the database, unless it changed
  * 
  * Update Fields:
  * - Account holder name
  * - Account balance
- * - Account type specific data
+ * 
+ * Compare-and-swap: the update is made only if the stored account is
+ * still at the version the object was read at, so changes made by
+ * another session in the meantime are never overwritten.
  * 
  * @param updatedAccount The account with updated information
- * @return bool True if account was found and updated
+ * @return CommitStatus COMMITTED, CONFLICT if the account changed since it was read,
+ *         NOT_FOUND or FAILED
  */
-bool updateAccountInDatabase(const bankAccountType& updatedAccount) {
-    vector<unique_ptr<bankAccountType>> accounts = loadAccounts();
-    bool found = false;
+CommitStatus updateAccountInDatabase(const bankAccountType& updatedAccount) {
+    return commitStatus(AccountStore::instance().update(updatedAccount.getAccountNumber(),
+                                                        updatedAccount.getVersion(),
+                                                        updatedAccount.getName(),
+                                                        toCents(updatedAccount.getBalance())));
+}
 
-    for (auto& account : accounts) {
-        if (account->getAccountNumber() == updatedAccount.getAccountNumber()) {
-            account->setName(updatedAccount.getName());
-            account->setBalance(updatedAccount.getBalance());
-            found = true;
-            break;
-        }
+/**
+ * Updates only the balances of accounts, unless any of them changed
+ * 
+ * Used after deposits, withdrawals and transfers. All balances are
+ * written or none; none is written if any account is no longer at the
+ * version it was read at. The store writes the new balances straight
+ * into the accounts' records in the accounts file when they are current.
+ * 
+ * @param accounts The accounts with their new balances
+ * @return CommitStatus COMMITTED, CONFLICT if an account changed since it was read,
+ *         NOT_FOUND or FAILED
+ */
+CommitStatus updateBalancesInDatabase(const vector<unique_ptr<bankAccountType>>& accounts) {
+    vector<BalanceUpdate> updates;
+    updates.reserve(accounts.size());
+    for (const auto& account : accounts) {
+        updates.push_back({account->getAccountNumber(), account->getVersion(),
+                           toCents(account->getBalance())});
     }
+    return commitStatus(AccountStore::instance().updateBalances(updates));
+}
 
-    if (found) {
-        string content;
-        for (const auto& account : accounts) {
-            content += to_string(account->getAccountNumber()) + ","
-                    + account->getName() + ","
-                    + account->getType() + ","
-                    + to_string(account->getBalance()) + "\n";
-        }
+/**
+ * Commits a change to the balances of accounts read earlier
+ * 
+ * Process:
+ * 1. Let change adjust the accounts as the caller read them, or refuse
+ * 2. Write the balances if no account changed since it was read
+ * 3. On a conflict, pause briefly, read the accounts again and go back
+ *    to step 1 with their current state, up to COMMIT_ATTEMPTS times
+ * 
+ * No lock is held while the caller talks to the user, and none is
+ * needed here: the version check and the write are one step in the
+ * store. A change that is valid on the current balances, such as a
+ * deposit, therefore goes through even if another session changed the
+ * account in the meantime; one that depends on them, such as a
+ * withdrawal, is checked again against them.
+ * 
+ * @param accounts The accounts as read; hold the committed state on return
+ *                 unless an account was not found
+ * @param change Adjusts the accounts, in the same order; returns false to refuse
+ * @return CommitStatus COMMITTED, or why nothing was written
+ */
+CommitStatus commitBalanceChange(vector<unique_ptr<bankAccountType>>& accounts,
+                                 const function<bool(vector<unique_ptr<bankAccountType>>&)>& change) {
+    vector<int> accountNumbers;
+    for (const auto& account : accounts) {
+        accountNumbers.push_back(account->getAccountNumber());
+    }
 
-        ofstream tempFile("temp_accounts.txt");
-        if (tempFile.is_open()) {
-            tempFile << content;
-            tempFile.close();
-        } else {
-            cerr << "Error: Unable to write to temp_accounts.txt" << endl;
-            return false;
+    CommitStatus status = CommitStatus::CONFLICT;
+    for (int attempt = 0; attempt < COMMIT_ATTEMPTS && status == CommitStatus::CONFLICT; attempt++) {
+        if (attempt > 0) {
+            static thread_local minstd_rand jitter(random_device{}());
+            long limit = min<long>(1L << (attempt - 1), COMMIT_BACKOFF_MAX.count());
+            this_thread::sleep_for(chrono::microseconds(jitter() % (limit * 1000 + 1)));
+
+            vector<unique_ptr<bankAccountType>> current = findAccountsInDatabase(accountNumbers);
+            if (current.size() != accountNumbers.size()) {
+                return CommitStatus::NOT_FOUND;
+            }
+            accounts = move(current);
         }
+        if (!change(accounts)) {
+            return CommitStatus::REJECTED;
+        }
+        status = updateBalancesInDatabase(accounts);
+    }
+    return status;
+}
+
+/**
+ * Describes why a change was not committed
+ * 
+ * @param status Outcome of commitBalanceChange
+ * @return string Message for the user and the transaction log
+ */
+string describeCommitStatus(CommitStatus status) {
+    switch (status) {
+        case CommitStatus::COMMITTED: return "Committed";
+        case CommitStatus::CONFLICT: return "Account was changed in another session";
+        case CommitStatus::NOT_FOUND: return "Account not found";
+        case CommitStatus::REJECTED: return "Change refused";
+        case CommitStatus::FAILED: break;
+    }
+    return "Database update failed";
+}
 
-        encryptFile(FILE_NAME, simpleHash(ENCRYPTION_KEY));
-        return true;
+/**
+ * Imports accounts from an encrypted CSV file
+ * 
+ * File Format:
+ * accountNumber,name,type,balance
+ * 
+ * Accounts whose number is already in use are skipped. All other
+ * accounts are added in a single batch, and the account sequence is
+ * moved past the numbers in the file.
+ * 
+ * @param filename CSV file to read
+ * @return int Number of accounts imported
+ */
+int importAccountsFromCsv(const string& filename) {
+    vector<AccountRecord> records;
+    int highest = 0;
+    AccountFileStatus status = readAccountCsv(filename, keyContextFor(ACCOUNT_CSV_KEY),
+        [&records, &highest](const AccountRecord& record) {
+            records.push_back(record);
+            highest = max(highest, record.accountNumber);
+        });
+    if (status == AccountFileStatus::MISSING) {
+        cerr << "Error: Unable to open " << filename << endl;
+        return 0;
     }
-    return false;
+    int imported = AccountStore::instance().insertAll(records);
+    if (imported > 0) {
+        advanceAccountSequence(highest + 1);
+    }
+    return imported;
+}
+
+/**
+ * Exports all accounts to an encrypted CSV file
+ * 
+ * @param filename CSV file to write
+ * @return bool True if the file was written completely
+ */
+bool exportAccountsToCsv(const string& filename) {
+    return writeAccountCsv(filename, keyContextFor(ACCOUNT_CSV_KEY), AccountStore::instance().all());
 }
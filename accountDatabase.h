@@ -7,9 +7,13 @@
  * Works in conjunction with the user management system to maintain account relationships.
  * 
  * File Structure:
- * - Accounts stored in accounts.txt
+ * - Accounts stored in accounts.dat (binary, fixed-width records)
+ * - accounts.txt (CSV) kept for import and export
  * - Uses encryption for data security
+ * - Book kept in memory by the AccountStore after the first load
  * - Maintains atomic operations through file locking
+ * - Accounts carry the version they were read at; changes are written
+ *   only if the stored account still has it
  */
 
 #ifndef ACCOUNT_DATABASE_H
@@ -17,7 +21,10 @@
 
 #include <vector>
 #include <memory>
+#include <string>
+#include <functional>
 #include "bankAccountType.h"
+#include "accountView.h"
 
 using namespace std;
 
@@ -29,16 +36,68 @@ void saveAccount(const unique_ptr<bankAccountType>& account);
 // Handles different account types and their specific attributes
 vector<unique_ptr<bankAccountType>> loadAccounts();
 
+// Calls visit for every account in file order
+// Views refer to the stored accounts, so no object is created per account
+void forEachAccount(const function<void(const AccountView&)>& visit);
+
+// Calls visit for every account the predicate accepts, in file order
+void forEachAccount(const function<bool(const AccountView&)>& predicate,
+                    const function<void(const AccountView&)>& visit);
+
+// Calls visit for each of the given accounts that exists, in the order given
+void forEachAccountIn(const vector<int>& accountNumbers,
+                      const function<void(const AccountView&)>& visit);
+
+// Returns the number of accounts in the database
+size_t countAccounts();
+
+// Retrieves a single account by number without scanning the book
+// Returns nullptr if the account does not exist
+unique_ptr<bankAccountType> findAccountInDatabase(int accountNumber);
+
+// Retrieves the accounts with the given numbers through the index
+// Numbers that do not exist are skipped
+vector<unique_ptr<bankAccountType>> findAccountsInDatabase(const vector<int>& accountNumbers);
+
 // Generates the next available account number
-// Ensures unique account numbers across the system
+// Ensures unique account numbers across the system; returns -1 on error
 int getNextAccountNumber();
 
 // Removes an account from the database
 // Returns true if account was found and removed
 bool removeAccountFromDatabase(int accountNumber);
 
-// Updates an existing account's information
-// Returns true if account was found and updated
-bool updateAccountInDatabase(const bankAccountType& updatedAccount);
+// Outcome of a change to stored accounts
+enum class CommitStatus {
+    COMMITTED,      // Every change was written
+    CONFLICT,       // An account was changed by another session since it was read
+    NOT_FOUND,      // An account no longer exists
+    REJECTED,       // The change refused the current balances
+    FAILED          // The database could not be updated
+};
+
+// Updates an existing account's information, only if it is unchanged since it was read
+// Returns CONFLICT if another session changed it in the meantime
+CommitStatus updateAccountInDatabase(const bankAccountType& updatedAccount);
+
+// Updates the balances of accounts together, only if none changed since they were read
+// Written in place when possible
+CommitStatus updateBalancesInDatabase(const vector<unique_ptr<bankAccountType>>& accounts);
+
+// Lets change adjust accounts read earlier and writes their balances; on a conflict the
+// accounts are read again and change is applied to their current state
+CommitStatus commitBalanceChange(vector<unique_ptr<bankAccountType>>& accounts,
+                                 const function<bool(vector<unique_ptr<bankAccountType>>&)>& change);
+
+// Describes a CommitStatus for messages and log entries
+string describeCommitStatus(CommitStatus status);
+
+// Adds the accounts of an encrypted CSV file to the database
+// Returns the number of accounts imported
+int importAccountsFromCsv(const string& filename);
+
+// Writes all accounts to an encrypted CSV file
+// Returns true if the file was written completely
+bool exportAccountsToCsv(const string& filename);
 
 #endif // ACCOUNT_DATABASE_H
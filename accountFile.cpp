@@ -0,0 +1,917 @@
+/**
+ * Account File Format Implementation
+ *
+ * This file implements reading and writing of the account book:
+ * - Memory-mapped binary snapshots with fixed-width records,
+ *   stored in an encrypted block container
+ * - Compressed, encrypted CSV files for import and export, with
+ *   CRC-32C checksums per line and per block of lines
+ * - Reporting of damaged records by position and byte range
+ */
+
+#include "accountFile.h"
+#include "simpleEncryption.h"
+#include "atomicFile.h"
+#include "crc32c.h"
+#include "lzCompressor.h"
+#include <charconv>
+#include <cctype>
+#include <iostream>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+const uint32_t ACCOUNT_FILE_MAGIC = 0x46414B42;     // "BKAF"
+const uint32_t ACCOUNT_FILE_VERSION = 3;            // Block container with keyed record checksums
+
+// Snapshot header, stored at offset 0
+struct accountFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordCount;
+    uint32_t recordSize;
+    uint64_t nameHeapOffset;
+    uint64_t nameHeapSize;
+    uint64_t lastLsn;           // Log sequence number the snapshot is current to
+    uint64_t generation;        // Batches of in-place updates written since the snapshot
+    char reserved[16];
+};
+
+// One fixed-width account record
+struct accountFileRecord {
+    int32_t accountNumber;
+    uint8_t typeTag;
+    uint8_t flags;
+    uint16_t nameLength;
+    uint32_t nameOffset;        // Offset into the name heap
+    uint32_t checksum;          // Checksum of the record with this field zeroed
+    int64_t balanceCents;
+    uint64_t lsn;               // Log sequence number of the last change
+};
+
+static_assert(sizeof(accountFileHeader) == 64, "Snapshot header must be 64 bytes");
+static_assert(sizeof(accountFileRecord) == 32, "Snapshot records must be 32 bytes");
+
+// Disk sector of the header holding the generation, rewritten by in-place updates
+const size_t GENERATION_SECTOR_OFFSET = offsetof(accountFileHeader, lastLsn);
+const size_t GENERATION_SECTOR_SIZE = 32;
+static_assert(offsetof(accountFileHeader, generation) < GENERATION_SECTOR_OFFSET + GENERATION_SECTOR_SIZE,
+              "Generation must share a sector with lastLsn");
+
+/**
+ * Checksum of one decrypted record
+ *
+ * The checksum is a keyed SipHash, so a record that passes the check
+ * is authentic even when its block's MAC cannot be verified.
+ *
+ * @param record Record to check
+ * @param key Container key
+ * @return uint32_t Checksum of the record with the checksum field zeroed
+ */
+static uint32_t recordChecksum(accountFileRecord record, const ContainerKey& key) {
+    record.checksum = 0;
+    return static_cast<uint32_t>(sipHash(key.macKey, reinterpret_cast<const char*>(&record),
+                                         sizeof(record)));
+}
+
+/**
+ * Byte offset of a record in the snapshot
+ *
+ * @param position Record number in file order
+ * @return size_t Offset of the record
+ */
+static size_t recordOffset(size_t position) {
+    return sizeof(accountFileHeader) + position * sizeof(accountFileRecord);
+}
+
+/**
+ * Drop mapped pages that have been decoded
+ *
+ * Pages are released in chunks of DECRYPT_CHUNK_SIZE, so a scan of
+ * the mapping keeps only a bounded window resident.
+ *
+ * @param base Start of the mapping
+ * @param released Offset up to which pages were already released; advanced
+ * @param consumed Offset up to which the mapping has been decoded
+ */
+static void releaseMapped(const char* base, size_t& released, size_t consumed) {
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t end = consumed - consumed % pageSize;
+    if (end >= released + DECRYPT_CHUNK_SIZE) {
+        madvise(const_cast<char*>(base) + released, end - released, MADV_DONTNEED);
+        released = end;
+    }
+}
+
+// Run of consecutive damaged records
+struct damagedRange {
+    size_t first;               // First record position or line number
+    size_t last;
+    size_t startByte;           // Byte range the records occupy in the file
+    size_t endByte;
+};
+
+// Ranges listed individually before the report is summarized
+const size_t DAMAGED_RANGES_SHOWN = 10;
+
+/**
+ * Add a damaged record to a list of ranges
+ *
+ * A record that directly follows the last range extends it.
+ *
+ * @param ranges Damaged ranges found so far
+ * @param item Record position or line number
+ * @param startByte Offset of the record in the file
+ * @param endByte Offset just past the record
+ */
+static void addDamaged(vector<damagedRange>& ranges, size_t item, size_t startByte, size_t endByte) {
+    if (!ranges.empty() && ranges.back().last + 1 == item) {
+        ranges.back().last = item;
+        ranges.back().endByte = endByte;
+        return;
+    }
+    ranges.push_back({item, item, startByte, endByte});
+}
+
+/**
+ * Report damaged ranges of a file
+ *
+ * @param filename File the ranges belong to
+ * @param what Name of the records, such as "records" or "lines"
+ * @param ranges Damaged ranges in file order
+ */
+static void reportDamaged(const string& filename, const string& what,
+                          const vector<damagedRange>& ranges) {
+    for (size_t i = 0; i < ranges.size() && i < DAMAGED_RANGES_SHOWN; i++) {
+        const damagedRange& range = ranges[i];
+        cerr << "Warning: " << filename << " has damaged " << what << " " << range.first;
+        if (range.last != range.first) {
+            cerr << "-" << range.last;
+        }
+        cerr << " (bytes " << range.startByte << "-" << range.endByte << "); skipped" << endl;
+    }
+    if (ranges.size() > DAMAGED_RANGES_SHOWN) {
+        cerr << "Warning: " << filename << " has " << ranges.size() - DAMAGED_RANGES_SHOWN
+             << " more damaged range(s)" << endl;
+    }
+}
+
+// Blocks decoded ahead of a container read, enough to keep every worker busy
+const size_t SNAPSHOT_READ_AHEAD_BLOCKS = PARALLEL_MIN_SIZE / CONTAINER_BLOCK_SIZE;
+
+// Reads the logical snapshot stream out of a mapped file
+class snapshotReader {
+public:
+    snapshotReader(const char* data, size_t size, const ContainerKey& key)
+        : data(data), size(size), key(key), container(isContainer(data, size)) {}
+
+    // Copies and decrypts length bytes at a logical offset
+    // False if out of range or the file is not a container
+    // Records and names are read through separate windows, so
+    // alternating between them does not decode a block twice
+    bool read(size_t offset, size_t length, char* out, int slot = 0);
+
+    // Physical position of a logical offset, for releasing pages
+    size_t fileOffset(size_t offset) const {
+        return containerFileOffset(offset);
+    }
+
+    // Logical stream size
+    size_t streamSize() const {
+        return blockCount() * CONTAINER_PAYLOAD_SIZE;
+    }
+
+    size_t damagedBlocks = 0;   // Blocks whose MAC did not verify
+
+private:
+    size_t blockCount() const { return size / CONTAINER_BLOCK_SIZE; }
+
+    // Run of blocks decoded in one go
+    struct window {
+        size_t firstBlock = SIZE_MAX;
+        size_t blocks = 0;
+        vector<char> payloads;
+    };
+
+    const char* data;
+    size_t size;
+    const ContainerKey& key;
+    bool container;
+    window windows[2];
+};
+
+bool snapshotReader::read(size_t offset, size_t length, char* out, int slot) {
+    if (!container || offset + length > streamSize()) {
+        return false;
+    }
+
+    window& current = windows[slot];
+    while (length > 0) {
+        size_t block = offset / CONTAINER_PAYLOAD_SIZE;
+        if (block < current.firstBlock || block >= current.firstBlock + current.blocks) {
+            // Decode the next run of blocks on all workers
+            current.firstBlock = block;
+            current.blocks = min(SNAPSHOT_READ_AHEAD_BLOCKS, blockCount() - block);
+            current.payloads.resize(current.blocks * CONTAINER_PAYLOAD_SIZE);
+            damagedBlocks += decodeContainerBlocks(data + block * CONTAINER_BLOCK_SIZE, block,
+                                                   current.blocks, key, current.payloads.data());
+        }
+        size_t within = (block - current.firstBlock) * CONTAINER_PAYLOAD_SIZE +
+                        offset % CONTAINER_PAYLOAD_SIZE;
+        size_t count = min(length, CONTAINER_PAYLOAD_SIZE - offset % CONTAINER_PAYLOAD_SIZE);
+        memcpy(out, current.payloads.data() + within, count);
+        out += count;
+        offset += count;
+        length -= count;
+    }
+    return true;
+}
+
+/**
+ * Map a snapshot read-only for a sequential scan
+ *
+ * @param filename Snapshot file
+ * @param mapping Receives the mapping; unmapped by the caller
+ * @param size Receives the file size
+ * @return AccountFileStatus MISSING, INVALID if it cannot be mapped, otherwise OK
+ */
+static AccountFileStatus mapAccountFile(const string& filename, void*& mapping, size_t& size) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return errno == ENOENT ? AccountFileStatus::MISSING : AccountFileStatus::INVALID;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(accountFileHeader))) {
+        close(fd);
+        return AccountFileStatus::INVALID;
+    }
+
+    size = st.st_size;
+    mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return AccountFileStatus::INVALID;
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    return AccountFileStatus::OK;
+}
+
+/**
+ * Decrypt and validate the header of a mapped snapshot
+ *
+ * @param reader Reader over the mapping
+ * @param header Receives the header
+ * @return bool False if the file is not a snapshot this version can read
+ */
+static bool readHeader(snapshotReader& reader, accountFileHeader& header) {
+    memset(&header, 0, sizeof(header));
+    bool headerRead = reader.read(0, sizeof(header), reinterpret_cast<char*>(&header));
+
+    uint64_t recordsEnd = sizeof(header) + uint64_t(header.recordCount) * sizeof(accountFileRecord);
+    return headerRead && header.magic == ACCOUNT_FILE_MAGIC && header.version == ACCOUNT_FILE_VERSION &&
+           header.recordSize == sizeof(accountFileRecord) && recordsEnd <= header.nameHeapOffset &&
+           header.nameHeapOffset + header.nameHeapSize <= reader.streamSize();
+}
+
+/**
+ * Read a binary snapshot through a memory mapping
+ *
+ * Process:
+ * 1. Map the file read-only
+ * 2. Decrypt and validate the header
+ * 3. Decrypt each fixed-width record and its name; blocks are decoded
+ *    ahead of the scan in runs spread over several threads
+ * 4. Release the pages behind the scan as it moves on
+ *
+ * Error Handling:
+ * - A missing file is reported as MISSING
+ * - A bad header makes the whole file INVALID
+ * - Records failing their checksum or pointing outside the name heap
+ *   are reported by position and byte range and skipped, and the file
+ *   is DAMAGED; the other accounts are still read
+ * - A block failing its MAC is accepted only through the keyed
+ *   checksums of its records; this is what a write interrupted by a
+ *   crash during an in-place update leaves behind
+ *
+ * @param filename Snapshot file
+ * @param keys Decryption key material
+ * @param lastLsn Receives the last log sequence number folded into the snapshot
+ * @param visit Called for every account in file order
+ * @param report False to leave damage unreported, for a read that will be retried
+ * @return AccountFileStatus Outcome of the read
+ */
+AccountFileStatus readAccountFile(const string& filename, const KeyContext& keys, uint64_t& lastLsn,
+                                  const function<void(const AccountRecord&)>& visit, bool report) {
+    size_t size;
+    void* mapping;
+    AccountFileStatus mapped = mapAccountFile(filename, mapping, size);
+    if (mapped != AccountFileStatus::OK) {
+        return mapped;
+    }
+    const char* data = static_cast<const char*>(mapping);
+
+    const ContainerKey& containerKey = keys.container;
+    snapshotReader reader(data, size, containerKey);
+
+    accountFileHeader header;
+    if (!readHeader(reader, header)) {
+        munmap(mapping, size);
+        return AccountFileStatus::INVALID;
+    }
+
+    vector<damagedRange> damaged;
+    size_t recordsReleased = 0;
+    size_t namesReleased = reader.fileOffset(header.nameHeapOffset);
+    namesReleased -= namesReleased % sysconf(_SC_PAGESIZE);
+    for (uint32_t i = 0; i < header.recordCount; i++) {
+        size_t offset = recordOffset(i);
+        accountFileRecord record;
+        reader.read(offset, sizeof(record), reinterpret_cast<char*>(&record));
+
+        if (record.checksum != recordChecksum(record, containerKey) ||
+            uint64_t(record.nameOffset) + record.nameLength > header.nameHeapSize) {
+            addDamaged(damaged, i, reader.fileOffset(offset), reader.fileOffset(offset + sizeof(record)));
+            continue;
+        }
+
+        size_t nameOffset = header.nameHeapOffset + record.nameOffset;
+        AccountRecord account;
+        account.accountNumber = record.accountNumber;
+        account.name.resize(record.nameLength);
+        reader.read(nameOffset, record.nameLength, &account.name[0], 1);
+        account.type = static_cast<AccountTypeTag>(record.typeTag);
+        account.balanceCents = record.balanceCents;
+        account.lsn = record.lsn;
+        visit(account);
+
+        releaseMapped(data, recordsReleased,
+                      reader.fileOffset(min<size_t>(offset, header.nameHeapOffset)));
+        releaseMapped(data, namesReleased, reader.fileOffset(nameOffset));
+    }
+
+    if (report) {
+        reportDamaged(filename, "records", damaged);
+    }
+    if (report && reader.damagedBlocks > 0 && damaged.empty()) {
+        cerr << "Warning: " << filename << " has " << reader.damagedBlocks
+             << " block(s) from an interrupted update; their records passed their checksums" << endl;
+    }
+
+    lastLsn = header.lastLsn;
+    munmap(mapping, size);
+    return damaged.empty() ? AccountFileStatus::OK : AccountFileStatus::DAMAGED;
+}
+
+/**
+ * Read the identity of a snapshot without reading its records
+ *
+ * Only the header is decrypted, so this is cheap enough to do before
+ * every operation.
+ *
+ * @param filename Snapshot file
+ * @param keys Decryption key material
+ * @return AccountFileState Inode 0 if the file does not exist
+ */
+AccountFileState readAccountFileState(const string& filename, const KeyContext& keys) {
+    AccountFileState state;
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return state;
+    }
+
+    struct stat st;
+    accountFileHeader header;
+    if (fstat(fd, &st) == 0) {
+        state.inode = st.st_ino;
+        if (readContainerRange(fd, 0, sizeof(header), keys.container, reinterpret_cast<char*>(&header)) &&
+            header.magic == ACCOUNT_FILE_MAGIC) {
+            state.generation = header.generation;
+        }
+    }
+    close(fd);
+    return state;
+}
+
+/**
+ * Read the records changed in place after a log sequence number
+ *
+ * In-place updates only change balances, so names are not read. Every
+ * record is still decrypted, but nothing else of the book is rebuilt.
+ *
+ * @param filename Snapshot file
+ * @param keys Decryption key material
+ * @param sinceLsn Records at or below this sequence number are skipped
+ * @param visit Called with the position and contents of each changed record;
+ *              the name is left empty
+ * @return AccountFileStatus Outcome of the read
+ */
+AccountFileStatus readAccountFileChanges(const string& filename, const KeyContext& keys, uint64_t sinceLsn,
+                                         const function<void(size_t, const AccountRecord&)>& visit) {
+    size_t size;
+    void* mapping;
+    AccountFileStatus mapped = mapAccountFile(filename, mapping, size);
+    if (mapped != AccountFileStatus::OK) {
+        return mapped;
+    }
+
+    const ContainerKey& containerKey = keys.container;
+    snapshotReader reader(static_cast<const char*>(mapping), size, containerKey);
+    accountFileHeader header;
+    if (!readHeader(reader, header)) {
+        munmap(mapping, size);
+        return AccountFileStatus::INVALID;
+    }
+
+    bool damaged = false;
+    for (uint32_t i = 0; i < header.recordCount; i++) {
+        accountFileRecord record;
+        reader.read(recordOffset(i), sizeof(record), reinterpret_cast<char*>(&record));
+        if (record.checksum != recordChecksum(record, containerKey)) {
+            damaged = true;
+            continue;
+        }
+        if (record.lsn <= sinceLsn) {
+            continue;
+        }
+        AccountRecord account;
+        account.accountNumber = record.accountNumber;
+        account.type = static_cast<AccountTypeTag>(record.typeTag);
+        account.balanceCents = record.balanceCents;
+        account.lsn = record.lsn;
+        visit(i, account);
+    }
+
+    munmap(mapping, size);
+    return damaged ? AccountFileStatus::DAMAGED : AccountFileStatus::OK;
+}
+
+/**
+ * Write a binary snapshot
+ *
+ * Layout:
+ * header | records[recordCount] | name heap
+ * stored in a block container
+ *
+ * The file is replaced atomically; blocks that did not change since
+ * the previous snapshot are cloned from it rather than written again.
+ *
+ * @param filename Snapshot file to replace
+ * @param keys Encryption key material
+ * @param records Accounts to write, in file order
+ * @param lastLsn Last log sequence number reflected in the records
+ * @return bool True if the file was written completely
+ */
+bool writeAccountFile(const string& filename, const KeyContext& keys,
+                      const vector<AccountRecord>& records, uint64_t lastLsn) {
+    const ContainerKey& containerKey = keys.container;
+    size_t heapOffset = recordOffset(records.size());
+    size_t heapSize = 0;
+    for (const auto& account : records) {
+        heapSize += account.name.size();
+    }
+
+    string buffer(heapOffset + heapSize, '\0');
+
+    accountFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ACCOUNT_FILE_MAGIC;
+    header.version = ACCOUNT_FILE_VERSION;
+    header.recordCount = records.size();
+    header.recordSize = sizeof(accountFileRecord);
+    header.nameHeapOffset = heapOffset;
+    header.nameHeapSize = heapSize;
+    header.lastLsn = lastLsn;
+    memcpy(&buffer[0], &header, sizeof(header));
+
+    size_t nameOffset = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        const AccountRecord& account = records[i];
+        accountFileRecord record;
+        memset(&record, 0, sizeof(record));
+        record.accountNumber = account.accountNumber;
+        record.typeTag = static_cast<uint8_t>(account.type);
+        record.nameLength = account.name.size();
+        record.nameOffset = nameOffset;
+        record.balanceCents = account.balanceCents;
+        record.lsn = account.lsn;
+        record.checksum = recordChecksum(record, containerKey);
+        memcpy(&buffer[recordOffset(i)], &record, sizeof(record));
+
+        memcpy(&buffer[heapOffset + nameOffset], account.name.data(), account.name.size());
+        nameOffset += account.name.size();
+    }
+
+    return replaceFileAtomically(filename, encodeContainer(buffer, containerKey));
+}
+
+/**
+ * Count one more batch of in-place updates in the snapshot header
+ *
+ * Other sessions compare the generation with the one they last saw to
+ * notice records changed in place; the file's size and identity stay
+ * the same, and its modification time is too coarse to rely on.
+ *
+ * @param fd Snapshot open for reading and writing
+ * @param key Container key
+ * @return bool True if the header was written
+ */
+static bool bumpGeneration(int fd, const ContainerKey& key) {
+    ContainerUpdate result = updateContainerRange(fd, GENERATION_SECTOR_OFFSET, GENERATION_SECTOR_SIZE, key,
+                                                  [](char* bytes) {
+        uint64_t generation;
+        char* field = bytes + offsetof(accountFileHeader, generation) - GENERATION_SECTOR_OFFSET;
+        memcpy(&generation, field, sizeof(generation));
+        generation++;
+        memcpy(field, &generation, sizeof(generation));
+        return true;
+    });
+    return result == ContainerUpdate::WRITTEN;
+}
+
+/**
+ * Overwrite balances of existing records without rewriting the file
+ *
+ * Process:
+ * 1. Read and decrypt the block holding each target record, and check
+ *    that the record is intact, belongs to the expected account and is
+ *    at the expected log sequence number
+ * 2. Re-encrypt the block with the new balance, sequence number and checksum
+ * 3. Write back only the changed record and the block header with its new MAC
+ * 4. Bump the generation in the file header once for all updates
+ * 5. Sync the file once for all updates
+ *
+ * Records and block headers are 32 bytes and 32-byte aligned, so each
+ * write stays within one disk sector. Updates whose record does not
+ * match are left out and reported through their written flag.
+ *
+ * @param filename Snapshot file to update
+ * @param keys Encryption key material
+ * @param updates Updates to apply in order; written is set for each one applied
+ * @return bool False if the file could not be opened or synced
+ */
+bool updateAccountFileInPlace(const string& filename, const KeyContext& keys,
+                              vector<AccountFileUpdate>& updates) {
+    int fd = open(filename.c_str(), O_RDWR);
+    if (fd == -1) {
+        return false;
+    }
+
+    const ContainerKey& containerKey = keys.container;
+    accountFileHeader header;
+    bool headerOk = readContainerRange(fd, 0, sizeof(header), containerKey,
+                                       reinterpret_cast<char*>(&header)) &&
+                    header.magic == ACCOUNT_FILE_MAGIC && header.version == ACCOUNT_FILE_VERSION;
+
+    bool anyWritten = false;
+    for (auto& update : updates) {
+        update.written = false;
+        if (!headerOk || update.position >= header.recordCount) {
+            continue;
+        }
+
+        ContainerUpdate result = updateContainerRange(fd, recordOffset(update.position),
+                                                      sizeof(accountFileRecord), containerKey,
+                                                      [&](char* bytes) {
+            accountFileRecord record;
+            memcpy(&record, bytes, sizeof(record));
+            if (record.checksum != recordChecksum(record, containerKey) ||
+                record.accountNumber != update.accountNumber || record.lsn != update.expectedLsn) {
+                return false;
+            }
+            record.balanceCents = update.balanceCents;
+            record.lsn = update.lsn;
+            record.checksum = recordChecksum(record, containerKey);
+            memcpy(bytes, &record, sizeof(record));
+            return true;
+        });
+        if (result == ContainerUpdate::FAILED) {
+            cerr << "Error: Unable to write to " << filename << endl;
+            break;
+        }
+        update.written = result == ContainerUpdate::WRITTEN;
+        anyWritten = anyWritten || update.written;
+    }
+
+    // Records first, so a session that sees the new generation finds them
+    bool ok = !anyWritten || (bumpGeneration(fd, containerKey) && fdatasync(fd) == 0);
+    close(fd);
+    if (!ok) {
+        cerr << "Error: Unable to sync " << filename << endl;
+        for (auto& update : updates) {
+            update.written = false;
+        }
+    }
+    return ok;
+}
+
+/**
+ * Parse an integer or decimal CSV field
+ *
+ * Leading spaces are skipped and trailing characters ignored, as
+ * stoi and stod did.
+ *
+ * @param field Field text
+ * @param value Receives the parsed value
+ * @return bool False if the field does not start with a number
+ */
+template <typename T>
+static bool parseCsvNumber(string_view field, T& value) {
+    while (!field.empty() && isspace(static_cast<unsigned char>(field.front()))) {
+        field.remove_prefix(1);
+    }
+    if (!field.empty() && field.front() == '+') {
+        field.remove_prefix(1);
+    }
+    return from_chars(field.data(), field.data() + field.size(), value).ec == errc();
+}
+
+// Prefix of the line holding a block checksum
+const string_view CSV_BLOCK_MARKER = "#crc32c,";
+
+/**
+ * Format a checksum as 8 hex digits
+ *
+ * @param crc Checksum
+ * @return string Lower-case hex digits
+ */
+static string crcHex(uint32_t crc) {
+    char digits[8];
+    for (int i = 7; i >= 0; i--) {
+        digits[i] = "0123456789abcdef"[crc & 0xF];
+        crc >>= 4;
+    }
+    return string(digits, 8);
+}
+
+/**
+ * Parse a checksum written by crcHex
+ *
+ * @param field Field text
+ * @param crc Receives the checksum
+ * @return bool False unless the field is exactly 8 hex digits
+ */
+static bool parseCrcHex(string_view field, uint32_t& crc) {
+    return field.size() == 8 &&
+           from_chars(field.data(), field.data() + field.size(), crc, 16).ptr == field.data() + 8;
+}
+
+/**
+ * Parse one CSV line without copying its fields
+ *
+ * A fifth field, if present, is the line's checksum and must match
+ * the CRC-32C of the text before it.
+ *
+ * @param line accountNumber,name,type,balance[,crc]
+ * @param visit Called with the account if the line is valid
+ * @return bool False if the line cannot be parsed or fails its checksum
+ */
+static bool parseCsvLine(string_view line, const function<void(const AccountRecord&)>& visit) {
+    string_view fields[4];
+    string_view record = line;
+    for (int i = 0; i < 3; i++) {
+        size_t comma = line.find(',');
+        if (comma == string_view::npos) {
+            return false;
+        }
+        fields[i] = line.substr(0, comma);
+        line.remove_prefix(comma + 1);
+    }
+    fields[3] = line;
+
+    size_t comma = line.find(',');
+    if (comma != string_view::npos) {
+        uint32_t crc;
+        fields[3] = line.substr(0, comma);
+        record = record.substr(0, record.size() - line.size() + comma);
+        if (!parseCrcHex(line.substr(comma + 1), crc) || crc != crc32c(record.data(), record.size())) {
+            return false;
+        }
+    }
+
+    AccountRecord account;
+    double balance;
+    if (!parseCsvNumber(fields[0], account.accountNumber) || !parseCsvNumber(fields[3], balance)) {
+        return false;
+    }
+    account.name.assign(fields[1]);
+    account.type = accountTypeTag(fields[2]);
+    account.balanceCents = toCents(balance);
+    visit(account);
+    return true;
+}
+
+// Checks a CSV file line by line as it is decrypted
+class csvScanner {
+public:
+    csvScanner(const function<void(const AccountRecord&)>& visit) : visit(visit) {}
+
+    // Handles one line without its newline, starting at a byte offset of the file
+    void line(string_view text, size_t offset);
+
+    // Checks the lines after the last block checksum
+    void finish(size_t fileSize);
+
+    vector<damagedRange> damaged;       // Lines that could not be read
+    vector<damagedRange> unmatched;     // Blocks whose lines read but do not match their checksum
+    bool checksummed = false;           // The file has block checksums
+
+private:
+    void endBlock(bool matches, size_t endByte);
+
+    const function<void(const AccountRecord&)>& visit;
+    size_t lineNumber = 0;
+    uint32_t blockCrc = 0;
+    size_t blockLines = 0;
+    size_t blockStart = 0;              // Byte offset of the block's first line
+    bool blockDamaged = false;          // A line of the block was already reported
+};
+
+void csvScanner::line(string_view text, size_t offset) {
+    lineNumber++;
+    if (text.substr(0, CSV_BLOCK_MARKER.size()) == CSV_BLOCK_MARKER) {
+        string_view fields = text.substr(CSV_BLOCK_MARKER.size());
+        size_t comma = fields.find(',');
+        size_t lines = 0;
+        uint32_t crc = 0;
+        bool valid = comma != string_view::npos && parseCsvNumber(fields.substr(0, comma), lines) &&
+                     parseCrcHex(fields.substr(comma + 1), crc);
+        checksummed = true;
+        endBlock(valid && lines == blockLines && crc == blockCrc, offset);
+        blockStart = offset + text.size() + 1;
+        return;
+    }
+
+    blockCrc = crc32c(text.data(), text.size(), blockCrc);
+    blockCrc = crc32c("\n", 1, blockCrc);
+    blockLines++;
+    if (text.empty()) {
+        return;
+    }
+    if (!parseCsvLine(text, visit)) {
+        addDamaged(damaged, lineNumber, offset, offset + text.size() + 1);
+        blockDamaged = true;
+    }
+}
+
+void csvScanner::endBlock(bool matches, size_t endByte) {
+    if (!matches && !blockDamaged && blockLines > 0) {
+        unmatched.push_back({lineNumber - blockLines, lineNumber - 1, blockStart, endByte});
+    }
+    blockCrc = 0;
+    blockLines = 0;
+    blockDamaged = false;
+}
+
+void csvScanner::finish(size_t fileSize) {
+    // A file with block checksums ends with one; lines after it were not covered
+    if (checksummed && blockLines > 0) {
+        lineNumber++;
+        endBlock(false, fileSize);
+    }
+}
+
+/**
+ * Read an encrypted CSV account file
+ *
+ * File Format:
+ * accountNumber,name,type,balance[,crc]
+ * with a #crc32c,lines,crc line after every block of lines
+ *
+ * The file is decrypted into one reused chunk buffer and lines are
+ * parsed where they lie, so memory use does not grow with the file.
+ * Compressed files are decompressed chunk by chunk on the way, with
+ * the frames of a chunk decoded in parallel. Checksums are computed
+ * over the text as it is scanned.
+ *
+ * Error Handling:
+ * - Lines that cannot be parsed or fail their checksum are reported
+ *   by line number and byte range of the text and skipped
+ * - Blocks whose lines all read but whose block checksum does not
+ *   match, which is what a lost or duplicated line leaves, are reported
+ * - A damaged compressed frame is reported with the range of text it
+ *   held and skipped; the line it cuts fails its checksum. A damaged
+ *   frame header ends the read
+ * - Any of these makes the file DAMAGED; every intact account is still visited
+ *
+ * @param filename CSV file
+ * @param keys Decryption key material
+ * @param visit Called for every valid account in file order
+ * @return AccountFileStatus MISSING if the file does not exist
+ */
+AccountFileStatus readAccountCsv(const string& filename, const KeyContext& keys,
+                                 const function<void(const AccountRecord&)>& visit) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return AccountFileStatus::MISSING;
+    }
+
+    // A line may span two chunks; its start is carried over to the next one
+    csvScanner scanner(visit);
+    string partial;
+    size_t textOffset = 0;
+    auto scanText = [&](const char* chunk, size_t length) {
+        size_t start = 0;
+        const char* newline;
+        while ((newline = static_cast<const char*>(memchr(chunk + start, '\n', length - start)))) {
+            size_t lineEnd = newline - chunk;
+            if (partial.empty()) {
+                scanner.line(string_view(chunk + start, lineEnd - start), textOffset + start);
+            } else {
+                partial.append(chunk + start, lineEnd - start);
+                scanner.line(partial, textOffset + lineEnd - partial.size());
+                partial.clear();
+            }
+            start = lineEnd + 1;
+        }
+        partial.append(chunk + start, length - start);
+        textOffset += length;
+    };
+
+    LzStreamReader decompressor(scanText, [&](size_t rawLength) {
+        cerr << "Warning: " << filename << " has damaged text at bytes " << textOffset << "-"
+             << textOffset + rawLength << "; skipped" << endl;
+        textOffset += rawLength;
+    });
+    bool compressed = false;
+    bool firstChunk = true;
+    bool ok = decryptFileChunks(filename, keys.stream(), [&](const char* chunk, size_t length) {
+        if (firstChunk) {
+            compressed = isCompressed(chunk, length);
+            firstChunk = false;
+        }
+        if (compressed) {
+            decompressor.feed(chunk, length);
+        } else {
+            scanText(chunk, length);
+        }
+    });
+    if (!partial.empty()) {
+        scanner.line(partial, textOffset - partial.size());
+    }
+    if (!ok) {
+        return AccountFileStatus::INVALID;
+    }
+
+    bool truncated = compressed && !decompressor.finish();
+    if (truncated) {
+        cerr << "Warning: " << filename << " is damaged after byte " << textOffset
+             << " of its text; the rest was not read" << endl;
+    } else {
+        scanner.finish(textOffset);
+    }
+    reportDamaged(filename, "lines", scanner.damaged);
+    for (const auto& block : scanner.unmatched) {
+        cerr << "Warning: " << filename << " lines " << block.first << "-" << block.last
+             << " (bytes " << block.startByte << "-" << block.endByte
+             << ") do not match their block checksum; lines may be missing" << endl;
+    }
+    bool intact = scanner.damaged.empty() && scanner.unmatched.empty() &&
+                  !truncated && decompressor.skippedFrames == 0;
+    return intact ? AccountFileStatus::OK : AccountFileStatus::DAMAGED;
+}
+
+/**
+ * Write accounts as an encrypted CSV file
+ *
+ * Every line carries its own checksum, and every CSV_BLOCK_LINES lines
+ * are followed by the checksum of the block. The text is compressed
+ * before it is encrypted, and the file is replaced atomically.
+ *
+ * @param filename CSV file to replace
+ * @param keys Encryption key material
+ * @param records Accounts to write, in file order
+ * @return bool True if the file was written completely
+ */
+bool writeAccountCsv(const string& filename, const KeyContext& keys,
+                     const vector<AccountRecord>& records) {
+    string content;
+    size_t blockStart = 0;
+    size_t blockLines = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        const AccountRecord& record = records[i];
+        string line = to_string(record.accountNumber) + ","
+                    + record.name + ","
+                    + accountTypeName(record.type) + ","
+                    + to_string(fromCents(record.balanceCents));
+        content += line + "," + crcHex(crc32c(line.data(), line.size())) + "\n";
+        blockLines++;
+
+        if (blockLines == CSV_BLOCK_LINES || i + 1 == records.size()) {
+            uint32_t blockCrc = crc32c(content.data() + blockStart, content.size() - blockStart);
+            content += string(CSV_BLOCK_MARKER) + to_string(blockLines) + "," + crcHex(blockCrc) + "\n";
+            blockStart = content.size();
+            blockLines = 0;
+        }
+    }
+    string compressed = compressFrames(content.data(), content.size());
+    encryptDecryptParallel(&compressed[0], compressed.size(), keys.stream(), 0);
+    return replaceFileAtomically(filename, compressed);
+}
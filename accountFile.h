@@ -0,0 +1,113 @@
+/**
+ * Account File Format Header
+ *
+ * Purpose:
+ * Defines the on-disk formats of the account book.
+ *
+ * Binary Snapshot (accounts.dat, version 3):
+ * - 64-byte header: magic, version, record count, record size,
+ *   name heap location, the last log sequence number folded in and
+ *   a generation counting the batches of in-place updates since
+ * - Fixed-width 32-byte records: account number, type tag, flags,
+ *   name length and offset, checksum, balance in cents, last log
+ *   sequence number
+ * - Balance changes may be written into a record in place
+ * - Name heap holding the account holder names back to back
+ *
+ * The snapshot is stored in a block container (see blockContainer.h):
+ * each 4 KiB block is encrypted and authenticated on its own, so an
+ * in-place update re-encrypts one block instead of the whole file.
+ * Record checksums are keyed, so a record stays verifiable even when a
+ * crash leaves its block's MAC stale. The snapshot is memory-mapped for
+ * reading and needs no text parsing.
+ *
+ * CSV (accounts.txt):
+ * - accountNumber,name,type,balance,crc per line; crc is the CRC-32C
+ *   of the rest of the line in hex
+ * - After every CSV_BLOCK_LINES lines, a #crc32c,lines,crc line holds
+ *   the CRC-32C of the block, so lost or duplicated lines are noticed
+ * - The text is compressed into LZ frames (see lzCompressor.h) and then
+ *   encrypted as a whole
+ * - Uncompressed files and files without checksums are still read
+ * - Kept as the import/export format
+ *
+ * Damaged records are reported by position and byte range and skipped;
+ * the rest of the book is still read.
+ */
+
+#ifndef ACCOUNT_FILE_H
+#define ACCOUNT_FILE_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <sys/types.h>
+#include "accountStore.h"
+#include "keyContext.h"
+
+using namespace std;
+
+// Result of reading a snapshot
+enum class AccountFileStatus {
+    OK,
+    MISSING,
+    INVALID,
+    DAMAGED         // Read, but damaged records were reported and skipped
+};
+
+// Lines between two block checksums in a CSV file
+const size_t CSV_BLOCK_LINES = 1024;
+
+// Maps a binary snapshot and calls visit for every account in file order
+// lastLsn receives the log sequence number the snapshot is current to
+// Damaged records are reported on stderr unless report is false
+AccountFileStatus readAccountFile(const string& filename, const KeyContext& keys, uint64_t& lastLsn,
+                                  const function<void(const AccountRecord&)>& visit, bool report = true);
+
+// Identity of a snapshot as seen by a session
+struct AccountFileState {
+    ino_t inode = 0;            // 0 if the file does not exist
+    uint64_t generation = 0;    // Batches of in-place updates written into it
+
+    bool operator==(const AccountFileState& other) const {
+        return inode == other.inode && generation == other.generation;
+    }
+    bool operator!=(const AccountFileState& other) const { return !(*this == other); }
+};
+
+// Reads the inode and in-place update generation of a snapshot from its header
+AccountFileState readAccountFileState(const string& filename, const KeyContext& keys);
+
+// Calls visit with the position and balance of every intact record changed after sinceLsn
+AccountFileStatus readAccountFileChanges(const string& filename, const KeyContext& keys, uint64_t sinceLsn,
+                                         const function<void(size_t, const AccountRecord&)>& visit);
+
+// One balance change to write into an existing snapshot record
+struct AccountFileUpdate {
+    size_t position;            // Record number in file order
+    int accountNumber;          // Account the record must belong to
+    uint64_t expectedLsn;       // Sequence number the record must be at
+    int64_t balanceCents;
+    uint64_t lsn;               // Sequence number of this change
+    bool written = false;       // Set once the change is in the file
+};
+
+// Writes balance changes into their records and syncs the file once
+// Records that do not match their expected account and sequence number are skipped
+bool updateAccountFileInPlace(const string& filename, const KeyContext& keys,
+                              vector<AccountFileUpdate>& updates);
+
+// Writes a binary snapshot of the given accounts
+bool writeAccountFile(const string& filename, const KeyContext& keys,
+                      const vector<AccountRecord>& records, uint64_t lastLsn);
+
+// Reads an encrypted CSV account file and calls visit for every valid line
+AccountFileStatus readAccountCsv(const string& filename, const KeyContext& keys,
+                                 const function<void(const AccountRecord&)>& visit);
+
+// Writes the given accounts as an encrypted CSV file
+bool writeAccountCsv(const string& filename, const KeyContext& keys,
+                     const vector<AccountRecord>& records);
+
+#endif // ACCOUNT_FILE_H
@@ -0,0 +1,148 @@
+/**
+ * Account Index Implementation
+ *
+ * This file implements the open-addressing account number index:
+ * - Fibonacci hashing of account numbers
+ * - Linear probing for lookup and insert
+ * - Backward-shift deletion
+ */
+
+#include "accountIndex.h"
+#include <algorithm>
+
+using namespace std;
+
+const size_t MIN_CAPACITY = 16;
+
+/**
+ * Home position of an account number in the table
+ *
+ * Account numbers are handed out sequentially, so they are spread
+ * with a multiplicative hash before the table mask is applied.
+ *
+ * @param accountNumber Account number to place
+ * @return size_t Preferred table position
+ */
+size_t AccountIndex::home(int accountNumber) const {
+    uint64_t hash = static_cast<uint32_t>(accountNumber) * 0x9E3779B97F4A7C15ULL;
+    return (hash >> 32) & (table.size() - 1);
+}
+
+/**
+ * Find the slot of an account
+ *
+ * @param accountNumber Account to look up
+ * @return size_t Slot in the store, or NOT_FOUND
+ */
+size_t AccountIndex::find(int accountNumber) const {
+    if (table.empty()) {
+        return NOT_FOUND;
+    }
+    size_t mask = table.size() - 1;
+    for (size_t pos = home(accountNumber); table[pos].used; pos = (pos + 1) & mask) {
+        if (table[pos].accountNumber == accountNumber) {
+            return table[pos].slot;
+        }
+    }
+    return NOT_FOUND;
+}
+
+/**
+ * Add an account or move it to a new slot
+ *
+ * @param accountNumber Account to index
+ * @param slot Slot holding the account
+ */
+void AccountIndex::insert(int accountNumber, size_t slot) {
+    if ((count + 1) * 10 > table.size() * 7) {
+        grow(max(MIN_CAPACITY, table.size() * 2));
+    }
+
+    size_t mask = table.size() - 1;
+    size_t pos = home(accountNumber);
+    while (table[pos].used) {
+        if (table[pos].accountNumber == accountNumber) {
+            table[pos].slot = slot;
+            return;
+        }
+        pos = (pos + 1) & mask;
+    }
+    table[pos] = {accountNumber, true, slot};
+    count++;
+}
+
+/**
+ * Remove an account from the index
+ *
+ * Entries after the removed one are shifted back into the gap when
+ * that brings them closer to their home position, so every probe
+ * sequence stays unbroken without tombstones.
+ *
+ * @param accountNumber Account to remove
+ * @return bool True if the account was indexed
+ */
+bool AccountIndex::erase(int accountNumber) {
+    if (table.empty()) {
+        return false;
+    }
+    size_t mask = table.size() - 1;
+    size_t pos = home(accountNumber);
+    while (table[pos].used && table[pos].accountNumber != accountNumber) {
+        pos = (pos + 1) & mask;
+    }
+    if (!table[pos].used) {
+        return false;
+    }
+
+    size_t gap = pos;
+    for (size_t next = (gap + 1) & mask; table[next].used; next = (next + 1) & mask) {
+        size_t preferred = home(table[next].accountNumber);
+        // Move the entry unless its home lies cyclically in (gap, next]
+        if (((next - preferred) & mask) >= ((next - gap) & mask)) {
+            table[gap] = table[next];
+            gap = next;
+        }
+    }
+    table[gap].used = false;
+    count--;
+    return true;
+}
+
+/**
+ * Make room for a number of accounts
+ *
+ * @param expected Number of accounts the table should hold without growing
+ */
+void AccountIndex::reserve(size_t expected) {
+    size_t capacity = MIN_CAPACITY;
+    while (capacity * 7 < expected * 10) {
+        capacity *= 2;
+    }
+    if (capacity > table.size()) {
+        grow(capacity);
+    }
+}
+
+/**
+ * Remove every account from the index
+ */
+void AccountIndex::clear() {
+    table.clear();
+    count = 0;
+}
+
+/**
+ * Move every entry into a larger table
+ *
+ * @param capacity New table size (a power of two)
+ */
+void AccountIndex::grow(size_t capacity) {
+    vector<Entry> old = move(table);
+    table.assign(capacity, Entry{0, false, 0});
+    count = 0;
+    for (const Entry& entry : old) {
+        if (entry.used) {
+            insert(entry.accountNumber, entry.slot);
+        }
+    }
+}
@@ -0,0 +1,58 @@
+/**
+ * Account Index Header
+ *
+ * Purpose:
+ * Maps account numbers to the slot holding the account in the store.
+ * Open addressing with linear probing keeps every entry in one flat
+ * table, so a lookup touches one or two cache lines.
+ *
+ * Features:
+ * - Constant-time insert, lookup and erase
+ * - Erase by backward shifting, so no tombstones accumulate
+ * - Table doubles once it is more than 70% full
+ */
+
+#ifndef ACCOUNT_INDEX_H
+#define ACCOUNT_INDEX_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+class AccountIndex {
+public:
+    // Returned by find() for account numbers that are not indexed
+    static const size_t NOT_FOUND = SIZE_MAX;
+
+    // Returns the slot of the account, or NOT_FOUND
+    size_t find(int accountNumber) const;
+
+    // Adds or replaces the slot of an account
+    void insert(int accountNumber, size_t slot);
+
+    // Removes an account; returns false if it was not indexed
+    bool erase(int accountNumber);
+
+    // Makes room for the given number of accounts without growing
+    void reserve(size_t count);
+
+    void clear();
+    size_t size() const { return count; }
+
+private:
+    struct Entry {
+        int accountNumber;
+        bool used;
+        size_t slot;
+    };
+
+    size_t home(int accountNumber) const;
+    void grow(size_t capacity);
+
+    vector<Entry> table;        // Capacity is always a power of two
+    size_t count = 0;
+};
+
+#endif // ACCOUNT_INDEX_H
@@ -0,0 +1,131 @@
+/**
+ * Account Sequence Implementation
+ *
+ * This file implements the account number allocator:
+ * - Reading and writing the counter file
+ * - Seeding the counter from the book the first time it is used
+ * - Block reservation under an exclusive file lock
+ */
+
+#include "accountSequence.h"
+#include "accountStore.h"
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+using namespace std;
+
+const string SEQUENCE_FILE = "account_sequence";
+const uint32_t SEQUENCE_MAGIC = 0x51534B42;     // "BKSQ"
+const int FIRST_ACCOUNT_NUMBER = 1000;
+
+// On-disk layout of the counter
+struct sequenceDisk {
+    uint32_t magic;
+    int32_t nextAccountNumber;
+    uint32_t checksum;
+};
+
+/**
+ * Checksum of the stored counter
+ *
+ * @param next Next unreserved account number
+ * @return uint32_t Value stored alongside the counter
+ */
+static uint32_t sequenceChecksum(int32_t next) {
+    return (static_cast<uint32_t>(next) * 2654435761u) ^ SEQUENCE_MAGIC;
+}
+
+/**
+ * First free number according to the book
+ *
+ * Only used when the counter file does not exist yet.
+ *
+ * @return int One past the highest account number, or the first number for an empty book
+ */
+static int seedFromBook() {
+    int next = FIRST_ACCOUNT_NUMBER;
+    for (const auto& record : AccountStore::instance().all()) {
+        if (record.accountNumber >= next) {
+            next = record.accountNumber + 1;
+        }
+    }
+    return next;
+}
+
+/**
+ * Read the counter, move it forward and write it back under the file lock
+ *
+ * Process:
+ * 1. Lock the counter file
+ * 2. Read the next number (seed it from the book if the file is new)
+ * 3. Let advance pick the new value and write it durably
+ *
+ * @param advance Gets the current next number, returns the new one
+ * @return int The number before advancing, or -1 on error
+ */
+static int updateSequence(const function<int(int)>& advance) {
+    int fd = open(SEQUENCE_FILE.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd == -1) {
+        cerr << "Error: Unable to open " << SEQUENCE_FILE << endl;
+        return -1;
+    }
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    sequenceDisk stored;
+    ssize_t bytes = pread(fd, &stored, sizeof(stored), 0);
+    int current;
+    if (bytes == 0) {
+        current = seedFromBook();
+    } else if (bytes == sizeof(stored) && stored.magic == SEQUENCE_MAGIC &&
+               stored.checksum == sequenceChecksum(stored.nextAccountNumber)) {
+        current = stored.nextAccountNumber;
+    } else {
+        cerr << "Warning: " << SEQUENCE_FILE << " is damaged; recovering it from the account book" << endl;
+        current = seedFromBook();
+    }
+
+    int next = advance(current);
+    stored = {SEQUENCE_MAGIC, next, sequenceChecksum(next)};
+    bool ok = pwrite(fd, &stored, sizeof(stored), 0) == sizeof(stored) && fdatasync(fd) == 0;
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    if (!ok) {
+        cerr << "Error: Unable to write " << SEQUENCE_FILE << endl;
+        return -1;
+    }
+    return current;
+}
+
+/**
+ * Reserve a block of account numbers
+ *
+ * The numbers are never handed out again, even if they are not used.
+ *
+ * @param count How many consecutive numbers to reserve
+ * @return int First reserved number, or -1 on error
+ */
+int reserveAccountNumbers(int count) {
+    if (count < 1) {
+        return -1;
+    }
+    return updateSequence([count](int current) { return current + count; });
+}
+
+/**
+ * Move the counter past externally chosen account numbers
+ *
+ * @param nextAccountNumber Lowest number that may still be handed out
+ */
+void advanceAccountSequence(int nextAccountNumber) {
+    updateSequence([nextAccountNumber](int current) { return max(current, nextAccountNumber); });
+}
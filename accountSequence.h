@@ -0,0 +1,30 @@
+/**
+ * Account Sequence Header
+ *
+ * Purpose:
+ * Hands out account numbers from a small durable counter file, so new
+ * numbers never depend on the contents or order of the account book.
+ *
+ * Features:
+ * - Numbers only ever increase, across sessions and restarts
+ * - Blocks of numbers can be reserved in one step for bulk creation
+ * - Safe across processes through a lock on the counter file
+ *
+ * File Format (account_sequence):
+ * - Magic number, next unreserved account number and a checksum
+ */
+
+#ifndef ACCOUNT_SEQUENCE_H
+#define ACCOUNT_SEQUENCE_H
+
+using namespace std;
+
+// Reserves count consecutive account numbers and returns the first one
+// Returns -1 if the counter file cannot be read or written
+int reserveAccountNumbers(int count);
+
+// Makes sure no number below the given one is handed out again
+// Used after accounts with externally chosen numbers were added
+void advanceAccountSequence(int nextAccountNumber);
+
+#endif // ACCOUNT_SEQUENCE_H
@@ -0,0 +1,1161 @@
+/**
+ * Account Store Implementation
+ *
+ * This file implements the in-memory account book:
+ * - One-time loading of the binary accounts file
+ * - Account number index maintenance
+ * - Write-ahead logging of every mutation
+ * - Group commit of concurrent writers
+ * - Background checkpoints and crash recovery
+ * - Detection of changes made by other sessions
+ *
+ * On-Disk State:
+ * - accounts.dat      binary snapshot of the book at the last checkpoint
+ * - accounts.txt      CSV book of older versions, imported if no snapshot exists
+ * - accounts.wal.old  log being folded by a running checkpoint
+ * - accounts.wal      log of mutations since the last rotation
+ *
+ * The book is the snapshot with both logs replayed on top, in that order.
+ */
+
+#include "accountStore.h"
+#include "writeAheadLog.h"
+#include "accountFile.h"
+#include "simpleEncryption.h"
+#include "fileLock.h"
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <unordered_set>
+#include <filesystem>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+const string ACCOUNT_FILE = "accounts.dat";
+const string LEGACY_ACCOUNT_FILE = "accounts.txt";
+const string DAMAGED_ACCOUNT_FILE = "accounts.dat.damaged";
+const string WAL_FILE = "accounts.wal";
+const string WAL_ROTATED_FILE = "accounts.wal.old";
+const string BOOK_LOCK_FILE = "accounts.lock";
+const string RECORD_LOCK_FILE = "accounts.records.lock";   // Byte n stands for account n
+const string CHECKPOINT_LOCK_FILE = "accounts.checkpoint.lock";
+const string ENCRYPTION_KEY = "your_secret_key_here";
+
+// Log records accumulated before a background checkpoint is started
+const off_t CHECKPOINT_INTERVAL = 1000;
+
+// Reads of the accounts file before damage found in it is believed; an
+// in-place update of another session may be half written at the time
+const int SNAPSHOT_READ_ATTEMPTS = 3;
+const chrono::milliseconds SNAPSHOT_RETRY_PAUSE(2);
+
+// Longest wait for a lock held by another session before an operation fails
+const chrono::milliseconds LOCK_TIMEOUT(5000);
+
+// Default group commit settings
+const chrono::microseconds DEFAULT_BATCH_WINDOW(1000);
+const size_t DEFAULT_BATCH_RECORDS = 64;
+
+/**
+ * Map a type identifier to its one-byte tag
+ *
+ * Accepts the names returned by getType() as well as the
+ * identifiers used by older account files. Unknown names are
+ * treated as basic checking accounts.
+ *
+ * @param typeName Type identifier
+ * @return AccountTypeTag Matching tag
+ */
+AccountTypeTag accountTypeTag(string_view typeName) {
+    static const unordered_map<string_view, AccountTypeTag> tags = {
+        {"Checking", AccountTypeTag::CHECKING},
+        {"Service Charge Checking", AccountTypeTag::SERVICE_CHARGE_CHECKING},
+        {"ServiceChargeChecking", AccountTypeTag::SERVICE_CHARGE_CHECKING},
+        {"No Service Charge Checking", AccountTypeTag::NO_SERVICE_CHARGE_CHECKING},
+        {"NoServiceChargeChecking", AccountTypeTag::NO_SERVICE_CHARGE_CHECKING},
+        {"High Interest Checking", AccountTypeTag::HIGH_INTEREST_CHECKING},
+        {"HighInterestChecking", AccountTypeTag::HIGH_INTEREST_CHECKING},
+        {"Savings", AccountTypeTag::SAVINGS},
+        {"High Interest Savings", AccountTypeTag::HIGH_INTEREST_SAVINGS},
+        {"HighInterestSavings", AccountTypeTag::HIGH_INTEREST_SAVINGS},
+        {"Certificate of Deposit", AccountTypeTag::CERTIFICATE_OF_DEPOSIT},
+        {"CertificateOfDeposit", AccountTypeTag::CERTIFICATE_OF_DEPOSIT}
+    };
+    auto it = tags.find(typeName);
+    return it != tags.end() ? it->second : AccountTypeTag::CHECKING;
+}
+
+/**
+ * Get the full name of a type tag
+ *
+ * Every tag has its own name, so accountTypeTag() maps it back to
+ * the same tag. Returned as a literal, so listings do not allocate.
+ *
+ * @param tag Type tag
+ * @return const char* Name as shown to users and written to CSV files
+ */
+const char* accountTypeName(AccountTypeTag tag) {
+    switch (tag) {
+        case AccountTypeTag::SERVICE_CHARGE_CHECKING: return "Service Charge Checking";
+        case AccountTypeTag::NO_SERVICE_CHARGE_CHECKING: return "No Service Charge Checking";
+        case AccountTypeTag::HIGH_INTEREST_CHECKING: return "High Interest Checking";
+        case AccountTypeTag::SAVINGS: return "Savings";
+        case AccountTypeTag::HIGH_INTEREST_SAVINGS: return "High Interest Savings";
+        case AccountTypeTag::CERTIFICATE_OF_DEPOSIT: return "Certificate of Deposit";
+        default: return "Checking";
+    }
+}
+
+/**
+ * Convert a dollar amount to integer cents, rounding to the nearest cent
+ *
+ * @param amount Amount in dollars
+ * @return int64_t Amount in cents
+ */
+int64_t toCents(double amount) {
+    return llround(amount * 100.0);
+}
+
+/**
+ * Convert integer cents to a dollar amount
+ *
+ * @param cents Amount in cents
+ * @return double Amount in dollars
+ */
+double fromCents(int64_t cents) {
+    return cents / 100.0;
+}
+
+/**
+ * Get the process-wide account store
+ *
+ * @return AccountStore& The shared store instance
+ */
+AccountStore& AccountStore::instance() {
+    static AccountStore store;
+    return store;
+}
+
+/**
+ * Create the store with the default group commit settings
+ *
+ * The encryption keys are derived here once; the book itself is
+ * loaded lazily on first use.
+ */
+AccountStore::AccountStore()
+    : keys(keyContextFor(ENCRYPTION_KEY)), batchWindow(DEFAULT_BATCH_WINDOW), batchMaxRecords(DEFAULT_BATCH_RECORDS) {
+}
+
+/**
+ * Wait for a running checkpoint before the process exits
+ */
+AccountStore::~AccountStore() {
+    if (checkpointThread.joinable()) {
+        checkpointThread.join();
+    }
+}
+
+/**
+ * Find an account by number
+ *
+ * Uses the account number index, so the cost does not
+ * depend on the number of accounts in the book.
+ *
+ * @param accountNumber Account to find
+ * @return optional<AccountRecord> Copy of the account, empty if not found
+ */
+optional<AccountRecord> AccountStore::findAccount(int accountNumber) {
+    lock_guard<mutex> guard(storeMutex);
+    refresh();
+    size_t slot = index.find(accountNumber);
+    if (slot == AccountIndex::NOT_FOUND) {
+        return nullopt;
+    }
+    return *records[slot];
+}
+
+/**
+ * Find several accounts by number
+ *
+ * One index lookup per number under a single lock, so the cost
+ * depends on the number of accounts asked for, not on the book.
+ *
+ * @param accountNumbers Accounts to find
+ * @return vector<AccountRecord> Copies of the accounts that exist, in the order asked for
+ */
+vector<AccountRecord> AccountStore::findAccounts(const vector<int>& accountNumbers) {
+    lock_guard<mutex> guard(storeMutex);
+    refresh();
+    vector<AccountRecord> found;
+    found.reserve(accountNumbers.size());
+    for (int accountNumber : accountNumbers) {
+        size_t slot = index.find(accountNumber);
+        if (slot != AccountIndex::NOT_FOUND) {
+            found.push_back(*records[slot]);
+        }
+    }
+    return found;
+}
+
+/**
+ * Get every account in file order
+ *
+ * @return vector<AccountRecord> Copy of all accounts
+ */
+vector<AccountRecord> AccountStore::all() {
+    lock_guard<mutex> guard(storeMutex);
+    refresh();
+    return liveRecords();
+}
+
+/**
+ * Visit every account in file order
+ *
+ * Nothing is copied, so a full scan costs no memory beyond what
+ * the visitor keeps.
+ *
+ * @param visit Called for each account; must not use the store
+ */
+void AccountStore::forEach(const function<void(const AccountRecord&)>& visit) {
+    lock_guard<mutex> guard(storeMutex);
+    refresh();
+    for (const auto& record : records) {
+        if (record) {
+            visit(*record);
+        }
+    }
+}
+
+/**
+ * Visit selected accounts through the index
+ *
+ * @param accountNumbers Accounts to visit
+ * @param visit Called for each account that exists; must not use the store
+ */
+void AccountStore::forEach(const vector<int>& accountNumbers,
+                           const function<void(const AccountRecord&)>& visit) {
+    lock_guard<mutex> guard(storeMutex);
+    refresh();
+    for (int accountNumber : accountNumbers) {
+        size_t slot = index.find(accountNumber);
+        if (slot != AccountIndex::NOT_FOUND) {
+            visit(*records[slot]);
+        }
+    }
+}
+
+/**
+ * Count the accounts in the book
+ *
+ * @return size_t Number of accounts
+ */
+size_t AccountStore::size() {
+    lock_guard<mutex> guard(storeMutex);
+    refresh();
+    return index.size();
+}
+
+/**
+ * Add a new account to the book
+ *
+ * @param record Account to add
+ * @return bool False if the account number is already in use or the write failed
+ */
+bool AccountStore::insert(const AccountRecord& record) {
+    return mutate([&]() -> vector<WalEntry> {
+        if (index.find(record.accountNumber) != AccountIndex::NOT_FOUND) {
+            return {};
+        }
+        return {WalEntry{WalOperation::CREATE, 0, record}};
+    });
+}
+
+/**
+ * Add several new accounts in one batch
+ *
+ * All accounts are written together, so a large import costs one
+ * commit instead of one per account. Accounts whose number is already
+ * in use, in the book or earlier in the list, are left out.
+ *
+ * @param newRecords Accounts to add
+ * @return size_t Number of accounts added once durable, 0 if the batch failed
+ */
+size_t AccountStore::insertAll(const vector<AccountRecord>& newRecords) {
+    size_t added = 0;
+    bool ok = mutate([&]() -> vector<WalEntry> {
+        vector<WalEntry> entries;
+        unordered_set<int> batchNumbers;
+        for (const auto& record : newRecords) {
+            if (index.find(record.accountNumber) == AccountIndex::NOT_FOUND &&
+                batchNumbers.insert(record.accountNumber).second) {
+                entries.push_back(WalEntry{WalOperation::CREATE, 0, record});
+            }
+        }
+        added = entries.size();
+        return entries;
+    });
+    return ok ? added : 0;
+}
+
+/**
+ * Check that an account is still at the version a change was based on
+ *
+ * Called under the store lock from a mutation's prepare step.
+ *
+ * @param accountNumber Account to check
+ * @param expectedLsn Version the caller read
+ * @param result Set to NOT_FOUND or CONFLICT when the check fails
+ * @return size_t Slot of the account, or AccountIndex::NOT_FOUND if the check failed
+ */
+size_t AccountStore::unchangedSlot(int accountNumber, uint64_t expectedLsn, UpdateResult& result) {
+    size_t slot = index.find(accountNumber);
+    if (slot == AccountIndex::NOT_FOUND) {
+        result = UpdateResult::NOT_FOUND;
+    } else if (records[slot]->lsn != expectedLsn) {
+        result = UpdateResult::CONFLICT;
+        slot = AccountIndex::NOT_FOUND;
+    }
+    return slot;
+}
+
+/**
+ * Update an existing account's name and balance, unless it changed
+ *
+ * The comparison with the expected version and the change happen in
+ * one step under the book lock, so no change of another session or
+ * thread can come between them. The stored type identifier is left
+ * untouched.
+ *
+ * @param accountNumber Account to update
+ * @param expectedLsn Version (lsn) of the account the new values were based on
+ * @param name New account holder name
+ * @param balanceCents New balance in cents
+ * @return UpdateResult UPDATED once durable; CONFLICT if the account changed since expectedLsn
+ */
+UpdateResult AccountStore::update(int accountNumber, uint64_t expectedLsn,
+                                  const string& name, int64_t balanceCents) {
+    // A name too long for a log record is saved by a checkpoint, which needs the whole book
+    vector<int> accountNumbers;
+    if (walEntryFits(AccountRecord{accountNumber, name, AccountTypeTag::CHECKING, balanceCents})) {
+        accountNumbers.push_back(accountNumber);
+    }
+    UpdateResult result = UpdateResult::UPDATED;
+    bool ok = mutate([&]() -> vector<WalEntry> {
+        size_t slot = unchangedSlot(accountNumber, expectedLsn, result);
+        if (slot == AccountIndex::NOT_FOUND) {
+            return {};
+        }
+        AccountRecord updated = *records[slot];
+        updated.name = name;
+        updated.balanceCents = balanceCents;
+        return {WalEntry{WalOperation::UPDATE, 0, updated}};
+    }, accountNumbers);
+    return (ok || result != UpdateResult::UPDATED) ? result : UpdateResult::FAILED;
+}
+
+/**
+ * Change the balances of several accounts together, unless any changed
+ *
+ * Either every balance is changed or none: all accounts are compared
+ * with their expected versions before any is touched, and the changes
+ * join the same batch. A crash while that batch is written can still
+ * keep only part of it, as for any batch. If an account's record in the accounts file is
+ * unchanged since the last checkpoint, its new balance is written into
+ * that record directly and no log entry is needed.
+ *
+ * Only the records of the accounts involved are locked, in ascending
+ * order, so a transfer cannot deadlock with another one in the opposite
+ * direction. A batch naming an account twice is rejected before anything
+ * is locked, since only one of its balances could be kept.
+ *
+ * @param updates Accounts with the versions their new balances were based on
+ * @return UpdateResult UPDATED once durable; CONFLICT if any account changed since its version;
+ *         DUPLICATE if an account appears more than once
+ */
+UpdateResult AccountStore::updateBalances(const vector<BalanceUpdate>& updates) {
+    vector<int> accountNumbers;
+    accountNumbers.reserve(updates.size());
+    for (const auto& update : updates) {
+        accountNumbers.push_back(update.accountNumber);
+    }
+    sort(accountNumbers.begin(), accountNumbers.end());
+    if (adjacent_find(accountNumbers.begin(), accountNumbers.end()) != accountNumbers.end()) {
+        return UpdateResult::DUPLICATE;
+    }
+
+    UpdateResult result = UpdateResult::UPDATED;
+    bool ok = mutate([&]() -> vector<WalEntry> {
+        vector<WalEntry> entries;
+        for (const auto& update : updates) {
+            size_t slot = unchangedSlot(update.accountNumber, update.expectedLsn, result);
+            if (slot == AccountIndex::NOT_FOUND) {
+                return {};
+            }
+            AccountRecord updated = *records[slot];
+            updated.balanceCents = update.balanceCents;
+            entries.push_back(WalEntry{WalOperation::UPDATE, 0, updated});
+        }
+        return entries;
+    }, accountNumbers, true);
+    return (ok || result != UpdateResult::UPDATED) ? result : UpdateResult::FAILED;
+}
+
+/**
+ * Remove an account from the book
+ *
+ * @param accountNumber Account to remove
+ * @return bool True if the account was found and the removal is durable
+ */
+bool AccountStore::remove(int accountNumber) {
+    return mutate([&]() -> vector<WalEntry> {
+        size_t slot = index.find(accountNumber);
+        if (slot == AccountIndex::NOT_FOUND) {
+            return {};
+        }
+        return {WalEntry{WalOperation::REMOVE, 0, *records[slot]}};
+    });
+}
+
+/**
+ * Fold the log into the accounts file and wait for completion
+ */
+void AccountStore::checkpoint() {
+    unique_lock<mutex> guard(storeMutex);
+    batchDone.wait(guard, [this] { return !batchOpen && !flushing; });
+
+    FileLockGuard bookLock(BOOK_LOCK_FILE, LockMode::EXCLUSIVE, LOCK_TIMEOUT);
+    if (!bookLock) {
+        cerr << "Error: " << BOOK_LOCK_FILE << " is held by another session; checkpoint skipped" << endl;
+        return;
+    }
+    refreshLocked();
+    bool started = cutTornLogTail() && startCheckpoint(true);
+    bookLock.release();
+    if (started) {
+        checkpointThread.join();
+    }
+}
+
+/**
+ * Configure the group commit stage
+ *
+ * @param window How long the first writer of a batch waits for others
+ * @param maxRecords Batch size that triggers an immediate flush
+ */
+void AccountStore::setGroupCommit(chrono::microseconds window, size_t maxRecords) {
+    lock_guard<mutex> guard(storeMutex);
+    batchWindow = window;
+    batchMaxRecords = maxRecords > 0 ? maxRecords : 1;
+}
+
+/**
+ * Commit one mutation through the group commit stage
+ *
+ * Process:
+ * 1. A change confined to given accounts locks just their records and
+ *    shares the book lock, so sessions changing different accounts do
+ *    not wait for each other; any other change takes the book lock
+ *    exclusively. Every lock is waited for up to LOCK_TIMEOUT, and the
+ *    change fails without touching the book if one is not free in time
+ * 2. The first writer to arrive opens a batch: it takes the book lock,
+ *    catches up with the files on disk and, holding the lock
+ *    exclusively, cuts off a torn log tail. Writers joining a batch
+ *    that shares the book catch up again, as their accounts may have
+ *    changed before they locked them
+ * 3. Every writer validates its change, assigns each of its entries the
+ *    next log sequence number and applies them to memory, in arrival order;
+ *    the entries of one change are validated and applied together
+ * 4. The opener waits for the batch window or until the batch is full,
+ *    then appends the whole batch with one write and one fdatasync
+ * 5. Every writer in the batch is released once the batch is durable
+ *
+ * An exclusive change waits for a batch sharing the book to finish
+ * rather than join it. Log sequence numbers of changes to different
+ * accounts may coincide across sessions sharing the book; they only
+ * order the changes of one account, which its record lock serialises.
+ *
+ * If the batch cannot be written, or the log ends with more damage than
+ * a torn tail, the batch fails and the in-memory book is reloaded from
+ * disk so that changes which never became durable are dropped.
+ *
+ * Entries whose name or type does not fit a fixed-size log record are
+ * written with a synchronous checkpoint after the batch.
+ *
+ * Balance-only changes to accounts whose record in the accounts file is
+ * still current are written into that record instead of the log.
+ *
+ * @param prepare Builds the entries from the current book, or none if the
+ *                change is not valid
+ * @param accountNumbers Accounts the change is confined to; empty for
+ *                       creating or removing accounts
+ * @param inPlace The change only touches the balance
+ * @return bool True if the change was valid and is durable
+ */
+bool AccountStore::mutate(const function<vector<WalEntry>()>& prepare,
+                          const vector<int>& accountNumbers, bool inPlace) {
+    optional<RecordLockGuard> recordLock;
+    if (!accountNumbers.empty()) {
+        recordLock.emplace(RECORD_LOCK_FILE, vector<off_t>(accountNumbers.begin(), accountNumbers.end()),
+                           LOCK_TIMEOUT);
+        if (!*recordLock) {
+            cerr << "Error: the account is being changed by another session; changes not saved" << endl;
+            return false;
+        }
+    }
+    LockMode mode = accountNumbers.empty() ? LockMode::EXCLUSIVE : LockMode::SHARED;
+
+    unique_lock<mutex> guard(storeMutex);
+    batchDone.wait(guard, [this, mode] {
+        return !flushing && (!batchOpen || mode == LockMode::SHARED || batchMode == LockMode::EXCLUSIVE);
+    });
+
+    bool leader = !batchOpen;
+    optional<FileLockGuard> bookLock;
+    if (leader) {
+        bookLock.emplace(BOOK_LOCK_FILE, mode, LOCK_TIMEOUT);
+        if (*bookLock) {
+            refreshLocked();
+        }
+        struct stat st;
+        if (*bookLock && mode == LockMode::SHARED &&
+            stat(WAL_FILE.c_str(), &st) == 0 && st.st_size > logOffset) {
+            // A torn tail, or another session's append in progress; only
+            // the exclusive holder can tell them apart and cut the tail
+            mode = LockMode::EXCLUSIVE;
+            bookLock.emplace(BOOK_LOCK_FILE, mode, LOCK_TIMEOUT);
+            if (*bookLock) {
+                refreshLocked();
+            }
+        }
+        if (!*bookLock) {
+            cerr << "Error: " << BOOK_LOCK_FILE << " is held by another session; changes not saved" << endl;
+            return false;
+        }
+        batchMode = mode;
+        batchRefused = mode == LockMode::EXCLUSIVE && !cutTornLogTail();
+        batchOpen = true;
+    } else if (batchMode == LockMode::SHARED && !catchUpBatch()) {
+        return false;
+    }
+    uint64_t batch = batchSequence;
+
+    vector<WalEntry> changes = prepare();
+    for (WalEntry& entry : changes) {
+        entry.lsn = nextLsn;
+        size_t position = inPlace ? snapshotPositions.find(entry.account.accountNumber)
+                                  : AccountIndex::NOT_FOUND;
+        if (position != AccountIndex::NOT_FOUND) {
+            uint64_t previousLsn = records[index.find(entry.account.accountNumber)]->lsn;
+            pendingInPlace.push_back({position, entry.account.accountNumber, previousLsn,
+                                      entry.account.balanceCents, entry.lsn});
+            pendingInPlaceEntries.push_back(entry);
+            apply(entry, false);
+        } else if (walEntryFits(entry.account)) {
+            pendingEntries.push_back(entry);
+            apply(entry);
+        } else {
+            pendingCheckpoint = true;
+            apply(entry);
+        }
+    }
+    if (pendingEntries.size() + pendingInPlace.size() >= batchMaxRecords) {
+        batchFull.notify_one();
+    }
+
+    if (!leader) {
+        batchDone.wait(guard, [this, batch] { return batchSequence > batch; });
+        return !changes.empty() && !failedBatches.count(batch);
+    }
+
+    batchFull.wait_for(guard, batchWindow, [this] {
+        return pendingEntries.size() + pendingInPlace.size() >= batchMaxRecords;
+    });
+    vector<WalEntry> entries = move(pendingEntries);
+    pendingEntries.clear();
+    vector<AccountFileUpdate> inPlaceUpdates = move(pendingInPlace);
+    pendingInPlace.clear();
+    vector<WalEntry> inPlaceEntries = move(pendingInPlaceEntries);
+    pendingInPlaceEntries.clear();
+    bool needsCheckpoint = pendingCheckpoint;
+    pendingCheckpoint = false;
+    bool ok = !batchRefused;
+    batchOpen = false;
+    flushing = true;
+
+    guard.unlock();
+    if (ok) {
+        writeInPlace(inPlaceUpdates, inPlaceEntries, entries, needsCheckpoint);
+        ok = entries.empty() || appendWalEntries(WAL_FILE, entries, keys);
+    }
+    guard.lock();
+
+    // Accounts whose change went to the log now differ from their record
+    for (const auto& entry : entries) {
+        snapshotPositions.erase(entry.account.accountNumber);
+    }
+
+    if (ok && batchMode == LockMode::SHARED) {
+        catchUp();      // Other sessions may have appended before or after this batch
+    } else if (ok) {
+        logOffset += entries.size() * WAL_RECORD_SIZE;
+        if (logInode == 0) {
+            struct stat st;
+            if (stat(WAL_FILE.c_str(), &st) == 0) {
+                logInode = st.st_ino;
+            }
+        }
+    }
+    bool checkpointDue = logOffset >= CHECKPOINT_INTERVAL * static_cast<off_t>(WAL_RECORD_SIZE);
+    if (ok && batchMode == LockMode::SHARED && (needsCheckpoint || checkpointDue)) {
+        // Only the exclusive holder may rotate the log; a due checkpoint
+        // does not wait for it, a needed one does
+        bool upgraded = upgradeBookLock(bookLock, needsCheckpoint ? LOCK_TIMEOUT : chrono::milliseconds(0));
+        ok = upgraded || !needsCheckpoint;
+        checkpointDue = checkpointDue && upgraded;
+    }
+    if (ok) {
+        if (needsCheckpoint) {
+            ok = startCheckpoint(true);
+            if (ok) {
+                checkpointThread.join();
+            }
+        } else if (checkpointDue) {
+            startCheckpoint(false);
+        }
+    }
+    if (!ok) {
+        failedBatches.insert(batch);
+        loaded = false;
+    }
+
+    bookLock.reset();
+    flushing = false;
+    batchSequence++;
+    batchDone.notify_all();
+    return !changes.empty() && ok;
+}
+
+/**
+ * Write a batch's balance changes into the accounts file
+ *
+ * Skipped while a checkpoint of any session is replacing the file.
+ * Changes that cannot be written in place are moved to the batch's
+ * log entries instead, so every change ends up durable one way or
+ * the other.
+ *
+ * Called without the store mutex, while holding the book lock.
+ *
+ * @param updates Record updates, in commit order
+ * @param updateEntries The same changes as log entries
+ * @param entries Log entries of the batch; receives the changes not written
+ * @param needsCheckpoint Set if a change not written does not fit a log record
+ */
+void AccountStore::writeInPlace(vector<AccountFileUpdate>& updates, const vector<WalEntry>& updateEntries,
+                                vector<WalEntry>& entries, bool& needsCheckpoint) {
+    if (updates.empty()) {
+        return;
+    }
+
+    bool written = false;
+    if (!checkpointRunning) {
+        FileLockGuard checkpointLock(CHECKPOINT_LOCK_FILE, LockMode::EXCLUSIVE, chrono::milliseconds(0));
+        if (checkpointLock) {
+            updateAccountFileInPlace(ACCOUNT_FILE, keys, updates);
+            rememberSnapshotState();
+            written = true;
+        }
+    }
+
+    for (size_t i = 0; i < updates.size(); i++) {
+        if (written && updates[i].written) {
+            continue;
+        }
+        if (walEntryFits(updateEntries[i].account)) {
+            entries.push_back(updateEntries[i]);
+        } else {
+            needsCheckpoint = true;
+        }
+    }
+    sort(entries.begin(), entries.end(),
+         [](const WalEntry& a, const WalEntry& b) { return a.lsn < b.lsn; });
+}
+
+/**
+ * Apply one logged mutation to the in-memory book
+ *
+ * Every entry carries absolute values, and entries older than an
+ * account's last change are skipped, so applying an entry that is
+ * already reflected in the book changes nothing.
+ *
+ * @param entry Mutation to apply
+ * @param logged The entry comes from or goes to the log rather than the accounts file
+ */
+void AccountStore::apply(const WalEntry& entry, bool logged) {
+    if (entry.lsn >= nextLsn) {
+        nextLsn = entry.lsn + 1;
+    }
+    if (logged) {
+        snapshotPositions.erase(entry.account.accountNumber);
+    }
+
+    size_t slot = index.find(entry.account.accountNumber);
+    bool found = slot != AccountIndex::NOT_FOUND;
+    switch (entry.operation) {
+        case WalOperation::CREATE:
+            if (!found) {
+                records.push_back(entry.account);
+                records.back()->lsn = entry.lsn;
+                index.insert(entry.account.accountNumber, records.size() - 1);
+            }
+            break;
+        case WalOperation::UPDATE:
+            if (found && records[slot]->lsn < entry.lsn) {
+                records[slot]->name = entry.account.name;
+                records[slot]->balanceCents = entry.account.balanceCents;
+                records[slot]->lsn = entry.lsn;
+            }
+            break;
+        case WalOperation::REMOVE:
+            if (found && records[slot]->lsn < entry.lsn) {
+                records[slot].reset();
+                index.erase(entry.account.accountNumber);
+                if (++removedSlots * 2 > records.size()) {
+                    compact();
+                }
+            }
+            break;
+    }
+}
+
+/**
+ * Make sure the in-memory book matches the files
+ *
+ * Reads under the shared book lock, so any number of sessions can read
+ * at once while no session rotates or cuts the log under them. If the
+ * lock is not free in time, the book is left as last read.
+ *
+ * Must be called with the store mutex held.
+ */
+void AccountStore::refresh() {
+    if (batchOpen || flushing) {
+        return;     // This process holds the book lock; nothing else can change
+    }
+    FileLockGuard bookLock(BOOK_LOCK_FILE, LockMode::SHARED, LOCK_TIMEOUT);
+    if (!bookLock) {
+        cerr << "Warning: " << BOOK_LOCK_FILE << " is held by another session; "
+             << "showing the accounts as last read" << endl;
+        return;
+    }
+    refreshLocked();
+}
+
+/**
+ * Bring the in-memory book up to date with the files
+ *
+ * Loads on first use. Afterwards the snapshot is only re-read when
+ * another session has checkpointed; new log entries and balances written
+ * in place by other sessions are applied incrementally.
+ *
+ * Must be called with the store mutex and the book lock held.
+ */
+void AccountStore::refreshLocked() {
+    if (!loaded || logReplaced()) {
+        load();
+        return;
+    }
+    switch (snapshotChanged()) {
+        case SnapshotChange::REPLACED:
+            load();
+            break;
+        case SnapshotChange::UPDATED_IN_PLACE:
+            catchUp();
+            if (!catchUpInPlace()) {
+                load();
+            }
+            break;
+        case SnapshotChange::NONE:
+            catchUp();
+            break;
+    }
+}
+
+/**
+ * Rebuild the book from disk
+ *
+ * Process:
+ * 1. Map and decode the binary snapshot
+ * 2. Replay the log of an unfinished checkpoint, if any
+ * 3. Replay the live log
+ */
+void AccountStore::load() {
+    records.clear();
+    index.clear();
+    snapshotPositions.clear();
+    removedSlots = 0;
+    nextLsn = 1;
+    snapshotLsn = 0;
+
+    rememberSnapshotState();
+    snapshotDamaged = false;
+    readSnapshot();
+    index.reserve(records.size());
+    for (size_t i = 0; i < records.size(); i++) {
+        index.insert(records[i]->accountNumber, i);
+        if (records[i]->lsn >= nextLsn) {
+            nextLsn = records[i]->lsn + 1;     // Balance written in place after the snapshot
+        }
+    }
+
+    auto applyEntry = [this](const WalEntry& entry) { apply(entry); };
+    replayWal(WAL_ROTATED_FILE, 0, keys, applyEntry);
+
+    struct stat st;
+    logInode = stat(WAL_FILE.c_str(), &st) == 0 ? st.st_ino : 0;
+    logOffset = replayWal(WAL_FILE, 0, keys, applyEntry);
+    loaded = true;
+}
+
+/**
+ * Read the snapshot into memory
+ *
+ * Falls back to importing the CSV book written by older versions
+ * when no binary snapshot exists yet, or when the snapshot cannot be
+ * read at all. The next checkpoint then writes a fresh binary snapshot.
+ *
+ * A read that finds damage is retried a few times first, since it may
+ * have met an in-place update of another session half written.
+ *
+ * A snapshot with some damaged records still provides every intact
+ * account. A copy is kept as accounts.dat.damaged, its positions are
+ * not used for in-place updates, and no checkpoint replaces it while it
+ * is damaged, since the new snapshot would lack the damaged accounts.
+ *
+ * @return bool False if the snapshot exists but cannot be read
+ */
+bool AccountStore::readSnapshot() {
+    uint64_t lastLsn = 0;
+    auto addRecord = [this](const AccountRecord& record) { records.push_back(record); };
+
+    AccountFileStatus status = AccountFileStatus::OK;
+    for (int attempt = 1; attempt <= SNAPSHOT_READ_ATTEMPTS; attempt++) {
+        bool lastAttempt = attempt == SNAPSHOT_READ_ATTEMPTS;
+        records.clear();
+        status = readAccountFile(ACCOUNT_FILE, keys, lastLsn, addRecord, lastAttempt);
+        if (lastAttempt || status == AccountFileStatus::OK || status == AccountFileStatus::MISSING) {
+            break;
+        }
+        this_thread::sleep_for(SNAPSHOT_RETRY_PAUSE);
+    }
+    if (status == AccountFileStatus::MISSING) {
+        records.clear();
+        readAccountCsv(LEGACY_ACCOUNT_FILE, keys, addRecord);
+        return true;
+    }
+    if (status == AccountFileStatus::INVALID) {
+        cerr << "Error: " << ACCOUNT_FILE << " is damaged or has an unknown format; "
+             << "falling back to " << LEGACY_ACCOUNT_FILE << endl;
+        records.clear();
+        readAccountCsv(LEGACY_ACCOUNT_FILE, keys, addRecord);
+        return false;
+    }
+    nextLsn = lastLsn + 1;
+    snapshotLsn = lastLsn;
+    if (status == AccountFileStatus::DAMAGED) {
+        snapshotDamaged = true;
+        error_code error;
+        if (filesystem::copy_file(ACCOUNT_FILE, DAMAGED_ACCOUNT_FILE,
+                                  filesystem::copy_options::skip_existing, error)) {
+            cerr << "Warning: a copy of " << ACCOUNT_FILE << " was kept as "
+                 << DAMAGED_ACCOUNT_FILE << endl;
+        }
+        return true;
+    }
+    for (size_t i = 0; i < records.size(); i++) {
+        snapshotPositions.insert(records[i]->accountNumber, i);
+    }
+    return true;
+}
+
+/**
+ * Apply log entries appended by other sessions since the last look
+ */
+void AccountStore::catchUp() {
+    struct stat st;
+    if (stat(WAL_FILE.c_str(), &st) != 0 || st.st_size <= logOffset) {
+        return;
+    }
+    if (logInode == 0) {
+        logInode = st.st_ino;
+    }
+    logOffset = replayWal(WAL_FILE, logOffset, keys,
+                          [this](const WalEntry& entry) { apply(entry); });
+}
+
+/**
+ * Apply balances written into the accounts file by other sessions
+ *
+ * Only records newer than the book's copy of their account are applied;
+ * the book's copy is then current with its record, so the record can
+ * take this session's next in-place update too.
+ *
+ * The file is read without a lock while other sessions may write into
+ * it, so a read that finds a damaged record is retried a few times
+ * before the book is reloaded. Applying a record twice changes nothing.
+ *
+ * @return bool False if the accounts file could not be read; the book
+ *         must then be reloaded
+ */
+bool AccountStore::catchUpInPlace() {
+    rememberSnapshotState();
+    auto applyRecord = [this](size_t position, const AccountRecord& record) {
+        size_t slot = index.find(record.accountNumber);
+        if (slot == AccountIndex::NOT_FOUND || records[slot]->lsn >= record.lsn) {
+            return;
+        }
+        records[slot]->balanceCents = record.balanceCents;
+        records[slot]->lsn = record.lsn;
+        snapshotPositions.insert(record.accountNumber, position);
+        if (record.lsn >= nextLsn) {
+            nextLsn = record.lsn + 1;
+        }
+    };
+    AccountFileStatus status = readAccountFileChanges(ACCOUNT_FILE, keys, snapshotLsn, applyRecord);
+    for (int attempt = 1; status != AccountFileStatus::OK && attempt < SNAPSHOT_READ_ATTEMPTS; attempt++) {
+        this_thread::sleep_for(SNAPSHOT_RETRY_PAUSE);
+        status = readAccountFileChanges(ACCOUNT_FILE, keys, snapshotLsn, applyRecord);
+    }
+    return status == AccountFileStatus::OK;
+}
+
+/**
+ * Catch up with other sessions for a writer joining an open batch
+ *
+ * In a batch that shares the book, other sessions may have changed the
+ * joining writer's accounts before it locked them. Their log entries and
+ * balances written in place are applied; the book is never reloaded, as
+ * that would drop the batch's pending changes.
+ *
+ * @return bool False if the accounts file could not be read
+ */
+bool AccountStore::catchUpBatch() {
+    catchUp();
+    return snapshotChanged() == SnapshotChange::NONE || catchUpInPlace();
+}
+
+/**
+ * Trade the shared book lock of a flushed batch for the exclusive one
+ *
+ * Needed to start a checkpoint after a batch that shared the book. The
+ * lock is released before the exclusive one is taken, so another session
+ * may change the book in between; its changes are applied. If it rotated
+ * the log, the changes only a checkpoint of this session could save are
+ * not in its snapshot, and the upgrade fails.
+ *
+ * @param bookLock Shared book lock held; replaced by the exclusive lock
+ * @param timeout Longest wait for the exclusive lock
+ * @return bool True if the exclusive lock is held and the book caught up
+ */
+bool AccountStore::upgradeBookLock(optional<FileLockGuard>& bookLock, chrono::milliseconds timeout) {
+    bookLock.emplace(BOOK_LOCK_FILE, LockMode::EXCLUSIVE, timeout);
+    return *bookLock && !logReplaced() && catchUpBatch();
+}
+
+/**
+ * Cut off the end of the live log past its last intact record
+ *
+ * Such an end is left by an append that was interrupted by a crash.
+ * Replay stops there, so records appended after it would be lost at
+ * the next start; it is therefore cut off before any append. Damaged
+ * records in the middle of the log are skipped by replay and left alone.
+ *
+ * Must be called with the store mutex and book lock held and the
+ * store caught up, so that logOffset is the end of the intact records
+ * and no other session is appending.
+ *
+ * @return bool False if the end could not be cut, or is longer than a
+ *         torn tail; nothing may be appended then
+ */
+bool AccountStore::cutTornLogTail() {
+    off_t cut = truncateWal(WAL_FILE, logOffset);
+    if (cut > 0) {
+        cerr << "Warning: " << WAL_FILE << " ended with " << cut
+             << " damaged byte(s) after offset " << logOffset << "; they were cut off" << endl;
+    }
+    return cut != -1;
+}
+
+/**
+ * Check whether another session rotated the live log
+ *
+ * @return bool True if the log seen so far is no longer the live log
+ */
+bool AccountStore::logReplaced() const {
+    struct stat st;
+    if (stat(WAL_FILE.c_str(), &st) != 0) {
+        return logInode != 0;
+    }
+    return (logInode != 0 && st.st_ino != logInode) || st.st_size < logOffset;
+}
+
+/**
+ * Check whether the snapshot differs from the last load or write
+ *
+ * A checkpoint replaces the file, so its inode changes; in-place updates
+ * bump the generation in its header. Changes made by this process's own
+ * running checkpoint are ignored.
+ *
+ * @return SnapshotChange How the snapshot changed
+ */
+AccountStore::SnapshotChange AccountStore::snapshotChanged() {
+    if (checkpointRunning) {
+        return SnapshotChange::NONE;
+    }
+    AccountFileState state = readAccountFileState(ACCOUNT_FILE, keys);
+    lock_guard<mutex> guard(snapshotMutex);
+    if (state.inode != snapshotInode) {
+        return SnapshotChange::REPLACED;
+    }
+    return state.generation != snapshotGeneration ? SnapshotChange::UPDATED_IN_PLACE : SnapshotChange::NONE;
+}
+
+/**
+ * Record the current identity of the snapshot file
+ */
+void AccountStore::rememberSnapshotState() {
+    AccountFileState state = readAccountFileState(ACCOUNT_FILE, keys);
+    lock_guard<mutex> guard(snapshotMutex);
+    snapshotInode = state.inode;
+    snapshotGeneration = state.generation;
+}
+
+/**
+ * Start folding the log into a new snapshot
+ *
+ * Process:
+ * 1. Take the checkpoint lock (skip if another session holds it)
+ * 2. Rename the live log so new entries go to a fresh file
+ * 3. Copy the book and write it out on a background thread
+ * 4. Delete the rotated log once the snapshot is written
+ *
+ * A rotated log that survived a crash is already part of the book;
+ * it is folded by a synchronous snapshot before the live log is rotated.
+ *
+ * Refused while the snapshot has damaged records: a new snapshot would
+ * erase the accounts held in them. The log keeps every change until the
+ * file is repaired or restored, which the next refresh picks up.
+ *
+ * Must be called with the store mutex and book lock held and the
+ * store caught up.
+ *
+ * @param wait Wait up to LOCK_TIMEOUT for the checkpoint lock
+ * @return bool True if a checkpoint was started
+ */
+bool AccountStore::startCheckpoint(bool wait) {
+    if (checkpointThread.joinable()) {
+        checkpointThread.join();
+    }
+    if (snapshotDamaged) {
+        if (wait) {
+            cerr << "Error: " << ACCOUNT_FILE << " has damaged records; no checkpoint is written "
+                 << "until it is repaired or restored from a backup" << endl;
+        }
+        return false;
+    }
+
+    FileLockGuard checkpointLock(CHECKPOINT_LOCK_FILE, LockMode::EXCLUSIVE,
+                                 wait ? LOCK_TIMEOUT : chrono::milliseconds(0));
+    if (!checkpointLock) {
+        if (wait) {
+            cerr << "Error: the checkpoint of another session did not finish in time" << endl;
+        }
+        return false;
+    }
+
+    struct stat st;
+    if (stat(WAL_ROTATED_FILE.c_str(), &st) == 0) {
+        vector<AccountRecord> snapshot = liveRecords();
+        if (!writeAccountFile(ACCOUNT_FILE, keys, snapshot, nextLsn - 1)) {
+            return false;
+        }
+        rememberSnapshotPositions(snapshot);
+        rememberSnapshotState();
+        snapshotLsn = nextLsn - 1;
+        ::remove(WAL_ROTATED_FILE.c_str());
+    }
+    if (rename(WAL_FILE.c_str(), WAL_ROTATED_FILE.c_str()) == 0) {
+        logInode = 0;
+        logOffset = 0;
+    }
+
+    checkpointRunning = true;
+    vector<AccountRecord> snapshot = liveRecords();
+    uint64_t lastLsn = nextLsn - 1;
+    rememberSnapshotPositions(snapshot);
+    snapshotLsn = lastLsn;
+    checkpointThread = thread([this, snapshot = move(snapshot), lastLsn,
+                               checkpointLock = move(checkpointLock)]() mutable {
+        if (writeAccountFile(ACCOUNT_FILE, keys, snapshot, lastLsn)) {
+            rememberSnapshotState();
+            ::remove(WAL_ROTATED_FILE.c_str());
+        }
+        checkpointRunning = false;
+        checkpointLock.release();
+    });
+    return true;
+}
+
+/**
+ * Copy the accounts in file order, skipping removed slots
+ *
+ * @return vector<AccountRecord> Every account in the book
+ */
+vector<AccountRecord> AccountStore::liveRecords() const {
+    vector<AccountRecord> live;
+    live.reserve(records.size() - removedSlots);
+    for (const auto& record : records) {
+        if (record) {
+            live.push_back(*record);
+        }
+    }
+    return live;
+}
+
+/**
+ * Record where each account sits in a snapshot being written
+ *
+ * If the snapshot is never written, the positions are stale; in-place
+ * updates detect this from the record contents and fall back to the log.
+ *
+ * @param snapshot Accounts in the order they are written
+ */
+void AccountStore::rememberSnapshotPositions(const vector<AccountRecord>& snapshot) {
+    snapshotPositions.clear();
+    snapshotPositions.reserve(snapshot.size());
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        snapshotPositions.insert(snapshot[i].accountNumber, i);
+    }
+}
+
+/**
+ * Drop the slots of removed accounts
+ *
+ * Called once more than half of the slots are empty, so the cost
+ * is spread over the removals that emptied them.
+ */
+void AccountStore::compact() {
+    size_t next = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (records[i]) {
+            if (next != i) {
+                records[next] = move(records[i]);
+                index.insert(records[next]->accountNumber, next);
+            }
+            next++;
+        }
+    }
+    records.resize(next);
+    removedSlots = 0;
+}
@@ -0,0 +1,219 @@
+/**
+ * Account Store Header
+ *
+ * Purpose:
+ * Keeps the account book resident in memory for the lifetime of the process.
+ * The binary accounts file is mapped and decoded once; afterwards every
+ * read is served from memory. Mutations are appended to a write-ahead log and
+ * folded into the accounts file by a background checkpoint. Concurrent
+ * writers are grouped so that one log write and one sync cover many of them.
+ *
+ * Features:
+ * - Accounts indexed by account number for constant-time lookup,
+ *   maintained incrementally on create and remove
+ * - File order preserved for listings
+ * - One fixed-size log record per create, update and removal
+ * - Group commit with a configurable window and batch size
+ * - Safe for use from multiple threads
+ * - Recovery by replaying the log on top of the last snapshot
+ * - Pick-up of changes made by other sessions, under a shared book lock
+ *   that only writers hold exclusively
+ * - Balance and name changes lock only the records of their accounts,
+ *   so sessions changing different accounts write in parallel; creating
+ *   and removing accounts and checkpoints lock the whole book
+ * - Compare-and-swap updates against the lsn of an account, which
+ *   serves as its version
+ */
+
+#ifndef ACCOUNT_STORE_H
+#define ACCOUNT_STORE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <set>
+#include <optional>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <sys/types.h>
+#include "accountIndex.h"
+#include "keyContext.h"
+#include "fileLock.h"
+
+using namespace std;
+
+// Outcome of a change made only if the account is unchanged
+enum class UpdateResult {
+    UPDATED,        // Applied and durable
+    NOT_FOUND,      // The account does not exist
+    CONFLICT,       // The account changed since the expected version
+    DUPLICATE,      // A batch named the same account more than once
+    FAILED          // The change could not be written
+};
+
+// Account type stored as a one-byte tag
+enum class AccountTypeTag : uint8_t {
+    CHECKING = 0,
+    SERVICE_CHARGE_CHECKING = 1,
+    NO_SERVICE_CHARGE_CHECKING = 2,
+    HIGH_INTEREST_CHECKING = 3,
+    SAVINGS = 4,
+    HIGH_INTEREST_SAVINGS = 5,
+    CERTIFICATE_OF_DEPOSIT = 6
+};
+
+// Plain account data as stored in the accounts file
+struct AccountRecord {
+    int accountNumber;
+    string name;
+    AccountTypeTag type;
+    int64_t balanceCents;       // Balance in integer cents
+    uint64_t lsn = 0;           // Log sequence number of the last change; serves as its version
+};
+
+// New balance for an account, computed from the version expectedLsn
+struct BalanceUpdate {
+    int accountNumber;
+    uint64_t expectedLsn;       // lsn of the account the balance was computed from
+    int64_t balanceCents;
+};
+
+// Maps a type identifier (as returned by getType() or found in old files) to its tag
+AccountTypeTag accountTypeTag(string_view typeName);
+
+// Returns the full name of a type tag, as shown in listings and written to CSV files
+const char* accountTypeName(AccountTypeTag tag);
+
+// Converts between dollar amounts and integer cents
+int64_t toCents(double amount);
+double fromCents(int64_t cents);
+
+struct WalEntry;
+struct AccountFileUpdate;
+
+class AccountStore {
+public:
+    // Returns the process-wide store, loading it on first use
+    static AccountStore& instance();
+
+    // Returns a copy of the account with the given number, if it exists
+    optional<AccountRecord> findAccount(int accountNumber);
+
+    // Returns copies of the accounts that exist among the given numbers
+    vector<AccountRecord> findAccounts(const vector<int>& accountNumbers);
+
+    // Returns a copy of all accounts in file order
+    vector<AccountRecord> all();
+
+    // Calls visit for every account in file order without copying the book
+    // visit runs under the store lock and must not call back into the store
+    void forEach(const function<void(const AccountRecord&)>& visit);
+
+    // Calls visit for each of the given accounts that exists, in the order given
+    void forEach(const vector<int>& accountNumbers, const function<void(const AccountRecord&)>& visit);
+
+    // Returns the number of accounts in the book
+    size_t size();
+
+    // Adds a new account; returns false if the number is already in use
+    bool insert(const AccountRecord& record);
+
+    // Adds new accounts in one batch, skipping numbers already in use
+    // Returns the number of accounts added
+    size_t insertAll(const vector<AccountRecord>& newRecords);
+
+    // Replaces the name and balance of an existing account, if it is still at expectedLsn
+    UpdateResult update(int accountNumber, uint64_t expectedLsn, const string& name, int64_t balanceCents);
+
+    // Changes the balances of several accounts together, if each is still at its expected lsn
+    // Written straight into the accounts' records in the accounts file when possible,
+    // otherwise logged like update()
+    UpdateResult updateBalances(const vector<BalanceUpdate>& updates);
+
+    // Removes an account; returns false if it does not exist
+    bool remove(int accountNumber);
+
+    // Folds the write-ahead log into the accounts file and waits for it
+    void checkpoint();
+
+    // Sets how long a batch collects writers and how many records flush it early
+    void setGroupCommit(chrono::microseconds window, size_t maxRecords);
+
+private:
+    AccountStore();
+    ~AccountStore();
+
+    bool mutate(const function<vector<WalEntry>()>& prepare, const vector<int>& accountNumbers = {},
+                bool inPlace = false);
+    size_t unchangedSlot(int accountNumber, uint64_t expectedLsn, UpdateResult& result);
+    void apply(const WalEntry& entry, bool logged = true);  // Apply one mutation to memory
+    void writeInPlace(vector<AccountFileUpdate>& updates, const vector<WalEntry>& updateEntries,
+                      vector<WalEntry>& entries, bool& needsCheckpoint);
+    void rememberSnapshotPositions(const vector<AccountRecord>& snapshot);
+    void refresh();                     // Reload or catch up with the files on disk
+    void refreshLocked();               // The same, for callers holding the book lock
+    void load();                        // Read the snapshot and replay the logs
+    bool readSnapshot();                // Load accounts.dat, or import the old CSV file
+    void catchUp();                     // Apply log entries written by other sessions
+    bool cutTornLogTail();              // Drop the end of an interrupted append
+    bool logReplaced() const;
+    enum class SnapshotChange { NONE, UPDATED_IN_PLACE, REPLACED };
+    SnapshotChange snapshotChanged();
+    void rememberSnapshotState();
+    bool catchUpInPlace();              // Apply balances other sessions wrote into the accounts file
+    bool catchUpBatch();                // Catch up without reloading, for a writer joining a batch
+    bool upgradeBookLock(optional<FileLockGuard>& bookLock, chrono::milliseconds timeout);
+    bool startCheckpoint(bool wait);    // Rotate the log and write a snapshot
+    vector<AccountRecord> liveRecords() const;
+    void compact();                     // Drop slots of removed accounts
+
+    const KeyContext& keys;                     // Derived once for every file this store touches
+
+    mutex storeMutex;                           // Guards everything below
+    vector<optional<AccountRecord>> records;    // Account slots in file order; empty once removed
+    size_t removedSlots = 0;
+    AccountIndex index;                         // Account number -> slot in records
+    AccountIndex snapshotPositions;             // Account number -> record in the accounts file,
+                                                // for accounts not changed by the log since
+    bool loaded = false;
+    uint64_t nextLsn = 1;
+
+    // Portion of the live log already applied to memory
+    off_t logOffset = 0;
+    ino_t logInode = 0;                         // 0 until the current log file is seen
+
+    // Group commit state
+    chrono::microseconds batchWindow;
+    size_t batchMaxRecords;
+    vector<WalEntry> pendingEntries;            // Applied to memory, not yet durable
+    vector<AccountFileUpdate> pendingInPlace;   // Balance changes for the accounts file
+    vector<WalEntry> pendingInPlaceEntries;     // The same changes, in case they must be logged
+    bool pendingCheckpoint = false;             // Batch holds entries too long for the log
+    bool batchOpen = false;
+    bool flushing = false;
+    bool batchRefused = false;                  // The log is too damaged to append the current batch
+    LockMode batchMode = LockMode::EXCLUSIVE;   // How the current batch holds the book lock
+    uint64_t batchSequence = 0;                 // Number of batches completed
+    set<uint64_t> failedBatches;
+    condition_variable batchFull;
+    condition_variable batchDone;
+
+    uint64_t snapshotLsn = 0;                   // Last sequence number folded into the accounts file
+    bool snapshotDamaged = false;               // The accounts file has damaged records; no checkpoints
+
+    // Identity of the snapshot file when it was last read or written
+    mutex snapshotMutex;
+    ino_t snapshotInode = 0;
+    uint64_t snapshotGeneration = 0;            // In-place update batches seen
+
+    thread checkpointThread;
+    atomic<bool> checkpointRunning{false};
+};
+
+#endif // ACCOUNT_STORE_H
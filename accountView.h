@@ -0,0 +1,38 @@
+/**
+ * Account View Header
+ *
+ * Purpose:
+ * Read-only view of a stored account for listings, searches and reports.
+ * A view refers to the account inside the store instead of copying it,
+ * so scanning the book does not allocate an object per account.
+ *
+ * Features:
+ * - Same getters as bankAccountType for the fields listings use
+ * - Type names come from accountTypeName, like in CSV exports
+ * - Only valid during the scan callback that receives it
+ */
+
+#ifndef ACCOUNT_VIEW_H
+#define ACCOUNT_VIEW_H
+
+#include <string>
+#include "accountStore.h"
+
+using namespace std;
+
+class AccountView {
+public:
+    explicit AccountView(const AccountRecord& record) : record(record) {}
+
+    int getAccountNumber() const { return record.accountNumber; }
+    const string& getName() const { return record.name; }
+    const char* getType() const { return accountTypeName(record.type); }
+    AccountTypeTag getTypeTag() const { return record.type; }
+    double getBalance() const { return fromCents(record.balanceCents); }
+    int64_t getBalanceCents() const { return record.balanceCents; }
+
+private:
+    const AccountRecord& record;
+};
+
+#endif // ACCOUNT_VIEW_H
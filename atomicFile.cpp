@@ -0,0 +1,160 @@
+/**
+ * Atomic File Replacement Implementation
+ *
+ * This file implements the temp-file, fsync, rename commit protocol
+ * with reuse of unchanged segments of the old file.
+ */
+
+#include "atomicFile.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+using namespace std;
+
+// Granularity at which old and new content are compared
+const size_t SEGMENT_SIZE = 64 * 1024;
+
+/**
+ * Write a buffer completely at an offset
+ *
+ * @param fd File to write to
+ * @param data Bytes to write
+ * @param length Number of bytes
+ * @param offset Position in the file
+ * @return bool True if every byte was written
+ */
+static bool writeAt(int fd, const char* data, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+
+/**
+ * Clone a range of the old file into the new one
+ *
+ * Uses FICLONERANGE, which shares the blocks of the old file instead
+ * of copying them. File systems without reflinks (such as ext4) refuse
+ * it, and the caller then writes the data itself; copying the old data
+ * would cost as much as writing the new.
+ *
+ * @param from Old file
+ * @param to New file
+ * @param length Number of bytes
+ * @param offset Position in both files
+ * @return bool False if the file system cannot share the range
+ */
+static bool cloneRange(int from, int to, size_t length, off_t offset) {
+    struct file_clone_range range;
+    range.src_fd = from;
+    range.src_offset = offset;
+    range.src_length = length;
+    range.dest_offset = offset;
+    return ioctl(to, FICLONERANGE, &range) == 0;
+}
+
+/**
+ * Write new content, cloning segments the old file already holds
+ *
+ * Process:
+ * 1. Compare each segment with the same range of the old file
+ * 2. Clone equal segments; write the others
+ * 3. Stop comparing and write everything else once the file system
+ *    refuses a clone
+ *
+ * @param oldFd Old file, or -1 if there is none
+ * @param newFd Temporary file
+ * @param content New content
+ * @return bool True if all content is in the temporary file
+ */
+static bool writeSegments(int oldFd, int newFd, const string& content) {
+    vector<char> oldSegment(oldFd == -1 ? 0 : SEGMENT_SIZE);
+    bool cloning = oldFd != -1;
+
+    for (size_t offset = 0; offset < content.size(); offset += SEGMENT_SIZE) {
+        size_t length = min(SEGMENT_SIZE, content.size() - offset);
+        const char* segment = content.data() + offset;
+
+        if (cloning) {
+            ssize_t bytes = pread(oldFd, oldSegment.data(), length, offset);
+            if (bytes == static_cast<ssize_t>(length) &&
+                memcmp(oldSegment.data(), segment, length) == 0) {
+                if (cloneRange(oldFd, newFd, length, offset)) {
+                    continue;
+                }
+                cloning = false;
+            }
+        }
+        if (!writeAt(newFd, segment, length, offset)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Replace a file atomically
+ *
+ * Error Handling:
+ * - Any failure removes the temporary file and leaves the target as it was
+ * - Errors are reported to cerr
+ *
+ * @param filename File to replace (created if missing)
+ * @param content Complete new content
+ * @return bool True if the new content is durable under filename
+ */
+bool replaceFileAtomically(const string& filename, const string& content) {
+    string tempName = filename + ".XXXXXX";
+    int newFd = mkstemp(&tempName[0]);
+    if (newFd == -1) {
+        cerr << "Error: Unable to create a temporary file for " << filename << endl;
+        return false;
+    }
+
+    int oldFd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    mode_t mode = (oldFd != -1 && fstat(oldFd, &st) == 0) ? (st.st_mode & 0777) : 0644;
+
+    bool ok = fchmod(newFd, mode) == 0 &&
+              writeSegments(oldFd, newFd, content) &&
+              fsync(newFd) == 0;
+    if (oldFd != -1) {
+        close(oldFd);
+    }
+    ok = close(newFd) == 0 && ok;
+    ok = ok && rename(tempName.c_str(), filename.c_str()) == 0;
+
+    if (!ok) {
+        cerr << "Error: Unable to write " << filename << endl;
+        unlink(tempName.c_str());
+        return false;
+    }
+
+    // Make the rename durable
+    size_t slash = filename.rfind('/');
+    string directory = slash == string::npos ? "." : filename.substr(0, slash + 1);
+    int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirFd != -1) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+/**
+ * Atomic File Replacement Header
+ *
+ * Purpose:
+ * Replaces data files so that a crash leaves either the complete old
+ * version or the complete new version on disk, never a mix of both.
+ *
+ * Commit Protocol:
+ * 1. Write the new content to a uniquely named temporary file
+ *    in the same directory
+ * 2. fsync the temporary file
+ * 3. rename() it over the target
+ * 4. fsync the directory so the rename itself is durable
+ *
+ * On file systems with reflinks (such as Btrfs or XFS), segments that
+ * are identical in the old file share its blocks through FICLONERANGE
+ * instead of being written a second time. Elsewhere every segment is
+ * written.
+ */
+
+#ifndef ATOMIC_FILE_H
+#define ATOMIC_FILE_H
+
+#include <string>
+
+using namespace std;
+
+// Replaces filename with content using the commit protocol
+// Returns false (leaving the old file untouched) if any step fails
+bool replaceFileAtomically(const string& filename, const string& content);
+
+#endif // ATOMIC_FILE_H
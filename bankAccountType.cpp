@@ -54,6 +54,18 @@ string bankAccountType::getName() const {
     return name;
 }
 
+/**
+ * Get the version of the stored account this object was read from
+ * 
+ * The version changes with every change to the stored account, so it
+ * tells whether the account was changed since it was read.
+ * 
+ * @return uint64_t The version, 0 for an account not read from the database
+ */
+uint64_t bankAccountType::getVersion() const {
+    return version;
+}
+
 /**
  * Update the account holder's name
  * 
@@ -73,6 +85,15 @@ void bankAccountType::setBalance(double bal) {
     balance = bal;
 }
 
+/**
+ * Record the version of the stored account this object was read from
+ * 
+ * @param v Version of the stored account
+ */
+void bankAccountType::setVersion(uint64_t v) {
+    version = v;
+}
+
 /**
  * Basic withdrawal operation
  * 
@@ -7,6 +7,8 @@
  * 
  * Account Features:
  * - Basic account information (name, number, balance)
+ * - Version of the stored account it was read from, so that changes
+ *   made elsewhere in the meantime can be detected
  * - Standard banking operations (deposit, withdraw)
  * - Monthly statement processing
  * - Account information display
@@ -23,6 +25,7 @@
 #define BANK_ACCOUNT_TYPE_H
 
 #include <string>
+#include <cstdint>
 
 using namespace std;
 
@@ -31,6 +34,7 @@ protected:
     string name;            // Account holder's name
     int accountNumber;      // Unique account identifier
     double balance;         // Current account balance
+    uint64_t version = 0;   // Version of the stored account this object was read from
 
 public:
     // Constructor to initialize account with basic information
@@ -40,10 +44,12 @@ public:
     int getAccountNumber() const;
     double getBalance() const;
     string getName() const;
+    uint64_t getVersion() const;
 
     // Account information modification
     void setName(string n);
     void setBalance(double bal);
+    void setVersion(uint64_t v);
 
     // Basic banking operations
     virtual void withdraw(double amount);  // Virtual to allow overriding by derived classes
@@ -0,0 +1,427 @@
+/**
+ * Block Container Implementation
+ *
+ * This file implements the block-based encrypted container:
+ * - Key derivation for the stream, tweak and MAC
+ * - SipHash-2-4 message authentication
+ * - Encoding and decoding of single blocks and whole streams
+ * - Multi-threaded encoding and decoding of long runs of blocks
+ * - Reading and rewriting small ranges of a container file in place
+ */
+
+#include "blockContainer.h"
+#include "parallelTasks.h"
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <unistd.h>
+
+using namespace std;
+
+const uint32_t CONTAINER_MAGIC = 0x4C424B42;        // "BKBL"
+
+// On-disk block header
+struct containerBlockHeader {
+    uint32_t magic;
+    uint32_t payloadLength;
+    uint64_t blockIndex;
+    uint64_t mac;               // SipHash over index, length and encrypted payload
+    uint64_t reserved;
+};
+
+static_assert(sizeof(containerBlockHeader) == CONTAINER_HEADER_SIZE, "Block header must be 32 bytes");
+static_assert(CONTAINER_PAYLOAD_SIZE % 32 == 0, "Payload must hold whole 32-byte records");
+
+/**
+ * SplitMix64 step, used to spread seeds
+ *
+ * @param x Input value
+ * @return uint64_t Mixed value
+ */
+static uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * FNV-1a hash of a key string with a seed
+ *
+ * @param key Key string
+ * @param seed Distinguishes the values derived from one key
+ * @return uint64_t Hash value
+ */
+static uint64_t keyHash(const string& key, uint64_t seed) {
+    uint64_t hash = 14695981039346656037ULL ^ mix64(seed);
+    for (unsigned char c : key) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return mix64(hash);
+}
+
+/**
+ * Derive the container key material
+ *
+ * @param key Key string
+ * @return ContainerKey Stream key, MAC key and tweak seed
+ */
+ContainerKey makeContainerKey(const string& key) {
+    ContainerKey derived;
+    derived.stream = expandKey(key);
+    derived.macKey[0] = keyHash(key, 1);
+    derived.macKey[1] = keyHash(key, 2);
+    derived.tweakSeed = keyHash(key, 3);
+    return derived;
+}
+
+static inline uint64_t rotl(uint64_t x, int b) {
+    return (x << b) | (x >> (64 - b));
+}
+
+#define SIP_ROUND(v0, v1, v2, v3)                                       \
+    do {                                                                \
+        v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);       \
+        v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;                          \
+        v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;                          \
+        v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);       \
+    } while (0)
+
+/**
+ * Keyed SipHash-2-4
+ *
+ * @param key 128-bit key
+ * @param data Bytes to authenticate
+ * @param length Number of bytes
+ * @return uint64_t 64-bit tag
+ */
+uint64_t sipHash(const uint64_t key[2], const char* data, size_t length) {
+    uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+    uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+
+    size_t whole = length - length % 8;
+    for (size_t i = 0; i < whole; i += 8) {
+        uint64_t m;
+        memcpy(&m, data + i, 8);
+        v3 ^= m;
+        SIP_ROUND(v0, v1, v2, v3);
+        SIP_ROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    uint64_t last = static_cast<uint64_t>(length) << 56;
+    for (size_t i = whole; i < length; i++) {
+        last |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * (i - whole));
+    }
+    v3 ^= last;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= last;
+
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; i++) {
+        SIP_ROUND(v0, v1, v2, v3);
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * Number of blocks needed for a stream
+ *
+ * @param length Stream length in bytes
+ * @return size_t Block count
+ */
+size_t containerBlockCount(size_t length) {
+    return (length + CONTAINER_PAYLOAD_SIZE - 1) / CONTAINER_PAYLOAD_SIZE;
+}
+
+/**
+ * Position of a stream byte in the container file
+ *
+ * @param logicalOffset Offset within the stream
+ * @return size_t Offset within the file
+ */
+size_t containerFileOffset(size_t logicalOffset) {
+    size_t blockIndex = logicalOffset / CONTAINER_PAYLOAD_SIZE;
+    return blockIndex * CONTAINER_BLOCK_SIZE + CONTAINER_HEADER_SIZE
+           + logicalOffset % CONTAINER_PAYLOAD_SIZE;
+}
+
+/**
+ * Apply the key stream and block tweak to a payload
+ *
+ * The operation is its own inverse.
+ *
+ * @param payload Payload bytes, transformed in place
+ * @param length Number of bytes
+ * @param blockIndex Block the payload belongs to
+ * @param key Container key
+ */
+static void cryptPayload(char* payload, size_t length, size_t blockIndex, const ContainerKey& key) {
+    encryptDecryptInPlace(payload, length, key.stream, blockIndex * CONTAINER_PAYLOAD_SIZE);
+
+    uint64_t tweak = mix64(key.tweakSeed ^ blockIndex);
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, payload + i, 8);
+        word ^= tweak;
+        memcpy(payload + i, &word, 8);
+    }
+    for (; i < length; i++) {
+        payload[i] ^= static_cast<char>(tweak >> (8 * (i % 8)));
+    }
+}
+
+/**
+ * MAC of an encrypted block
+ *
+ * @param block Block whose header holds index and length
+ * @param key Container key
+ * @return uint64_t Tag over index, length and encrypted payload
+ */
+static uint64_t blockMac(const char* block, const ContainerKey& key) {
+    containerBlockHeader header;
+    memcpy(&header, block, sizeof(header));
+
+    char message[16 + CONTAINER_PAYLOAD_SIZE];
+    memcpy(message, &header.blockIndex, 8);
+    uint64_t length = header.payloadLength;
+    memcpy(message + 8, &length, 8);
+    memcpy(message + 16, block + CONTAINER_HEADER_SIZE, CONTAINER_PAYLOAD_SIZE);
+    return sipHash(key.macKey, message, sizeof(message));
+}
+
+/**
+ * Encrypt one payload into a block
+ *
+ * @param payload Plain payload
+ * @param length Payload bytes in use (at most CONTAINER_PAYLOAD_SIZE)
+ * @param blockIndex Position of the block in the container
+ * @param key Container key
+ * @param block Receives CONTAINER_BLOCK_SIZE bytes
+ */
+void encodeContainerBlock(const char* payload, size_t length, size_t blockIndex,
+                          const ContainerKey& key, char* block) {
+    containerBlockHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CONTAINER_MAGIC;
+    header.payloadLength = length;
+    header.blockIndex = blockIndex;
+
+    char* body = block + CONTAINER_HEADER_SIZE;
+    memcpy(body, payload, length);
+    memset(body + length, 0, CONTAINER_PAYLOAD_SIZE - length);
+    cryptPayload(body, CONTAINER_PAYLOAD_SIZE, blockIndex, key);
+
+    memcpy(block, &header, sizeof(header));
+    header.mac = blockMac(block, key);
+    memcpy(block, &header, sizeof(header));
+}
+
+/**
+ * Authenticate and decrypt one block
+ *
+ * @param block CONTAINER_BLOCK_SIZE bytes as stored
+ * @param blockIndex Position the block was read from
+ * @param key Container key
+ * @param payload Receives CONTAINER_PAYLOAD_SIZE decrypted bytes
+ * @param length Receives the payload bytes in use
+ * @return bool True if the header and MAC are valid
+ */
+bool decodeContainerBlock(const char* block, size_t blockIndex, const ContainerKey& key,
+                          char* payload, size_t& length) {
+    containerBlockHeader header;
+    memcpy(&header, block, sizeof(header));
+
+    memcpy(payload, block + CONTAINER_HEADER_SIZE, CONTAINER_PAYLOAD_SIZE);
+    cryptPayload(payload, CONTAINER_PAYLOAD_SIZE, blockIndex, key);
+
+    bool valid = header.magic == CONTAINER_MAGIC && header.blockIndex == blockIndex &&
+                 header.payloadLength <= CONTAINER_PAYLOAD_SIZE;
+    length = valid ? header.payloadLength : CONTAINER_PAYLOAD_SIZE;
+    return valid && header.mac == blockMac(block, key);
+}
+
+/**
+ * Encrypt a whole stream into a container
+ *
+ * @param plain Stream contents
+ * @param key Container key
+ * @return string Container bytes, a whole number of blocks
+ */
+string encodeContainer(const string& plain, const ContainerKey& key) {
+    size_t blocks = containerBlockCount(plain.size());
+    string container(blocks * CONTAINER_BLOCK_SIZE, '\0');
+    size_t tasks = (blocks + CONTAINER_BLOCKS_PER_TASK - 1) / CONTAINER_BLOCKS_PER_TASK;
+    runInParallel(tasks, [&](size_t task) {
+        size_t first = task * CONTAINER_BLOCKS_PER_TASK;
+        size_t last = min(blocks, first + CONTAINER_BLOCKS_PER_TASK);
+        for (size_t i = first; i < last; i++) {
+            size_t offset = i * CONTAINER_PAYLOAD_SIZE;
+            size_t length = min(CONTAINER_PAYLOAD_SIZE, plain.size() - offset);
+            encodeContainerBlock(plain.data() + offset, length, i, key,
+                                 &container[i * CONTAINER_BLOCK_SIZE]);
+        }
+    });
+    return container;
+}
+
+/**
+ * Decrypt a run of consecutive blocks
+ *
+ * The blocks are split into groups of CONTAINER_BLOCKS_PER_TASK that
+ * are decoded on separate threads; each block depends only on its own
+ * bytes and index.
+ *
+ * @param blocks First block of the run
+ * @param firstBlock Index of the first block in the container
+ * @param count Number of blocks
+ * @param key Container key
+ * @param payloads Receives the decrypted payloads back to back
+ * @return size_t Number of blocks that failed authentication
+ */
+size_t decodeContainerBlocks(const char* blocks, size_t firstBlock, size_t count,
+                             const ContainerKey& key, char* payloads) {
+    atomic<size_t> damaged{0};
+    size_t tasks = (count + CONTAINER_BLOCKS_PER_TASK - 1) / CONTAINER_BLOCKS_PER_TASK;
+    runInParallel(tasks, [&](size_t task) {
+        size_t first = task * CONTAINER_BLOCKS_PER_TASK;
+        size_t last = min(count, first + CONTAINER_BLOCKS_PER_TASK);
+        for (size_t i = first; i < last; i++) {
+            size_t length;
+            if (!decodeContainerBlock(blocks + i * CONTAINER_BLOCK_SIZE, firstBlock + i, key,
+                                      payloads + i * CONTAINER_PAYLOAD_SIZE, length)) {
+                damaged++;
+            }
+        }
+    });
+    return damaged;
+}
+
+/**
+ * Read one block of a container file for a range update
+ *
+ * @param fd Open container file
+ * @param offset Logical offset of the range
+ * @param length Length of the range
+ * @param key Container key
+ * @param block Receives the block as stored; zeroed if it is past the end of the file
+ * @param payload Receives the decrypted payload
+ * @param used Receives the payload bytes in use
+ * @return int 1 if the block exists, 0 if it is past the end of the file, -1 on error
+ */
+static int readRangeBlock(int fd, size_t offset, size_t length, const ContainerKey& key,
+                          char* block, char* payload, size_t& used) {
+    size_t blockIndex = offset / CONTAINER_PAYLOAD_SIZE;
+    if (offset % CONTAINER_PAYLOAD_SIZE + length > CONTAINER_PAYLOAD_SIZE) {
+        return -1;
+    }
+
+    ssize_t bytes = pread(fd, block, CONTAINER_BLOCK_SIZE, blockIndex * CONTAINER_BLOCK_SIZE);
+    if (bytes == 0) {
+        memset(block, 0, CONTAINER_BLOCK_SIZE);
+        memset(payload, 0, CONTAINER_PAYLOAD_SIZE);
+        used = 0;
+        return 0;
+    }
+    if (bytes != static_cast<ssize_t>(CONTAINER_BLOCK_SIZE)) {
+        return -1;
+    }
+    decodeContainerBlock(block, blockIndex, key, payload, used);
+    return 1;
+}
+
+/**
+ * Read part of a container file
+ *
+ * Callers verify what they read with their own record checksums.
+ *
+ * @param fd Open container file
+ * @param offset Logical offset of the range
+ * @param length Length of the range, within one block
+ * @param key Container key
+ * @param out Receives the decrypted bytes
+ * @return bool False if the block does not exist or cannot be read
+ */
+bool readContainerRange(int fd, size_t offset, size_t length, const ContainerKey& key, char* out) {
+    char block[CONTAINER_BLOCK_SIZE];
+    char payload[CONTAINER_PAYLOAD_SIZE];
+    size_t used;
+    if (readRangeBlock(fd, offset, length, key, block, payload, used) != 1) {
+        return false;
+    }
+    memcpy(out, payload + offset % CONTAINER_PAYLOAD_SIZE, length);
+    return true;
+}
+
+/**
+ * Change part of a container file in place
+ *
+ * Process:
+ * 1. Read and decrypt the block holding the range
+ * 2. Let modify check and change the decrypted range
+ * 3. Re-encrypt the block, growing its payload length if the range
+ *    extends it
+ * 4. Write back only the range and the block header with its new MAC;
+ *    a block past the end of the file is written whole
+ *
+ * The ciphertext of the rest of the block does not change, so it
+ * does not need to be written.
+ *
+ * @param fd Container file open for reading and writing
+ * @param offset Logical offset of the range
+ * @param length Length of the range, within one block
+ * @param key Container key
+ * @param modify Changes the range in place; returns false to skip the update
+ * @return ContainerUpdate Whether the range was written
+ */
+ContainerUpdate updateContainerRange(int fd, size_t offset, size_t length, const ContainerKey& key,
+                                     const function<bool(char*)>& modify) {
+    char block[CONTAINER_BLOCK_SIZE];
+    char payload[CONTAINER_PAYLOAD_SIZE];
+    size_t used;
+    int exists = readRangeBlock(fd, offset, length, key, block, payload, used);
+    if (exists < 0) {
+        return ContainerUpdate::FAILED;
+    }
+
+    size_t blockIndex = offset / CONTAINER_PAYLOAD_SIZE;
+    size_t within = offset % CONTAINER_PAYLOAD_SIZE;
+    if (!modify(payload + within)) {
+        return ContainerUpdate::SKIPPED;
+    }
+    encodeContainerBlock(payload, max(used, within + length), blockIndex, key, block);
+
+    off_t blockStart = blockIndex * CONTAINER_BLOCK_SIZE;
+    if (!exists) {
+        bool ok = pwrite(fd, block, CONTAINER_BLOCK_SIZE, blockStart) ==
+                  static_cast<ssize_t>(CONTAINER_BLOCK_SIZE);
+        return ok ? ContainerUpdate::WRITTEN : ContainerUpdate::FAILED;
+    }
+
+    off_t rangeStart = blockStart + CONTAINER_HEADER_SIZE + within;
+    bool ok = pwrite(fd, block + CONTAINER_HEADER_SIZE + within, length, rangeStart) ==
+                  static_cast<ssize_t>(length) &&
+              pwrite(fd, block, CONTAINER_HEADER_SIZE, blockStart) ==
+                  static_cast<ssize_t>(CONTAINER_HEADER_SIZE);
+    return ok ? ContainerUpdate::WRITTEN : ContainerUpdate::FAILED;
+}
+
+/**
+ * Check for a container by the first block's magic number
+ *
+ * @param data Start of the file
+ * @param size File size
+ * @return bool True if the file is a block container
+ */
+bool isContainer(const char* data, size_t size) {
+    uint32_t magic;
+    if (size < CONTAINER_BLOCK_SIZE || size % CONTAINER_BLOCK_SIZE != 0) {
+        return false;
+    }
+    memcpy(&magic, data, sizeof(magic));
+    return magic == CONTAINER_MAGIC;
+}
@@ -0,0 +1,96 @@
+/**
+ * Block Container Header
+ *
+ * Purpose:
+ * Stores an encrypted byte stream as a sequence of fixed-size blocks, so
+ * any part of it can be read, decrypted, changed and re-encrypted by
+ * touching only the blocks that hold it.
+ *
+ * Block Layout (4096 bytes):
+ * - 32-byte header: magic, payload length, block index and MAC
+ * - 4064-byte payload; 4064 is a multiple of 32, so fixed-width
+ *   32-byte records never straddle two blocks
+ *
+ * Each payload is encrypted with the key stream at its logical position,
+ * mixed with a tweak derived from the block index, so equal data in
+ * different blocks encrypts differently. The MAC is a keyed SipHash-2-4
+ * over the block index, payload length and encrypted payload.
+ */
+
+#ifndef BLOCK_CONTAINER_H
+#define BLOCK_CONTAINER_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "simpleEncryption.h"
+
+using namespace std;
+
+const size_t CONTAINER_BLOCK_SIZE = 4096;
+const size_t CONTAINER_HEADER_SIZE = 32;
+const size_t CONTAINER_PAYLOAD_SIZE = CONTAINER_BLOCK_SIZE - CONTAINER_HEADER_SIZE;
+
+// Key material for the container, derived once from a key string
+struct ContainerKey {
+    ExpandedKey stream;         // XOR key stream
+    uint64_t macKey[2];         // SipHash key
+    uint64_t tweakSeed;         // Seed of the per-block tweak
+};
+
+// Derives the container key material from a key string
+ContainerKey makeContainerKey(const string& key);
+
+// Keyed 64-bit SipHash-2-4 of a buffer
+uint64_t sipHash(const uint64_t key[2], const char* data, size_t length);
+
+// Number of blocks needed for a stream of the given length
+size_t containerBlockCount(size_t length);
+
+// Physical file offset of a logical stream offset
+size_t containerFileOffset(size_t logicalOffset);
+
+// Encrypts a whole stream into blocks
+string encodeContainer(const string& plain, const ContainerKey& key);
+
+// Encrypts one payload into a complete block
+void encodeContainerBlock(const char* payload, size_t length, size_t blockIndex,
+                          const ContainerKey& key, char* block);
+
+// Authenticates and decrypts one block; payload receives CONTAINER_PAYLOAD_SIZE bytes
+// Returns false if the header or MAC does not match; the payload is decrypted anyway
+bool decodeContainerBlock(const char* block, size_t blockIndex, const ContainerKey& key,
+                          char* payload, size_t& length);
+
+// Blocks handed to one thread when many blocks are encoded or decoded at once
+const size_t CONTAINER_BLOCKS_PER_TASK = 64;
+
+// Authenticates and decrypts count consecutive blocks, on several threads
+// when there are enough of them; payloads receives count * CONTAINER_PAYLOAD_SIZE bytes
+// Returns the number of blocks whose header or MAC did not match
+size_t decodeContainerBlocks(const char* blocks, size_t firstBlock, size_t count,
+                             const ContainerKey& key, char* payloads);
+
+// Outcome of updateContainerRange
+enum class ContainerUpdate {
+    WRITTEN,        // Range and block header written
+    SKIPPED,        // modify declined the change
+    FAILED          // The block could not be read or written
+};
+
+// Reads and decrypts length bytes at a logical offset of a container file
+// The range must lie within one block; the block's MAC is not checked
+bool readContainerRange(int fd, size_t offset, size_t length, const ContainerKey& key, char* out);
+
+// Changes length bytes at a logical offset of a container file in place
+// modify receives the decrypted range and returns false to leave it unchanged;
+// only the range and the block header are written, and the caller syncs the file.
+// The range must lie within one block; a block just past the end of the file is created
+ContainerUpdate updateContainerRange(int fd, size_t offset, size_t length, const ContainerKey& key,
+                                     const function<bool(char*)>& modify);
+
+// Checks whether a file starts with a container block
+bool isContainer(const char* data, size_t size);
+
+#endif // BLOCK_CONTAINER_H
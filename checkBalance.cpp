@@ -23,14 +23,8 @@ void checkBalance(int accountNumber) {
         }
     } else {
         // Client is checking their own account balance
-        vector<unique_ptr<bankAccountType>> accounts = loadAccounts();
-        auto it = std::find_if(accounts.begin(), accounts.end(),
-                          [accountNumber](const unique_ptr<bankAccountType>& acc) {
-                              return acc->getAccountNumber() == accountNumber;
-                          });
-        if (it != accounts.end()) {
-            account = move(*it);
-        } else {
+        account = findAccountInDatabase(accountNumber);
+        if (!account) {
             cout << "Error: Account not found." << endl;
             return;
         }
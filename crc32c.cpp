@@ -0,0 +1,179 @@
+/**
+ * CRC32C Implementation
+ *
+ * This file implements CRC-32C with two kernels selected at runtime:
+ * - SSE4.2, using the processor's crc32 instruction
+ * - Slicing-by-8 lookup tables for processors without it
+ */
+
+#include "crc32c.h"
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+const uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;     // Castagnoli, reflected
+
+// Lookup tables for the table-driven kernel
+struct crc32cTables {
+    uint32_t table[8][256];
+
+    crc32cTables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLYNOMIAL : 0);
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int slice = 1; slice < 8; slice++) {
+                uint32_t previous = table[slice - 1][i];
+                table[slice][i] = (previous >> 8) ^ table[0][previous & 0xFF];
+            }
+        }
+    }
+};
+
+/**
+ * Table-driven kernel, 8 bytes per step
+ *
+ * @param data Buffer to checksum
+ * @param length Number of bytes
+ * @param crc Inverted running checksum
+ * @return uint32_t Inverted running checksum after the buffer
+ */
+static uint32_t crc32cTable(const char* data, size_t length, uint32_t crc) {
+    static const crc32cTables tables;
+    const auto& t = tables.table;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    for (; length >= 8; bytes += 8, length -= 8) {
+        uint32_t low;
+        uint32_t high;
+        memcpy(&low, bytes, 4);
+        memcpy(&high, bytes + 4, 4);
+        low ^= crc;
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^
+              t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+              t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^
+              t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+    }
+    for (; length > 0; bytes++, length--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *bytes) & 0xFF];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * SSE4.2 kernel, 8 bytes per instruction
+ *
+ * @param data Buffer to checksum
+ * @param length Number of bytes
+ * @param crc Inverted running checksum
+ * @return uint32_t Inverted running checksum after the buffer
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSse42(const char* data, size_t length, uint32_t crc) {
+#if defined(__x86_64__)
+    uint64_t wide = crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = static_cast<uint32_t>(wide);
+#endif
+    for (; length >= 4; data += 4, length -= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for (; length > 0; data++, length--) {
+        crc = _mm_crc32_u8(crc, static_cast<unsigned char>(*data));
+    }
+    return crc;
+}
+
+#endif
+
+using Crc32cKernel = uint32_t (*)(const char*, size_t, uint32_t);
+
+/**
+ * Check whether the processor can run a CRC kernel
+ *
+ * @param type Kernel to check
+ * @return bool True if the kernel can be used
+ */
+bool crc32cKernelSupported(Crc32cKernelType type) {
+    if (type == Crc32cKernelType::TABLE) {
+        return true;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2") != 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Look up the function of a CRC kernel
+ *
+ * @param type Kernel to look up
+ * @return Crc32cKernel The kernel, the table-driven one if the type has no build here
+ */
+static Crc32cKernel crc32cKernel(Crc32cKernelType type) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (type == Crc32cKernelType::SSE42) {
+        return crc32cSse42;
+    }
+#endif
+    return crc32cTable;
+}
+
+/**
+ * Pick the CRC kernel the processor supports
+ *
+ * @return Crc32cKernel SSE4.2 or table-driven kernel
+ */
+static Crc32cKernel selectCrc32cKernel() {
+    if (crc32cKernelSupported(Crc32cKernelType::SSE42)) {
+        return crc32cKernel(Crc32cKernelType::SSE42);
+    }
+    return crc32cTable;
+}
+
+/**
+ * Compute or extend a CRC-32C checksum with a chosen kernel
+ *
+ * Used by tests to check the SSE4.2 kernel against the table-driven one.
+ *
+ * @param type Kernel to use; must be supported by the processor
+ * @param data Buffer to checksum
+ * @param length Number of bytes
+ * @param crc Checksum of the bytes before the buffer, 0 to start a new one
+ * @return uint32_t Checksum of everything up to the end of the buffer
+ */
+uint32_t crc32cWithKernel(Crc32cKernelType type, const char* data, size_t length, uint32_t crc) {
+    return ~crc32cKernel(type)(data, length, ~crc);
+}
+
+/**
+ * Compute or extend a CRC-32C checksum
+ *
+ * crc32c(b, m, crc32c(a, n)) equals the checksum of a followed by b,
+ * so a stream can be checked in pieces as it arrives.
+ *
+ * @param data Buffer to checksum
+ * @param length Number of bytes
+ * @param crc Checksum of the bytes before the buffer, 0 to start a new one
+ * @return uint32_t Checksum of everything up to the end of the buffer
+ */
+uint32_t crc32c(const char* data, size_t length, uint32_t crc) {
+    static const Crc32cKernel kernel = selectCrc32cKernel();
+    return ~kernel(data, length, ~crc);
+}
@@ -0,0 +1,37 @@
+/**
+ * CRC32C Header
+ *
+ * Purpose:
+ * Computes CRC-32C (Castagnoli) checksums for detecting damaged records
+ * in the files of the banking system.
+ *
+ * Features:
+ * - Uses the SSE4.2 crc32 instruction when the processor has it
+ * - Falls back to a table-driven implementation that consumes
+ *   8 bytes per step
+ * - Checksums can be extended piece by piece, so a stream can be
+ *   checked while it is read
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// CRC-32C of a buffer; pass the checksum of the preceding bytes as crc to extend it
+uint32_t crc32c(const char* data, size_t length, uint32_t crc = 0);
+
+// Kernels crc32c chooses from, fastest first
+enum class Crc32cKernelType { SSE42, TABLE };
+
+// Returns true if the processor can run the given kernel
+bool crc32cKernelSupported(Crc32cKernelType type);
+
+// Same as crc32c, but with the given kernel instead of the fastest one;
+// lets tests compare the kernels. The kernel must be supported.
+uint32_t crc32cWithKernel(Crc32cKernelType type, const char* data, size_t length, uint32_t crc = 0);
+
+#endif // CRC32C_H
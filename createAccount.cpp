@@ -2,7 +2,7 @@
 #include "accountDatabase.h"
 #include "utilityFunctions.h"
 #include "userManagement.h"
-#include "simpleEncryption.h"
+#include "passwordHasher.h"
 #include "serviceChargeCheckingType.h"
 #include "noServiceChargeCheckingType.h"
 #include "savingsAccountType.h"
@@ -20,40 +20,34 @@ using namespace std;
 void createClientAccount();
 void createManagerAccount();
 
-void displayMatchingUsers(const vector<User>& users, const vector<unique_ptr<bankAccountType>>& accounts) {
+void displayMatchingUsers(const vector<User>& users) {
     for (size_t i = 0; i < users.size(); i++) {
         cout << i + 1 << ". " << users[i].username << " (";
         
-        // Find all accounts for this user
+        // Look up the accounts of this user
         cout << "Accounts: ";
         bool firstAccount = true;
-        for (const auto& acc : accounts) {
-            if (find(users[i].accountNumbers.begin(), users[i].accountNumbers.end(), 
-                    acc->getAccountNumber()) != users[i].accountNumbers.end()) {
-                if (!firstAccount) {
-                    cout << ", ";
-                }
-                cout << acc->getType() << " #" << acc->getAccountNumber();
-                firstAccount = false;
+        forEachAccountIn(users[i].accountNumbers, [&firstAccount](const AccountView& acc) {
+            if (!firstAccount) {
+                cout << ", ";
             }
-        }
+            cout << acc.getType() << " #" << acc.getAccountNumber();
+            firstAccount = false;
+        });
         cout << ")" << endl;
     }
 }
 
-void displayUserAccounts(const User& user, const vector<unique_ptr<bankAccountType>>& accounts) {
+void displayUserAccounts(const User& user) {
     cout << "\nCurrent Accounts for " << user.username << ":" << endl;
     cout << string(50, '-') << endl;
     
-    for (const auto& acc : accounts) {
-        if (find(user.accountNumbers.begin(), user.accountNumbers.end(), 
-                acc->getAccountNumber()) != user.accountNumbers.end()) {
-            cout << setw(25) << left << acc->getType() 
-                 << " #" << acc->getAccountNumber()
-                 << "\n   Balance: $" << fixed << setprecision(2) 
-                 << acc->getBalance() << endl;
-        }
-    }
+    forEachAccountIn(user.accountNumbers, [](const AccountView& acc) {
+        cout << setw(25) << left << acc.getType() 
+             << " #" << acc.getAccountNumber()
+             << "\n   Balance: $" << fixed << setprecision(2) 
+             << acc.getBalance() << endl;
+    });
     cout << string(50, '-') << endl;
 }
 
@@ -100,7 +94,6 @@ void createClientAccount() {
 
     if (toupper(existingUser) == 'Y') {
         vector<User> allUsers = getAllUsers();
-        vector<unique_ptr<bankAccountType>> allAccounts = loadAccounts();
         vector<User> matchingUsers;
         string searchTerm;
 
@@ -127,7 +120,7 @@ void createClientAccount() {
             }
 
             cout << "\nMatching users:" << endl;
-            displayMatchingUsers(matchingUsers, allAccounts);
+            displayMatchingUsers(matchingUsers);
             
             int userChoice;
             cout << "\nSelect user number (0 to search again): ";
@@ -139,9 +132,13 @@ void createClientAccount() {
             }
 
             if (userChoice > 0 && userChoice <= static_cast<int>(matchingUsers.size())) {
+                if (!hasRoomForAccount(matchingUsers[userChoice - 1].username)) {
+                    cout << "This user cannot own any more accounts." << endl;
+                    continue;
+                }
                 username = matchingUsers[userChoice - 1].username;
                 name = matchingUsers[userChoice - 1].username; // Using username as name for consistency
-                displayUserAccounts(matchingUsers[userChoice - 1], allAccounts);
+                displayUserAccounts(matchingUsers[userChoice - 1]);
                 break;
             }
 
@@ -151,6 +148,10 @@ void createClientAccount() {
         cout << "Enter new username: ";
         getline(cin, username);
 
+        if (!isUsernameValid(username)) {
+            cout << "Username must not be empty or too long. Please try again." << endl;
+            return;
+        }
         if (!isUsernameAvailable(username)) {
             cout << "Username already exists. Please try again." << endl;
             return;
@@ -161,6 +162,10 @@ void createClientAccount() {
     }
 
     int accountNumber = getNextAccountNumber();
+    if (accountNumber == -1) {
+        cout << "Unable to allocate an account number. Please try again later." << endl;
+        return;
+    }
     double initialBalance;
     int accountType;
 
@@ -244,19 +249,28 @@ void createClientAccount() {
         return;
     }
 
+    // Another session may have changed the user since it was chosen
+    bool userReady = toupper(existingUser) == 'Y' ? hasRoomForAccount(username)
+                                                   : isUsernameAvailable(username);
+    if (!userReady) {
+        cout << "The user changed in the meantime; account creation cancelled." << endl;
+        return;
+    }
+
     saveAccount(newAccount);
 
     if (toupper(existingUser) == 'Y') {
         if (addAccountToUser(username, accountNumber)) {
             cout << "Account added successfully to existing user." << endl;
         } else {
-            cout << "Error adding account to user." << endl;
+            removeAccountFromDatabase(accountNumber);
+            cout << "Error adding account to user; the account was not created." << endl;
         }
     } else {
         User newUser;
         newUser.username = username;
         string defaultPassword = "password";
-        newUser.passwordHash = simpleHash(defaultPassword);
+        newUser.passwordHash = hashPassword(defaultPassword);
         newUser.role = UserRole::CLIENT;
         newUser.accountNumbers.push_back(accountNumber);
 
@@ -266,7 +280,9 @@ void createClientAccount() {
             cout << "Default password: " << defaultPassword << endl;
             cout << "Please advise the client to change their password upon first login." << endl;
         } else {
-            cout << "Failed to create user account. Please contact system administrator." << endl;
+            removeAccountFromDatabase(accountNumber);
+            cout << "Failed to create user account, so the account was not created. "
+                 << "Please contact system administrator." << endl;
         }
     }
 }
@@ -277,6 +293,10 @@ void createManagerAccount() {
     cout << "Enter username for new manager: ";
     getline(cin, username);
 
+    if (!isUsernameValid(username)) {
+        cout << "Error: Username must not be empty or too long." << endl;
+        return;
+    }
     if (!isUsernameAvailable(username)) {
         cout << "Error: Username already exists. Please choose a different username." << endl;
         return;
@@ -8,7 +8,7 @@
 #include "userManagement.h"
 
 void createAccount();
-void displayMatchingUsers(const std::vector<User>& users, const std::vector<std::unique_ptr<bankAccountType>>& accounts);
-void displayUserAccounts(const User& user, const std::vector<std::unique_ptr<bankAccountType>>& accounts);
+void displayMatchingUsers(const std::vector<User>& users);
+void displayUserAccounts(const User& user);
 
 #endif // CREATE_ACCOUNT_H
@@ -27,7 +27,7 @@ using namespace std;
  * Process Flow:
  * 1. Locate the account (lookup or direct)
  * 2. Verify deposit amount
- * 3. Process deposit
+ * 3. Add it to the balance, or to the current one if the account changed
  * 4. Generate receipt
  * 5. Log transaction
  * 
@@ -48,14 +48,8 @@ void deposit(int accountNumber) {
         }
     } else {
         // Client operation - direct account access
-        vector<unique_ptr<bankAccountType>> accounts = loadAccounts();
-        auto it = find_if(accounts.begin(), accounts.end(),
-                      [accountNumber](const unique_ptr<bankAccountType>& acc) {
-                          return acc->getAccountNumber() == accountNumber;
-                      });
-        if (it != accounts.end()) {
-            account = move(*it);
-        } else {
+        account = findAccountInDatabase(accountNumber);
+        if (!account) {
             cout << "Error: Account not found." << endl;
             return;
         }
@@ -96,10 +90,20 @@ void deposit(int accountNumber) {
     cin >> confirm;
     cin.ignore(numeric_limits<streamsize>::max(), '\n');
 
-    // Process deposit if confirmed
+    // Process deposit if confirmed; no lock was held while the user
+    // decided, so if another session changed the account meanwhile the
+    // deposit is added to its current balance instead
     if (toupper(confirm) == 'Y') {
-        account->setBalance(newBalance);
-        if (updateAccountInDatabase(*account)) {
+        vector<unique_ptr<bankAccountType>> accounts;
+        accounts.push_back(move(account));
+        CommitStatus status = commitBalanceChange(accounts,
+            [&](vector<unique_ptr<bankAccountType>>& current) {
+                current[0]->deposit(depositAmount);
+                return true;
+            });
+        account = move(accounts[0]);
+        newBalance = account->getBalance();
+        if (status == CommitStatus::COMMITTED) {
             // Generate receipt
             cout << "\n=== Deposit Receipt ===" << endl;
             cout << "Transaction Date: " << getCurrentDate() << endl;
@@ -116,9 +120,9 @@ void deposit(int accountNumber) {
             logTransaction(TransactionType::DEPOSIT, account->getAccountNumber(), 
                          depositAmount, username, TransactionStatus::SUCCESS, details);
         } else {
-            cout << "Error: Failed to update account in database." << endl;
+            cout << "Error: " << describeCommitStatus(status) << ". Deposit not made." << endl;
             logTransaction(TransactionType::DEPOSIT, account->getAccountNumber(), 
-                         depositAmount, username, TransactionStatus::FAILED, "Database update failed");
+                         depositAmount, username, TransactionStatus::FAILED, describeCommitStatus(status));
         }
     } else {
         cout << "Deposit cancelled." << endl;
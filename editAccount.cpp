@@ -26,7 +26,9 @@ using namespace std;
  * 2. Display current information
  * 3. Allow modifications
  * 4. Confirm changes
- * 5. Save updates
+ * 5. Save updates, unless the account was changed in another session
+ *    since it was looked up; then the current details are shown and
+ *    editing starts over from them
  * 
  * Edit Options:
  * - Account holder's name
@@ -86,12 +88,29 @@ void editAccount() {
                 char confirm;
                 cin >> confirm;
                 if (toupper(confirm) == 'Y') {
-                    if (updateAccountInDatabase(*account)) {
+                    // Saved only if nobody changed the account since it was looked up
+                    CommitStatus status = updateAccountInDatabase(*account);
+                    if (status == CommitStatus::COMMITTED) {
                         cout << "Changes saved successfully." << endl;
-                    } else {
-                        cout << "Error: Failed to update account in database." << endl;
+                        return;
                     }
-                    return;
+                    if (status != CommitStatus::CONFLICT) {
+                        cout << "Error: " << describeCommitStatus(status)
+                             << ". Changes not saved." << endl;
+                        return;
+                    }
+
+                    // Start over from the account as it is now
+                    account = findAccountInDatabase(account->getAccountNumber());
+                    if (!account) {
+                        cout << "Error: The account was deleted in another session." << endl;
+                        return;
+                    }
+                    cout << "The account was changed in another session while you were editing it." << endl;
+                    cout << "Your changes were not saved. Current details:" << endl;
+                    cout << "Name: " << account->getName() << endl;
+                    cout << "Balance: $" << fixed << setprecision(2)
+                         << account->getBalance() << endl;
                 }
                 break;
             }
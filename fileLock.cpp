@@ -4,6 +4,10 @@
  * This file implements system-level file locking:
  * - Preventing concurrent file access
  * - Managing file locks
+ * - Waiting for shared and exclusive locks with backoff and
+ *   recording the waits
+ * - Scoped lock guards
+ * - Byte-range locks on single records
  * - Handling lock release
  */
 
@@ -12,6 +16,19 @@
 #include <unistd.h>
 #include <sys/file.h>
 #include <iostream>
+#include <cerrno>
+#include <thread>
+#include <mutex>
+#include <random>
+#include <algorithm>
+#include <functional>
+
+// First and longest pause between attempts of acquireLockFor
+const std::chrono::milliseconds LOCK_BACKOFF_MIN(1);
+const std::chrono::milliseconds LOCK_BACKOFF_MAX(50);
+
+static std::mutex statsMutex;
+static LockWaitStats stats;
 
 /**
  * Acquire a lock on specified file
@@ -45,6 +62,141 @@ int acquireLock(const std::string& filename) {
     return fd;
 }
 
+/**
+ * Record the outcome of one waiting lock acquisition
+ *
+ * @param acquired Whether the lock was acquired
+ * @param waited Whether the lock was held by someone else at first
+ * @param wait Time spent waiting
+ */
+static void recordWait(bool acquired, bool waited, std::chrono::microseconds wait) {
+    std::lock_guard<std::mutex> guard(statsMutex);
+    if (acquired) {
+        stats.acquisitions++;
+    } else {
+        stats.timeouts++;
+    }
+    if (waited) {
+        stats.contended++;
+        stats.totalWait += wait;
+        stats.longestWait = std::max(stats.longestWait, wait);
+    }
+}
+
+/**
+ * Retry a lock attempt until it succeeds or a timeout passes
+ * 
+ * Process:
+ * 1. Try to acquire the lock without blocking
+ * 2. While it is held elsewhere, sleep and retry; the pause starts at
+ *    LOCK_BACKOFF_MIN and doubles up to LOCK_BACKOFF_MAX, with random
+ *    jitter so waiting processes do not retry in lockstep
+ * 3. Give up once the timeout has passed
+ * 
+ * Every call is counted in the lock wait statistics, except a failed
+ * call with a zero timeout: that only checked whether the lock was free.
+ * 
+ * @param attempt Tries the lock once; false with errno EWOULDBLOCK while it is held
+ * @param timeout Longest time to wait for the lock
+ * @return bool True if the lock was acquired
+ */
+static bool waitWithBackoff(const std::function<bool()>& attempt,
+                            std::chrono::milliseconds timeout) {
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + timeout;
+    auto pause = std::chrono::duration_cast<std::chrono::microseconds>(LOCK_BACKOFF_MIN);
+    static thread_local std::minstd_rand jitter(std::random_device{}());
+    bool waited = false;
+
+    while (!attempt()) {
+        auto now = std::chrono::steady_clock::now();
+        if (errno != EWOULDBLOCK || now >= deadline) {
+            if (timeout.count() > 0) {
+                recordWait(false, waited,
+                           std::chrono::duration_cast<std::chrono::microseconds>(now - start));
+            }
+            return false;
+        }
+        waited = true;
+
+        auto sleep = pause / 2 + std::chrono::microseconds(jitter() % (pause.count() / 2 + 1));
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(sleep, deadline - now));
+        pause = std::min(pause * 2, std::chrono::duration_cast<std::chrono::microseconds>(LOCK_BACKOFF_MAX));
+    }
+
+    recordWait(true, waited, std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now() - start));
+    return true;
+}
+
+/**
+ * Acquire a lock on specified file, waiting for it up to a timeout
+ * 
+ * @param filename File to lock; created if it does not exist
+ * @param operation LOCK_SH or LOCK_EX
+ * @param timeout Longest time to wait for the lock
+ * @return int File descriptor or -1 on failure or timeout
+ */
+static int acquireWithBackoff(const std::string& filename, int operation,
+                              std::chrono::milliseconds timeout) {
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        std::cerr << "Error opening file for locking" << std::endl;
+        return -1;
+    }
+
+    if (!waitWithBackoff([fd, operation] { return flock(fd, operation | LOCK_NB) == 0; }, timeout)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Acquire an exclusive lock, waiting for it up to a timeout
+ * 
+ * @param filename File to lock
+ * @param timeout Longest time to wait for the lock
+ * @return int File descriptor or -1 on failure or timeout
+ */
+int acquireLockFor(const std::string& filename, std::chrono::milliseconds timeout) {
+    return acquireWithBackoff(filename, LOCK_EX, timeout);
+}
+
+/**
+ * Acquire a shared lock for reading
+ * 
+ * Readers do not exclude each other, only holders of the exclusive lock.
+ * 
+ * @param filename File to lock
+ * @param timeout Longest time to wait for writers to finish
+ * @return int File descriptor or -1 on failure or timeout
+ */
+int acquireSharedLock(const std::string& filename, std::chrono::milliseconds timeout) {
+    return acquireWithBackoff(filename, LOCK_SH, timeout);
+}
+
+/**
+ * Acquire an exclusive lock for changing the file
+ * 
+ * @param filename File to lock
+ * @param timeout Longest time to wait for readers and writers to finish
+ * @return int File descriptor or -1 on failure or timeout
+ */
+int acquireExclusiveLock(const std::string& filename, std::chrono::milliseconds timeout) {
+    return acquireWithBackoff(filename, LOCK_EX, timeout);
+}
+
+/**
+ * Get the lock wait counters
+ * 
+ * @return LockWaitStats Counters of all waiting acquisitions so far
+ */
+LockWaitStats lockWaitStats() {
+    std::lock_guard<std::mutex> guard(statsMutex);
+    return stats;
+}
+
 /**
  * Release a previously acquired lock
  * 
@@ -64,3 +216,123 @@ void releaseLock(int fd) {
         close(fd);           // Close file
     }
 }
+
+/**
+ * Acquire a lock for the lifetime of the guard
+ * 
+ * @param filename File to lock
+ * @param mode Shared or exclusive
+ * @param timeout Longest time to wait for the lock
+ */
+FileLockGuard::FileLockGuard(const std::string& filename, LockMode mode,
+                             std::chrono::milliseconds timeout)
+    : fd(mode == LockMode::SHARED ? acquireSharedLock(filename, timeout)
+                                  : acquireExclusiveLock(filename, timeout)) {}
+
+/**
+ * Take over the lock of another guard, releasing the one held
+ * 
+ * @param other Guard to take the lock from; left without a lock
+ * @return FileLockGuard& This guard
+ */
+FileLockGuard& FileLockGuard::operator=(FileLockGuard&& other) noexcept {
+    if (this != &other) {
+        release();
+        fd = other.fd;
+        other.fd = -1;
+    }
+    return *this;
+}
+
+/**
+ * Release the lock early; does nothing if no lock is held
+ */
+void FileLockGuard::release() {
+    releaseLock(fd);
+    fd = -1;
+}
+
+/**
+ * Lock one byte of a file exclusively through its open file description
+ * 
+ * Open file description locks belong to the descriptor rather than the
+ * process, are released when it is closed, and do not interact with
+ * flock locks on the same file.
+ * 
+ * @param fd Open lock file
+ * @param offset Byte to lock
+ * @return bool True on success; errno is EWOULDBLOCK if the byte is locked elsewhere
+ */
+static bool setRecordLock(int fd, off_t offset) {
+    struct flock range = {};
+    range.l_type = F_WRLCK;
+    range.l_whence = SEEK_SET;
+    range.l_start = offset;
+    range.l_len = 1;
+    if (fcntl(fd, F_OFD_SETLK, &range) == 0) {
+        return true;
+    }
+    if (errno == EACCES) {
+        errno = EWOULDBLOCK;
+    }
+    return false;
+}
+
+/**
+ * Lock records of a file for the lifetime of the guard
+ * 
+ * Process:
+ * 1. Sort the records and drop duplicates
+ * 2. Lock them one by one in ascending order, waiting for each with
+ *    backoff; as every caller takes its records in the same order, two
+ *    callers needing the same pair of records cannot deadlock
+ * 3. On a timeout, release the records already taken
+ * 
+ * @param filename Lock file; created if it does not exist
+ * @param records Byte offsets of the records to lock
+ * @param timeout Longest time to wait for each record
+ */
+RecordLockGuard::RecordLockGuard(const std::string& filename, std::vector<off_t> records,
+                                 std::chrono::milliseconds timeout) : fd(-1) {
+    std::sort(records.begin(), records.end());
+    records.erase(std::unique(records.begin(), records.end()), records.end());
+
+    int lockFd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (lockFd == -1) {
+        std::cerr << "Error opening file for locking" << std::endl;
+        return;
+    }
+    for (off_t record : records) {
+        if (!waitWithBackoff([lockFd, record] { return setRecordLock(lockFd, record); },
+                             timeout)) {
+            close(lockFd);
+            return;
+        }
+    }
+    fd = lockFd;
+}
+
+/**
+ * Take over the records of another guard, releasing the ones held
+ * 
+ * @param other Guard to take the records from; left without a lock
+ * @return RecordLockGuard& This guard
+ */
+RecordLockGuard& RecordLockGuard::operator=(RecordLockGuard&& other) noexcept {
+    if (this != &other) {
+        release();
+        fd = other.fd;
+        other.fd = -1;
+    }
+    return *this;
+}
+
+/**
+ * Release the records early; closing the descriptor drops all of its locks
+ */
+void RecordLockGuard::release() {
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+}
@@ -8,6 +8,13 @@
  * Features:
  * - File-based locking
  * - Non-blocking operations
+ * - Waiting for a lock with a timeout, retrying with bounded
+ *   exponential backoff
+ * - Shared locks for readers, which only exclude exclusive holders
+ * - Scoped guard that releases its lock when it goes out of scope
+ * - Byte-range locks on single records, so writers of different
+ *   records do not wait for each other
+ * - Statistics of how often and how long callers waited
  * - Automatic lock cleanup
  */
 
@@ -15,12 +22,93 @@
 #define FILE_LOCK_H
 
 #include <string>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <sys/types.h>
 
 // Acquire a lock on a file
 // Returns file descriptor or -1 if lock cannot be acquired
 int acquireLock(const std::string& filename);
 
+// Acquire a lock on a file, waiting up to timeout for other holders to release it
+// Returns file descriptor or -1 if the lock could not be acquired in time
+int acquireLockFor(const std::string& filename, std::chrono::milliseconds timeout);
+
+// Acquire a shared lock, held by any number of readers at once; waits up to timeout
+// Returns file descriptor or -1 if the lock could not be acquired in time
+int acquireSharedLock(const std::string& filename, std::chrono::milliseconds timeout);
+
+// Acquire an exclusive lock, held by one writer and no readers; waits up to timeout
+// Returns file descriptor or -1 if the lock could not be acquired in time
+int acquireExclusiveLock(const std::string& filename, std::chrono::milliseconds timeout);
+
+// Counters of waiting lock acquisitions in this process
+struct LockWaitStats {
+    uint64_t acquisitions = 0;                  // Calls that got the lock
+    uint64_t contended = 0;                     // Calls that found the lock held
+    uint64_t timeouts = 0;                      // Calls that gave up; failed tries with no timeout are not counted
+    std::chrono::microseconds totalWait{0};     // Time spent waiting, over all calls
+    std::chrono::microseconds longestWait{0};   // Longest single wait
+};
+
+// Returns the lock wait counters so far
+LockWaitStats lockWaitStats();
+
 // Release a previously acquired lock
 void releaseLock(int fd);
 
+// Kind of lock held by a FileLockGuard
+enum class LockMode {
+    SHARED,         // Reading; other readers may hold the lock too
+    EXCLUSIVE       // Changing; nobody else may hold the lock
+};
+
+// Holds a lock on a file for as long as it is in scope
+class FileLockGuard {
+public:
+    // Acquires the lock, waiting up to timeout; check locked() for the outcome
+    FileLockGuard(const std::string& filename, LockMode mode, std::chrono::milliseconds timeout);
+    ~FileLockGuard() { release(); }
+
+    FileLockGuard(const FileLockGuard&) = delete;
+    FileLockGuard& operator=(const FileLockGuard&) = delete;
+    FileLockGuard(FileLockGuard&& other) noexcept : fd(other.fd) { other.fd = -1; }
+    FileLockGuard& operator=(FileLockGuard&& other) noexcept;
+
+    bool locked() const { return fd != -1; }
+    explicit operator bool() const { return locked(); }
+
+    // Releases the lock before the guard goes out of scope
+    void release();
+
+private:
+    int fd;
+};
+
+// Holds exclusive locks on single records of a file for as long as it is in scope
+// Each record is one byte of the lock file at its offset; records are taken in
+// ascending order so that callers locking several records cannot deadlock
+class RecordLockGuard {
+public:
+    // Locks every record, waiting up to timeout for each; check locked() for the outcome
+    RecordLockGuard(const std::string& filename, std::vector<off_t> records,
+                    std::chrono::milliseconds timeout);
+    ~RecordLockGuard() { release(); }
+
+    RecordLockGuard(const RecordLockGuard&) = delete;
+    RecordLockGuard& operator=(const RecordLockGuard&) = delete;
+    RecordLockGuard(RecordLockGuard&& other) noexcept : fd(other.fd) { other.fd = -1; }
+    RecordLockGuard& operator=(RecordLockGuard&& other) noexcept;
+
+    bool locked() const { return fd != -1; }
+    explicit operator bool() const { return locked(); }
+
+    // Releases all records before the guard goes out of scope
+    void release();
+
+private:
+    int fd;
+};
+
 #endif // FILE_LOCK_H
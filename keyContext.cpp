@@ -0,0 +1,40 @@
+/**
+ * Key Context Implementation
+ *
+ * This file implements the process-wide cache of derived keys.
+ */
+
+#include "keyContext.h"
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+/**
+ * Get the key material for a secret
+ *
+ * Process:
+ * 1. Look the secret up in the cache
+ * 2. On the first request, hash it, expand it for the XOR kernels and
+ *    derive the container keys
+ * 3. Keep the result for the rest of the process
+ *
+ * Contexts are never removed, so callers may hold on to the reference.
+ *
+ * @param secret Key as configured
+ * @return const KeyContext& Derived key material
+ */
+const KeyContext& keyContextFor(const string& secret) {
+    static mutex cacheMutex;
+    static unordered_map<string, unique_ptr<KeyContext>> cache;
+
+    lock_guard<mutex> lock(cacheMutex);
+    unique_ptr<KeyContext>& context = cache[secret];
+    if (!context) {
+        context.reset(new KeyContext);
+        context->hashedKey = simpleHash(secret);
+        context->container = makeContainerKey(context->hashedKey);
+    }
+    return *context;
+}
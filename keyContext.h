@@ -0,0 +1,36 @@
+/**
+ * Key Context Header
+ *
+ * Purpose:
+ * Derives the key material for a secret once and keeps it for the life
+ * of the process, so that no save, load or log append hashes or expands
+ * a key again.
+ *
+ * Contents:
+ * - The hashed key string the files are encrypted with
+ * - The key expanded for the XOR kernels
+ * - The block container MAC key and tweak seed
+ */
+
+#ifndef KEY_CONTEXT_H
+#define KEY_CONTEXT_H
+
+#include <string>
+#include "simpleEncryption.h"
+#include "blockContainer.h"
+
+using namespace std;
+
+// Key material derived from one secret
+struct KeyContext {
+    string hashedKey;           // simpleHash of the secret
+    ContainerKey container;     // container.stream is the expanded XOR key
+
+    const ExpandedKey& stream() const { return container.stream; }
+};
+
+// Returns the key material for a secret, deriving it on first use
+// The reference stays valid for the life of the process
+const KeyContext& keyContextFor(const string& secret);
+
+#endif // KEY_CONTEXT_H
@@ -0,0 +1,240 @@
+/**
+ * Log Archive Implementation
+ *
+ * This file implements the compressed log archive:
+ * - Locked appends to the live log
+ * - Rolling the live log into compressed frames
+ * - Reading archived and live lines in order
+ */
+
+#include "logArchive.h"
+#include "lzCompressor.h"
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+ * Name of a log's compressed archive
+ *
+ * @param filename Live log
+ * @return string Archive file name
+ */
+static string archiveName(const string& filename) {
+    return filename + ".lz";
+}
+
+/**
+ * Write a buffer completely
+ *
+ * @param fd File to write to
+ * @param data Bytes to write
+ * @param length Number of bytes
+ * @return bool True if every byte was written
+ */
+static bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+/**
+ * Move the live log into its archive
+ *
+ * Process:
+ * 1. Lock the live log exclusively, which waits for appends in progress
+ * 2. Check that no other process rolled it in the meantime
+ * 3. Compress the live log into frames as it is read
+ * 4. Append the frames to the archive and sync it
+ * 5. Empty the live log
+ *
+ * @param filename Live log
+ * @return bool False if the archive could not be written
+ */
+static bool rollLog(const string& filename) {
+    int fd = open(filename.c_str(), O_RDWR);
+    if (fd == -1) {
+        return false;
+    }
+    flock(fd, LOCK_EX);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(LOG_ROLL_SIZE)) {
+        flock(fd, LOCK_UN);
+        close(fd);
+        return true;
+    }
+
+    string frames;
+    LzStreamWriter writer([&frames](const char* data, size_t length) { frames.append(data, length); });
+    vector<char> buffer(LZ_BLOCK_SIZE);
+    off_t offset = 0;
+    ssize_t bytes;
+    while ((bytes = pread(fd, buffer.data(), buffer.size(), offset)) > 0) {
+        writer.write(buffer.data(), bytes);
+        offset += bytes;
+    }
+    writer.finish();
+
+    bool ok = bytes == 0;
+    if (ok) {
+        int archive = open(archiveName(filename).c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+        ok = archive != -1 && writeAll(archive, frames.data(), frames.size()) && fdatasync(archive) == 0;
+        if (archive != -1) {
+            close(archive);
+        }
+    }
+    if (ok) {
+        ok = ftruncate(fd, 0) == 0;
+    } else {
+        cerr << "Error: Unable to archive " << filename << endl;
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return ok;
+}
+
+/**
+ * Append one line to a log
+ *
+ * The line is written with a single append under a shared lock; the
+ * writer that takes the log past LOG_ROLL_SIZE rolls it into the archive.
+ *
+ * @param filename Live log
+ * @param line Line to append, without its newline
+ * @return bool True if the line was written
+ */
+bool appendLogLine(const string& filename, const string& line) {
+    int fd = open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    flock(fd, LOCK_SH);
+
+    string record = line + "\n";
+    bool ok = writeAll(fd, record.data(), record.size());
+    struct stat st;
+    bool full = ok && fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(LOG_ROLL_SIZE);
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    if (full) {
+        rollLog(filename);
+    }
+    return ok;
+}
+
+// Splits text handed over in pieces into lines
+class lineSplitter {
+public:
+    explicit lineSplitter(const function<void(string_view)>& visit) : visit(visit) {}
+
+    // Handles the next piece of text
+    void consume(const char* data, size_t length);
+
+    // Hands over a last line without a newline
+    void finish();
+
+private:
+    const function<void(string_view)>& visit;
+    string partial;             // Start of a line that continues in the next piece
+};
+
+void lineSplitter::consume(const char* data, size_t length) {
+    size_t start = 0;
+    const char* newline;
+    while ((newline = static_cast<const char*>(memchr(data + start, '\n', length - start)))) {
+        size_t lineEnd = newline - data;
+        if (partial.empty()) {
+            visit(string_view(data + start, lineEnd - start));
+        } else {
+            partial.append(data + start, lineEnd - start);
+            visit(partial);
+            partial.clear();
+        }
+        start = lineEnd + 1;
+    }
+    partial.append(data + start, length - start);
+}
+
+void lineSplitter::finish() {
+    if (!partial.empty()) {
+        visit(partial);
+        partial.clear();
+    }
+}
+
+/**
+ * Read every line of a log
+ *
+ * Process:
+ * 1. Lock the live log shared, so it is not rolled during the read
+ * 2. Read the archive in large chunks; the frames of each chunk are
+ *    decoded in parallel and split into lines
+ * 3. Read the live log
+ *
+ * Error Handling:
+ * - A missing archive or live log holds no lines
+ * - Damaged frames of the archive are reported and skipped; a damaged
+ *   frame header ends the archive, and the live log is still read
+ *
+ * @param filename Live log
+ * @param visit Called for every line in the order the lines were written
+ * @return bool False if part of the archive was damaged
+ */
+bool forEachLogLine(const string& filename, const function<void(string_view)>& visit) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd != -1) {
+        flock(fd, LOCK_SH);
+    }
+
+    lineSplitter lines(visit);
+    vector<char> buffer(LOG_READ_CHUNK_SIZE);
+    ssize_t bytes;
+    bool ok = true;
+
+    int archive = open(archiveName(filename).c_str(), O_RDONLY);
+    if (archive != -1) {
+        LzStreamReader reader([&lines](const char* data, size_t length) { lines.consume(data, length); });
+        while ((bytes = read(archive, buffer.data(), buffer.size())) > 0 &&
+               reader.feed(buffer.data(), bytes)) {
+        }
+        close(archive);
+        lines.finish();
+        if (reader.skippedFrames > 0) {
+            cerr << "Warning: " << archiveName(filename) << " has " << reader.skippedFrames
+                 << " damaged block(s); their lines were skipped" << endl;
+        }
+        if (!reader.finish()) {
+            cerr << "Warning: " << archiveName(filename)
+                 << " is damaged; the lines after the damage were skipped" << endl;
+        }
+        ok = reader.finish() && reader.skippedFrames == 0;
+    }
+
+    if (fd != -1) {
+        while ((bytes = read(fd, buffer.data(), buffer.size())) > 0) {
+            lines.consume(buffer.data(), bytes);
+        }
+        lines.finish();
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+    return ok;
+}
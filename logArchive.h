@@ -0,0 +1,45 @@
+/**
+ * Log Archive Header
+ *
+ * Purpose:
+ * Keeps the text logs of the system (transactions.txt, logins.txt) from
+ * growing without bound as plain text.
+ *
+ * Layout:
+ * - New lines are appended to the live log as plain text
+ * - Once the live log reaches LOG_ROLL_SIZE, its contents are compressed
+ *   into independent frames (see lzCompressor.h), appended to the
+ *   archive <log>.lz, and the live log is emptied
+ * - Readers see the archived lines followed by the live ones, in the
+ *   order they were written
+ *
+ * Writers hold a shared lock on the live log while appending and the
+ * roll holds an exclusive one, so no line is lost while the log is
+ * moved into the archive. A crash during a roll can repeat the last
+ * archived lines but never loses any.
+ */
+
+#ifndef LOG_ARCHIVE_H
+#define LOG_ARCHIVE_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <functional>
+
+using namespace std;
+
+// Size at which the live log is compressed into its archive
+const size_t LOG_ROLL_SIZE = 256 * 1024;
+
+// Bytes of the archive read at once; the frames in them are decoded in parallel
+const size_t LOG_READ_CHUNK_SIZE = 1024 * 1024;
+
+// Appends one line to a log, archiving the log when it has grown past LOG_ROLL_SIZE
+bool appendLogLine(const string& filename, const string& line);
+
+// Calls visit for every line of a log, archived lines first
+// Returns false if part of the archive was damaged and skipped
+bool forEachLogLine(const string& filename, const function<void(string_view)>& visit);
+
+#endif // LOG_ARCHIVE_H
@@ -9,7 +9,7 @@
 
 #include "loginLog.h"
 #include "utilityFunctions.h"
-#include <fstream>
+#include "logArchive.h"
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -24,17 +24,14 @@ const string LOGIN_LOG_FILE = "logins.txt";
  * Format:
  * datetime,username,status
  * 
+ * Older entries are compressed into logins.txt.lz (see logArchive.h).
+ * 
  * @param username User attempting to login
  * @param success Whether login was successful
  */
 void logLogin(const string& username, bool success) {
-    ofstream logFile(LOGIN_LOG_FILE, ios::app);
-    if (logFile.is_open()) {
-        logFile << getCurrentDate() << ","
-                << username << ","
-                << (success ? "Success" : "Failed") << endl;
-        logFile.close();
-    }
+    appendLogLine(LOGIN_LOG_FILE, getCurrentDate() + "," + username + "," +
+                                  (success ? "Success" : "Failed"));
 }
 
 /**
@@ -47,9 +44,6 @@ void logLogin(const string& username, bool success) {
  * - Username tracking
  */
 void viewLoginHistory() {
-    ifstream logFile(LOGIN_LOG_FILE);
-    string line;
-    
     clearScreen();
     cout << "=== Login History ===" << endl;
     cout << setfill('=') << setw(60) << "=" << setfill(' ') << endl;
@@ -61,9 +55,9 @@ void viewLoginHistory() {
          << "Status" << endl;
     cout << setfill('-') << setw(60) << "-" << setfill(' ') << endl;
 
-    // Process each login record
-    while (getline(logFile, line)) {
-        istringstream iss(line);
+    // Process each login record, archived ones first
+    forEachLogLine(LOGIN_LOG_FILE, [](string_view line) {
+        istringstream iss{string(line)};
         string datetime, username, status;
         
         getline(iss, datetime, ',');
@@ -75,7 +69,7 @@ void viewLoginHistory() {
              << setw(25) << datetime
              << setw(20) << username
              << status << endl;
-    }
+    });
 
     cout << setfill('=') << setw(60) << "=" << setfill(' ') << endl;
     cout << "\nPress Enter to continue...";
@@ -36,8 +36,7 @@ using namespace std;
  * @return unique_ptr<bankAccountType> Selected account or nullptr if cancelled
  */
 unique_ptr<bankAccountType> lookUpAccount() {
-    vector<unique_ptr<bankAccountType>> accounts = loadAccounts();
-    vector<unique_ptr<bankAccountType>*> matchedAccounts;
+    vector<int> matchedAccounts;
     string searchTerm;
 
     while (true) {
@@ -53,25 +52,26 @@ unique_ptr<bankAccountType> lookUpAccount() {
         // Convert search term to lowercase for case-insensitive search
         string lowerSearchTerm = toLowerCase(searchTerm);
 
-        // Find all accounts matching the search term
-        for (auto& account : accounts) {
-            if (toLowerCase(account->getName()).find(lowerSearchTerm) != string::npos) {
-                matchedAccounts.push_back(&account);
-            }
-        }
+        // Find and display all accounts matching the search term
+        forEachAccount(
+            [&lowerSearchTerm](const AccountView& account) {
+                return toLowerCase(account.getName()).find(lowerSearchTerm) != string::npos;
+            },
+            [&matchedAccounts](const AccountView& account) {
+                if (matchedAccounts.empty()) {
+                    cout << "Matches found:" << endl;
+                }
+                matchedAccounts.push_back(account.getAccountNumber());
+                cout << matchedAccounts.size() << ". " 
+                     << account.getName() << " (Acc# " 
+                     << account.getAccountNumber() << ") - "
+                     << account.getType() << endl;
+            });
 
-        // Display results or no matches message
+        // Display no matches message or let the user pick a match
         if (matchedAccounts.empty()) {
             cout << "No matches found. Please try again." << endl;
         } else {
-            cout << "Matches found:" << endl;
-            for (size_t i = 0; i < matchedAccounts.size(); ++i) {
-                const auto& account = matchedAccounts[i];
-                cout << i + 1 << ". " 
-                     << (*account)->getName() << " (Acc# " 
-                     << (*account)->getAccountNumber() << ") - "
-                     << (*account)->getType() << endl;
-            }
 
             // Get user selection
             int choice;
@@ -85,7 +85,11 @@ unique_ptr<bankAccountType> lookUpAccount() {
                 }
 
                 if (choice > 0 && static_cast<size_t>(choice) <= matchedAccounts.size()) {
-                    return move(*matchedAccounts[choice - 1]);
+                    unique_ptr<bankAccountType> account = findAccountInDatabase(matchedAccounts[choice - 1]);
+                    if (account) {
+                        return account;
+                    }
+                    cout << "The account no longer exists. Please try again." << endl;
                 } else {
                     cout << "Invalid selection. Please try again." << endl;
                 }
@@ -0,0 +1,443 @@
+/**
+ * LZ Block Compressor Implementation
+ *
+ * This file implements the frame compressor:
+ * - Greedy LZ77 matching through hash chains of 4-byte sequences
+ * - Sequences of a token, literals, a 16-bit offset and a match length,
+ *   with long lengths continued in extra bytes
+ * - Streaming encode and decode, with the frames of a piece of input
+ *   decoded on several threads
+ */
+
+#include "lzCompressor.h"
+#include "crc32c.h"
+#include "parallelTasks.h"
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+const uint32_t LZ_FRAME_MAGIC = 0x5A4C4B42;         // "BKLZ"
+const size_t LZ_MIN_MATCH = 4;
+const size_t LZ_MAX_OFFSET = 65535;
+const int LZ_HASH_BITS = 14;
+const int LZ_CHAIN_DEPTH = 8;                       // Earlier positions compared per position
+
+// Frame header, stored before the frame's data
+struct lzFrameHeader {
+    uint32_t magic;
+    uint32_t rawLength;
+    uint32_t storedLength;      // Equal to rawLength when the bytes are stored uncompressed
+    uint32_t checksum;          // CRC-32C of the raw bytes
+};
+
+static_assert(sizeof(lzFrameHeader) == LZ_FRAME_HEADER_SIZE, "Frame header must be 16 bytes");
+
+/**
+ * Largest compressed size of a block
+ *
+ * @param length Raw length
+ * @return size_t Bytes the compressor may write for it
+ */
+static size_t compressBound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+/**
+ * Write the continuation bytes of a long length
+ *
+ * @param out Output position; advanced
+ * @param extra Length beyond what the token holds
+ */
+static void writeLength(unsigned char*& out, size_t extra) {
+    while (extra >= 255) {
+        *out++ = 255;
+        extra -= 255;
+    }
+    *out++ = static_cast<unsigned char>(extra);
+}
+
+/**
+ * Write one sequence of literals followed by a back reference
+ *
+ * @param out Output position; advanced
+ * @param literals Bytes copied as they are
+ * @param literalLength Number of literal bytes
+ * @param offset Distance back to the match
+ * @param matchLength Match length, 0 for the last sequence of a block
+ */
+static void writeSequence(unsigned char*& out, const char* literals, size_t literalLength,
+                          size_t offset, size_t matchLength) {
+    size_t literalCode = min<size_t>(literalLength, 15);
+    size_t matchCode = matchLength ? min<size_t>(matchLength - LZ_MIN_MATCH, 15) : 0;
+    *out++ = static_cast<unsigned char>(literalCode << 4 | matchCode);
+    if (literalCode == 15) {
+        writeLength(out, literalLength - 15);
+    }
+    memcpy(out, literals, literalLength);
+    out += literalLength;
+    if (matchLength == 0) {
+        return;
+    }
+    *out++ = offset & 0xFF;
+    *out++ = offset >> 8;
+    if (matchCode == 15) {
+        writeLength(out, matchLength - LZ_MIN_MATCH - 15);
+    }
+}
+
+/**
+ * Compress one block
+ *
+ * Positions with the same hash of their first four bytes are chained
+ * together; the most recent LZ_CHAIN_DEPTH of them are compared and the
+ * longest match is replaced by a back reference.
+ *
+ * @param in Raw bytes
+ * @param length Number of raw bytes, at most LZ_BLOCK_SIZE
+ * @param out Receives up to compressBound(length) bytes
+ * @return size_t Compressed length
+ */
+static size_t compressBlock(const char* in, size_t length, unsigned char* out) {
+    vector<int32_t> head(1 << LZ_HASH_BITS, -1);
+    vector<int32_t> chain(length);
+
+    unsigned char* start = out;
+    size_t anchor = 0;
+    size_t pos = 0;
+    auto insert = [&](size_t at) {
+        uint32_t sequence;
+        memcpy(&sequence, in + at, sizeof(sequence));
+        uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        chain[at] = head[hash];
+        head[hash] = at;
+    };
+
+    while (pos + LZ_MIN_MATCH <= length) {
+        insert(pos);
+        size_t bestLength = 0;
+        size_t bestOffset = 0;
+        int32_t candidate = chain[pos];
+        for (int depth = 0; depth < LZ_CHAIN_DEPTH && candidate >= 0 &&
+                            pos - candidate <= LZ_MAX_OFFSET; depth++) {
+            size_t matchLength = 0;
+            while (pos + matchLength < length && in[candidate + matchLength] == in[pos + matchLength]) {
+                matchLength++;
+            }
+            if (matchLength > bestLength) {
+                bestLength = matchLength;
+                bestOffset = pos - candidate;
+            }
+            candidate = chain[candidate];
+        }
+        if (bestLength < LZ_MIN_MATCH) {
+            pos++;
+            continue;
+        }
+
+        writeSequence(out, in + anchor, pos - anchor, bestOffset, bestLength);
+        for (size_t next = pos + 1; next < pos + bestLength && next + LZ_MIN_MATCH <= length; next++) {
+            insert(next);
+        }
+        pos += bestLength;
+        anchor = pos;
+    }
+    if (anchor < length) {
+        writeSequence(out, in + anchor, length - anchor, 0, 0);
+    }
+    return out - start;
+}
+
+/**
+ * Read the continuation bytes of a long length
+ *
+ * @param in Input position; advanced
+ * @param end End of the input
+ * @param value Length to add to
+ * @return bool False if the input ends first
+ */
+static bool readLength(const unsigned char*& in, const unsigned char* end, size_t& value) {
+    unsigned char byte;
+    do {
+        if (in == end) {
+            return false;
+        }
+        byte = *in++;
+        value += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/**
+ * Decompress one block
+ *
+ * Every length and offset is checked against the input and output,
+ * so damaged data is rejected instead of read or written out of bounds.
+ *
+ * @param data Compressed bytes
+ * @param length Number of compressed bytes
+ * @param out Receives rawLength bytes
+ * @param rawLength Expected raw length
+ * @return bool False if the data is damaged
+ */
+static bool decompressBlock(const char* data, size_t length, char* out, size_t rawLength) {
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char* end = in + length;
+    size_t pos = 0;
+    while (in < end) {
+        unsigned token = *in++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(in, end, literalLength)) {
+            return false;
+        }
+        if (literalLength > static_cast<size_t>(end - in) || literalLength > rawLength - pos) {
+            return false;
+        }
+        memcpy(out + pos, in, literalLength);
+        in += literalLength;
+        pos += literalLength;
+        if (in == end) {
+            break;
+        }
+
+        if (end - in < 2) {
+            return false;
+        }
+        size_t offset = in[0] | in[1] << 8;
+        in += 2;
+        size_t matchLength = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15 && !readLength(in, end, matchLength)) {
+            return false;
+        }
+        if (offset == 0 || offset > pos || matchLength > rawLength - pos) {
+            return false;
+        }
+        if (offset >= matchLength) {
+            memcpy(out + pos, out + pos - offset, matchLength);
+        } else {
+            for (size_t i = 0; i < matchLength; i++) {
+                out[pos + i] = out[pos - offset + i];
+            }
+        }
+        pos += matchLength;
+    }
+    return pos == rawLength;
+}
+
+/**
+ * Compress a block into a frame
+ *
+ * A block that does not get smaller is stored as it is.
+ *
+ * @param data Raw bytes
+ * @param length Number of raw bytes, at most LZ_BLOCK_SIZE
+ * @param out Frame is appended here
+ */
+void compressFrame(const char* data, size_t length, string& out) {
+    size_t headerAt = out.size();
+    out.resize(headerAt + LZ_FRAME_HEADER_SIZE + compressBound(length));
+    char* body = &out[headerAt + LZ_FRAME_HEADER_SIZE];
+
+    size_t stored = compressBlock(data, length, reinterpret_cast<unsigned char*>(body));
+    if (stored >= length) {
+        memcpy(body, data, length);
+        stored = length;
+    }
+    out.resize(headerAt + LZ_FRAME_HEADER_SIZE + stored);
+
+    lzFrameHeader header;
+    header.magic = LZ_FRAME_MAGIC;
+    header.rawLength = length;
+    header.storedLength = stored;
+    header.checksum = crc32c(data, length);
+    memcpy(&out[headerAt], &header, sizeof(header));
+}
+
+/**
+ * Compress a buffer into frames
+ *
+ * Frames are independent, so blocks are compressed on separate threads
+ * and joined in order.
+ *
+ * @param data Raw bytes
+ * @param length Number of raw bytes
+ * @return string Stream of frames
+ */
+string compressFrames(const char* data, size_t length) {
+    size_t blocks = (length + LZ_BLOCK_SIZE - 1) / LZ_BLOCK_SIZE;
+    vector<string> frames(blocks);
+    runInParallel(blocks, [&](size_t i) {
+        size_t offset = i * LZ_BLOCK_SIZE;
+        compressFrame(data + offset, min(LZ_BLOCK_SIZE, length - offset), frames[i]);
+    });
+
+    string out;
+    size_t total = 0;
+    for (const auto& frame : frames) {
+        total += frame.size();
+    }
+    out.reserve(total);
+    for (const auto& frame : frames) {
+        out += frame;
+    }
+    return out;
+}
+
+/**
+ * Read and check a frame header
+ *
+ * @param data Start of the frame
+ * @param header Receives the header
+ * @return bool False if the header cannot belong to a frame
+ */
+static bool readFrameHeader(const char* data, lzFrameHeader& header) {
+    memcpy(&header, data, sizeof(header));
+    return header.magic == LZ_FRAME_MAGIC && header.rawLength <= LZ_BLOCK_SIZE &&
+           header.storedLength <= compressBound(header.rawLength);
+}
+
+/**
+ * Check for a compressed stream by its first frame header
+ *
+ * @param data Start of the stream
+ * @param length Bytes available
+ * @return bool True if the data starts with a frame
+ */
+bool isCompressed(const char* data, size_t length) {
+    lzFrameHeader header;
+    return length >= LZ_FRAME_HEADER_SIZE && readFrameHeader(data, header);
+}
+
+/**
+ * Decode a complete frame
+ *
+ * @param frame Frame header and data
+ * @param out Receives the raw bytes
+ * @return bool False if the frame is damaged or fails its checksum
+ */
+static bool decodeFrame(const char* frame, string& out) {
+    lzFrameHeader header;
+    memcpy(&header, frame, sizeof(header));
+    const char* body = frame + LZ_FRAME_HEADER_SIZE;
+    out.resize(header.rawLength);
+    if (header.storedLength == header.rawLength) {
+        memcpy(&out[0], body, header.rawLength);
+    } else if (!decompressBlock(body, header.storedLength, &out[0], header.rawLength)) {
+        return false;
+    }
+    return crc32c(out.data(), out.size()) == header.checksum;
+}
+
+/**
+ * Add bytes to a compressed stream
+ *
+ * Whole blocks are compressed as soon as they are complete; large
+ * writes are compressed straight from the caller's buffer.
+ *
+ * @param data Raw bytes
+ * @param length Number of raw bytes
+ */
+void LzStreamWriter::write(const char* data, size_t length) {
+    while (length > 0) {
+        if (pending.empty() && length >= LZ_BLOCK_SIZE) {
+            frame.clear();
+            compressFrame(data, LZ_BLOCK_SIZE, frame);
+            emit(frame.data(), frame.size());
+            data += LZ_BLOCK_SIZE;
+            length -= LZ_BLOCK_SIZE;
+            continue;
+        }
+        size_t take = min(length, LZ_BLOCK_SIZE - pending.size());
+        pending.append(data, take);
+        data += take;
+        length -= take;
+        if (pending.size() == LZ_BLOCK_SIZE) {
+            finish();
+        }
+    }
+}
+
+/**
+ * Compress the bytes that do not fill a whole block yet
+ */
+void LzStreamWriter::finish() {
+    if (pending.empty()) {
+        return;
+    }
+    frame.clear();
+    compressFrame(pending.data(), pending.size(), frame);
+    emit(frame.data(), frame.size());
+    pending.clear();
+}
+
+/**
+ * Add bytes of a compressed stream
+ *
+ * Process:
+ * 1. Find the frames that are complete, keeping a trailing partial frame
+ * 2. Decode them on several threads
+ * 3. Hand the raw bytes to emit in stream order; a frame failing its
+ *    checksum is reported to skip instead
+ *
+ * A damaged frame header hides where the next frame starts, so nothing
+ * after it can be read.
+ *
+ * @param data Stream bytes
+ * @param length Number of stream bytes
+ * @return bool False once a frame header is damaged
+ */
+bool LzStreamReader::feed(const char* data, size_t length) {
+    if (damaged) {
+        return false;
+    }
+    // Frames are decoded straight from the caller's buffer unless one was left incomplete
+    if (!pending.empty()) {
+        pending.append(data, length);
+        data = pending.data();
+        length = pending.size();
+    }
+
+    vector<size_t> frames;
+    size_t pos = 0;
+    while (length - pos >= LZ_FRAME_HEADER_SIZE) {
+        lzFrameHeader header;
+        if (!readFrameHeader(data + pos, header)) {
+            damaged = true;
+            break;
+        }
+        size_t frameSize = LZ_FRAME_HEADER_SIZE + header.storedLength;
+        if (length - pos < frameSize) {
+            break;
+        }
+        frames.push_back(pos);
+        pos += frameSize;
+    }
+
+    if (decoded.size() < frames.size()) {
+        decoded.resize(frames.size());
+    }
+    vector<char> valid(frames.size());
+    runInParallel(frames.size(), [&](size_t i) {
+        valid[i] = decodeFrame(data + frames[i], decoded[i]);
+    });
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (valid[i]) {
+            emit(decoded[i].data(), decoded[i].size());
+            continue;
+        }
+        skippedFrames++;
+        if (skip) {
+            lzFrameHeader header;
+            memcpy(&header, data + frames[i], sizeof(header));
+            skip(header.rawLength);
+        }
+    }
+
+    if (data == pending.data()) {
+        pending.erase(0, pos);
+    } else {
+        pending.assign(data + pos, length - pos);
+    }
+    return !damaged;
+}
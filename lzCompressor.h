@@ -0,0 +1,88 @@
+/**
+ * LZ Block Compressor Header
+ *
+ * Purpose:
+ * Compresses files of the banking system before they are encrypted or
+ * archived, without any external library.
+ *
+ * Frame Layout:
+ * - 16-byte header: magic, raw length, stored length and the CRC-32C
+ *   of the raw bytes
+ * - LZ77 sequences of literals and back references within the frame,
+ *   or the raw bytes when compression would not make them smaller
+ *
+ * Every frame holds at most LZ_BLOCK_SIZE raw bytes and can be decoded
+ * on its own, so a stream of frames can be decoded on several threads,
+ * appended to without touching what is already written, and read past
+ * a damaged frame.
+ */
+
+#ifndef LZ_COMPRESSOR_H
+#define LZ_COMPRESSOR_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <functional>
+
+using namespace std;
+
+// Raw bytes held by one frame at most
+const size_t LZ_BLOCK_SIZE = 64 * 1024;
+
+// Size of a frame header
+const size_t LZ_FRAME_HEADER_SIZE = 16;
+
+// Compresses up to LZ_BLOCK_SIZE bytes into one frame appended to out
+void compressFrame(const char* data, size_t length, string& out);
+
+// Compresses a buffer into a stream of frames, on several threads when it is large
+string compressFrames(const char* data, size_t length);
+
+// Checks whether a buffer starts with a frame header
+bool isCompressed(const char* data, size_t length);
+
+// Compresses data written in pieces; emit receives each finished frame
+class LzStreamWriter {
+public:
+    explicit LzStreamWriter(const function<void(const char*, size_t)>& emit) : emit(emit) {}
+
+    // Adds bytes to the stream
+    void write(const char* data, size_t length);
+
+    // Compresses what is left into a last, shorter frame
+    void finish();
+
+private:
+    function<void(const char*, size_t)> emit;
+    string pending;
+    string frame;
+};
+
+// Decompresses a stream of frames fed in pieces of any size
+// emit receives the raw bytes in order; the frames in one piece are decoded in parallel.
+// A frame failing its checksum is passed to skip with its raw length instead, and
+// decoding goes on with the next frame
+class LzStreamReader {
+public:
+    explicit LzStreamReader(const function<void(const char*, size_t)>& emit,
+                            const function<void(size_t)>& skip = nullptr)
+        : emit(emit), skip(skip) {}
+
+    // Adds stream bytes; returns false once a frame header is damaged
+    bool feed(const char* data, size_t length);
+
+    // Returns false if a frame header was damaged or the stream ends inside a frame
+    bool finish() const { return !damaged && pending.empty(); }
+
+    size_t skippedFrames = 0;   // Frames that failed their checksum
+
+private:
+    function<void(const char*, size_t)> emit;
+    function<void(size_t)> skip;
+    string pending;             // Start of a frame that is not complete yet
+    vector<string> decoded;     // Reused output buffers, one per frame
+    bool damaged = false;
+};
+
+#endif // LZ_COMPRESSOR_H
@@ -15,6 +15,8 @@
 #include "menuFunctions.h"
 #include "userManagement.h"
 #include "utilityFunctions.h"
+#include "passwordHasher.h"
+#include "fileLock.h"
 
 // Color codes for terminal output formatting
 #define RESET   "\033[0m"
@@ -42,11 +44,39 @@ using namespace std;
  * - Role-based menu routing
  * - Error handling for invalid credentials
  * - Clean exit functionality
+ * - Summary of lock waits on exit, if any operation had to wait
  *
+ * Options:
+ * --password-cost <space> <time>   Cost of newly hashed passwords
+ * --bench-login <logins> <clients> Benchmark password verification and exit
+ *
+ * @param argc Number of command line arguments
+ * @param argv Command line arguments
  * @return int Program exit status
  */
-int main() {
+int main(int argc, char* argv[]) {
     string username, password;
+
+    // Command line options
+    for (int i = 1; i < argc; i++) {
+        string option = argv[i];
+        try {
+            if (option == "--password-cost" && i + 2 < argc) {
+                setPasswordCost({static_cast<uint32_t>(stoul(argv[i + 1])),
+                                 static_cast<uint32_t>(stoul(argv[i + 2]))});
+                i += 2;
+            } else if (option == "--bench-login" && i + 2 < argc) {
+                runLoginBenchmark(stoul(argv[i + 1]), stoul(argv[i + 2]));
+                return 0;
+            } else {
+                cerr << "Unknown option: " << option << endl;
+                return 1;
+            }
+        } catch (const exception&) {
+            cerr << "Invalid value for " << option << endl;
+            return 1;
+        }
+    }
     
     // Main program loop
     while (true) {
@@ -69,6 +99,7 @@ int main() {
                 // Client menu access with their account numbers
                 displayClientMenu(currentUser.accountNumbers);
             }
+            endSession();
         } else {
             // Handle failed login
             cout << RED << "Invalid username or password. Please try again." << RESET << endl;
@@ -76,6 +107,14 @@ int main() {
             cin.get();
         }
     }
-    
+
+    LockWaitStats waits = lockWaitStats();
+    if (waits.contended > 0) {
+        cerr << "Lock waits: " << waits.contended << " of "
+             << waits.acquisitions + waits.timeouts << " operations waited, "
+             << waits.totalWait.count() / 1000 << " ms in total, longest "
+             << waits.longestWait.count() / 1000 << " ms, "
+             << waits.timeouts << " timed out" << endl;
+    }
     return 0;
 }
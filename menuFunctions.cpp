@@ -8,7 +8,6 @@
 #include "listAllAccounts.h"
 #include "deleteAccount.h"
 #include "utilityFunctions.h"
-#include "fileLock.h"
 #include "transferFunds.h"
 #include "accountDatabase.h"
 #include "transactionLog.h"
@@ -30,8 +29,6 @@
 
 using namespace std;
 
-const string FILE_NAME = "accounts.txt";
-
 void displayLoginMenu(string& username, string& password) {
     clearScreen();
     cout << CYAN;
@@ -64,7 +61,36 @@ void changeUsernameMenu() {
     if (changeUsername(getCurrentUser().username, newUsername)) {
         cout << GREEN << "Username changed successfully." << RESET << endl;
     } else {
-        cout << RED << "Failed to change username." << RESET << endl;
+        cout << RED << "Failed to change username. It may be in use, empty or too long." << RESET << endl;
+    }
+}
+
+void importAccountsMenu() {
+    string filename;
+    cout << "Enter the CSV file to import: ";
+    getline(cin, filename);
+    if (filename.empty()) {
+        cout << "No file given; nothing was imported." << endl;
+        return;
+    }
+
+    int imported = importAccountsFromCsv(filename);
+    cout << GREEN << imported << " account(s) imported." << RESET << endl;
+}
+
+void exportAccountsMenu() {
+    string filename;
+    cout << "Enter the CSV file to export to: ";
+    getline(cin, filename);
+    if (filename.empty()) {
+        cout << "No file given; nothing was exported." << endl;
+        return;
+    }
+
+    if (exportAccountsToCsv(filename)) {
+        cout << GREEN << "Accounts exported to " << filename << "." << RESET << endl;
+    } else {
+        cout << RED << "Failed to export accounts." << RESET << endl;
     }
 }
 
@@ -151,15 +177,7 @@ void changePasswordMenu(bool isManager) {
 }
 
 unique_ptr<bankAccountType> selectAccount(const vector<int>& accountNumbers, const string& prompt) {
-    vector<unique_ptr<bankAccountType>> accounts = loadAccounts();
-    vector<unique_ptr<bankAccountType>> userAccounts;
-    
-    for (auto& account : accounts) {
-        if (find(accountNumbers.begin(), accountNumbers.end(), 
-                account->getAccountNumber()) != accountNumbers.end()) {
-            userAccounts.push_back(move(account));
-        }
-    }
+    vector<unique_ptr<bankAccountType>> userAccounts = findAccountsInDatabase(accountNumbers);
 
     if (userAccounts.empty()) {
         cout << "No accounts found." << endl;
@@ -190,7 +208,6 @@ unique_ptr<bankAccountType> selectAccount(const vector<int>& accountNumbers, con
 }
 void displayClientMenu(const vector<int>& accountNumbers) {
     char choice;
-    int lockFd = -1;
 
     do {
         clearScreen();
@@ -225,17 +242,11 @@ void displayClientMenu(const vector<int>& accountNumbers) {
                 auto selectedAccount = selectAccount(accountNumbers, 
                     "Select account for operation:");
                 if (selectedAccount) {
-                    lockFd = acquireLock(FILE_NAME);
-                    if (lockFd == -1) {
-                        cout << "Someone is currently editing the file. Please try again later." << endl;
-                        break;
-                    }
                     switch (choice) {
                         case '1': deposit(selectedAccount->getAccountNumber()); break;
                         case '2': withdraw(selectedAccount->getAccountNumber()); break;
                         case '3': checkBalance(selectedAccount->getAccountNumber()); break;
                     }
-                    releaseLock(lockFd);
                 }
                 break;
             }
@@ -246,13 +257,7 @@ void displayClientMenu(const vector<int>& accountNumbers) {
                     cin.get();
                     break;
                 }
-                lockFd = acquireLock(FILE_NAME);
-                if (lockFd == -1) {
-                    cout << "Someone is currently editing the file. Please try again later." << endl;
-                    break;
-                }
                 transferFunds(getCurrentUser().accountNumbers[0]);
-                releaseLock(lockFd);
                 break;
             }
             case '5':
@@ -280,7 +285,6 @@ void displayClientMenu(const vector<int>& accountNumbers) {
 
 void displayManagerMenu() {
     char choice;
-    int lockFd = -1;
 
     do {
         clearScreen();
@@ -300,6 +304,8 @@ void displayManagerMenu() {
         cout << "│ " << CYAN << "L" << RESET << ". View Login History           │\n";
         cout << "│ " << CYAN << "U" << RESET << ". Change Username              │\n";
         cout << "│ " << CYAN << "P" << RESET << ". Change Password              │\n";
+        cout << "│ " << CYAN << "I" << RESET << ". Import Accounts from CSV     │\n";
+        cout << "│ " << CYAN << "E" << RESET << ". Export Accounts to CSV       │\n";
         cout << "│ " << MAGENTA << "R" << RESET << ". Reset System to Admin Only   │\n";
         cout << "│ " << RED << "0" << RESET << ". Logout                       │\n";
         cout << "└─────────────────────────────────┘\n";
@@ -307,20 +313,14 @@ void displayManagerMenu() {
         cin >> choice;
         cin.ignore(numeric_limits<streamsize>::max(), '\n');
 
-        vector<unique_ptr<bankAccountType>> accounts = loadAccounts();
+        size_t accountCount = countAccounts();
         vector<User> users = getAllUsers();
         int numClients = count_if(users.begin(), users.end(), 
                                 [](const User& user) { return user.role == UserRole::CLIENT; });
 
         switch (toupper(choice)) {
             case '1':
-                lockFd = acquireLock(FILE_NAME);
-                if (lockFd == -1) {
-                    cout << "Someone is currently editing the file. Please try again later." << endl;
-                    break;
-                }
                 createAccount();
-                releaseLock(lockFd);
                 break;
             case '2':
             case '3':
@@ -328,17 +328,14 @@ void displayManagerMenu() {
             case '5':
             case '7':
             case '8': {
-                if (accounts.empty()) {
+                if (accountCount == 0) {
                     cout << "No accounts exist in the system. Create an account first." << endl;
                     cout << "Press Enter to continue...";
                     cin.get();
                     break;
                 }
-                lockFd = acquireLock(FILE_NAME);
-                if (lockFd == -1) {
-                    cout << "Someone is currently editing the file. Please try again later." << endl;
-                    break;
-                }
+                // Each operation commits against the account versions it read
+                // and nothing is locked while it waits for input
                 switch (toupper(choice)) {
                     case '2': editAccount(); break;
                     case '3': deposit(); break;
@@ -356,11 +353,10 @@ void displayManagerMenu() {
                         break;
                     }
                 }
-                releaseLock(lockFd);
                 break;
             }
             case '6': {
-                if (accounts.empty()) {
+                if (accountCount == 0) {
                     cout << "No accounts exist in the system." << endl;
                     cout << "Press Enter to continue...";
                     cin.get();
@@ -390,6 +386,12 @@ void displayManagerMenu() {
                 }
                 break;
             }
+            case 'I':
+                importAccountsMenu();
+                break;
+            case 'E':
+                exportAccountsMenu();
+                break;
             case 'R': {
                 cout << "Are you sure you want to reset the system? This will remove all users except admin. (y/n): ";
                 char confirm;
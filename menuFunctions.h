@@ -12,6 +12,8 @@
 using namespace std;
 
 void changeUsernameMenu();
+void importAccountsMenu();
+void exportAccountsMenu();
 void changePasswordMenu(bool isManager = false);
 void displayManagerMenu();
 void displayClientMenu(const vector<int>& accountNumbers);
@@ -0,0 +1,65 @@
+/**
+ * Parallel Tasks Implementation
+ *
+ * This file implements the fork-join helper used for bulk cipher work.
+ */
+
+#include "parallelTasks.h"
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+using namespace std;
+
+// Upper bound on worker threads, whatever the hardware reports
+const size_t MAX_PARALLEL_WORKERS = 16;
+
+/**
+ * Get the number of worker threads
+ *
+ * @return size_t Hardware threads, at least 1 and at most MAX_PARALLEL_WORKERS
+ */
+size_t parallelWorkerCount() {
+    static const size_t workers =
+        max<size_t>(1, min<size_t>(thread::hardware_concurrency(), MAX_PARALLEL_WORKERS));
+    return workers;
+}
+
+/**
+ * Run numbered tasks on several threads
+ *
+ * Process:
+ * 1. Start one thread fewer than needed; the caller is the last worker
+ * 2. Each worker takes the next task number until none are left
+ * 3. Join the workers
+ *
+ * @param count Number of tasks
+ * @param task Called once for every task number
+ */
+void runInParallel(size_t count, const function<void(size_t)>& task) {
+    size_t workers = min(count, parallelWorkerCount());
+    if (workers <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    atomic<size_t> next{0};
+    auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            task(i);
+        }
+    };
+
+    vector<thread> threads;
+    threads.reserve(workers - 1);
+    for (size_t i = 1; i < workers; i++) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto& worker : threads) {
+        worker.join();
+    }
+}
@@ -0,0 +1,29 @@
+/**
+ * Parallel Tasks Header
+ *
+ * Purpose:
+ * Runs independent, numbered pieces of work on several threads, for the
+ * bulk encryption and decryption of large files.
+ *
+ * Features:
+ * - Worker count follows the number of hardware threads
+ * - Work is handed out one task at a time, so uneven tasks balance out
+ * - Small jobs run on the calling thread without starting any threads
+ */
+
+#ifndef PARALLEL_TASKS_H
+#define PARALLEL_TASKS_H
+
+#include <cstddef>
+#include <functional>
+
+using namespace std;
+
+// Number of threads runInParallel uses at most
+size_t parallelWorkerCount();
+
+// Calls task(i) for every i in [0, count) across the worker threads
+// Returns once every task has finished; tasks must not depend on each other
+void runInParallel(size_t count, const function<void(size_t)>& task);
+
+#endif // PARALLEL_TASKS_H
@@ -0,0 +1,487 @@
+/**
+ * Password Hasher Implementation
+ *
+ * This file implements password hashing and verification:
+ * - Balloon hashing (Boneh, Corrigan-Gibbs and Schechter) over SHA-256
+ * - Encoding of salt, cost and hash into the stored string
+ * - A fixed pool of workers with a bounded job queue
+ * - Machine-wide hashing slots shared by every session
+ * - A benchmark of concurrent login verification
+ */
+
+#include "passwordHasher.h"
+#include "sha256.h"
+#include "simpleEncryption.h"
+#include "fileLock.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cctype>
+#include <sys/random.h>
+
+using namespace std;
+
+const string PASSWORD_HASH_PREFIX = "bh1";
+const size_t PASSWORD_SALT_SIZE = 16;
+const uint32_t BALLOON_DELTA = 3;               // Random blocks mixed into each block per round
+const size_t PASSWORD_MAX_WORKERS = 4;
+const size_t PASSWORD_QUEUE_LIMIT = 64;         // Jobs waiting for a worker before callers block
+
+// Hashing slots shared by all sessions; byte n of the file is slot n
+const string PASSWORD_SLOT_FILE = "passwords.lock";
+const chrono::milliseconds PASSWORD_SLOT_PAUSE_MAX(20);
+const chrono::milliseconds PASSWORD_SLOT_TIMEOUT(10000);
+
+// Cost used for new hashes
+static mutex costMutex;
+static PasswordCost currentCost = DEFAULT_PASSWORD_COST;
+
+/**
+ * Fixed pool of hashing threads
+ *
+ * Jobs are queued up to PASSWORD_QUEUE_LIMIT; callers that find the
+ * queue full wait for room, so the work in progress stays bounded.
+ */
+class passwordWorkerPool {
+public:
+    passwordWorkerPool() {
+        size_t workers = max<size_t>(1, min<size_t>(thread::hardware_concurrency(), PASSWORD_MAX_WORKERS));
+        for (size_t i = 0; i < workers; i++) {
+            threads.emplace_back([this] { work(); });
+        }
+    }
+
+    ~passwordWorkerPool() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        for (auto& worker : threads) {
+            worker.join();
+        }
+    }
+
+    // Runs a job on a worker and waits for its result
+    template <typename T>
+    T run(const function<T()>& job) {
+        // Shared with the queued job, so the task stays alive however this call returns
+        auto task = make_shared<packaged_task<T()>>(job);
+        future<T> result = task->get_future();
+        {
+            unique_lock<mutex> lock(queueMutex);
+            roomAvailable.wait(lock, [this] { return jobs.size() < PASSWORD_QUEUE_LIMIT; });
+            jobs.emplace_back([task] { (*task)(); });
+        }
+        jobReady.notify_one();
+        return result.get();
+    }
+
+private:
+    void work() {
+        while (true) {
+            function<void()> job;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = move(jobs.front());
+                jobs.pop_front();
+            }
+            roomAvailable.notify_one();
+            job();
+        }
+    }
+
+    vector<thread> threads;
+    mutex queueMutex;
+    condition_variable jobReady;
+    condition_variable roomAvailable;
+    deque<function<void()>> jobs;
+    bool stopping = false;
+};
+
+/**
+ * Get the process-wide worker pool, started on first use
+ *
+ * @return passwordWorkerPool& The shared pool
+ */
+static passwordWorkerPool& workerPool() {
+    static passwordWorkerPool pool;
+    return pool;
+}
+
+/**
+ * Set the cost used for new hashes
+ *
+ * @param cost Space and time cost; zero values are raised to 1 and
+ *             values above MAX_PASSWORD_COST lowered to it
+ */
+void setPasswordCost(const PasswordCost& cost) {
+    lock_guard<mutex> lock(costMutex);
+    currentCost.spaceCost = clamp<uint32_t>(cost.spaceCost, 1, MAX_PASSWORD_COST.spaceCost);
+    currentCost.timeCost = clamp<uint32_t>(cost.timeCost, 1, MAX_PASSWORD_COST.timeCost);
+}
+
+/**
+ * Get the cost used for new hashes
+ *
+ * @return PasswordCost Current space and time cost
+ */
+PasswordCost passwordCost() {
+    lock_guard<mutex> lock(costMutex);
+    return currentCost;
+}
+
+/**
+ * SHA-256 of a counter followed by up to two inputs
+ *
+ * @param counter Balloon hashing step counter, incremented
+ * @param first First input
+ * @param firstLength Length of the first input
+ * @param second Second input, may be null
+ * @param secondLength Length of the second input
+ * @param out Receives the digest
+ */
+static void balloonStep(uint64_t& counter, const void* first, size_t firstLength,
+                        const void* second, size_t secondLength, uint8_t* out) {
+    Sha256 hash;
+    hash.update(&counter, sizeof(counter));
+    counter++;
+    hash.update(first, firstLength);
+    if (second) {
+        hash.update(second, secondLength);
+    }
+    hash.finish(out);
+}
+
+/**
+ * Balloon hash of a password
+ *
+ * Process:
+ * 1. Expand: fill spaceCost blocks, each the hash of the one before
+ * 2. Mix: for timeCost rounds, hash every block with its predecessor
+ *    and with BALLOON_DELTA blocks chosen by the salt
+ * 3. Extract: the last block is the result
+ *
+ * @param password Password to hash
+ * @param salt Random salt
+ * @param cost Space and time cost
+ * @return string SHA256_DIGEST_SIZE bytes of hash
+ */
+static string balloonHash(const string& password, const string& salt, const PasswordCost& cost) {
+    const size_t blockSize = SHA256_DIGEST_SIZE;
+    size_t blocks = cost.spaceCost;
+    vector<uint8_t> buffer(blocks * blockSize);
+    uint64_t counter = 0;
+
+    balloonStep(counter, password.data(), password.size(), salt.data(), salt.size(), &buffer[0]);
+    for (size_t m = 1; m < blocks; m++) {
+        balloonStep(counter, &buffer[(m - 1) * blockSize], blockSize, nullptr, 0, &buffer[m * blockSize]);
+    }
+
+    for (uint32_t t = 0; t < cost.timeCost; t++) {
+        for (size_t m = 0; m < blocks; m++) {
+            uint8_t* current = &buffer[m * blockSize];
+            const uint8_t* previous = &buffer[((m + blocks - 1) % blocks) * blockSize];
+            balloonStep(counter, previous, blockSize, current, blockSize, current);
+
+            for (uint32_t i = 0; i < BALLOON_DELTA; i++) {
+                uint64_t index[3] = {t, m, i};
+                uint8_t digest[SHA256_DIGEST_SIZE];
+                balloonStep(counter, salt.data(), salt.size(), index, sizeof(index), digest);
+                uint64_t other;
+                memcpy(&other, digest, sizeof(other));
+                balloonStep(counter, current, blockSize, &buffer[(other % blocks) * blockSize],
+                            blockSize, current);
+            }
+        }
+    }
+
+    return string(reinterpret_cast<const char*>(&buffer[(blocks - 1) * blockSize]), blockSize);
+}
+
+/**
+ * Take one of the hashing slots shared by every session on this machine
+ *
+ * Each session has its own worker pool, so the pools alone would let
+ * many sessions hash at once. There is one slot per CPU, each a byte of
+ * PASSWORD_SLOT_FILE held with a byte-range lock, which the kernel
+ * drops if its session dies. The slots are tried in turn; while all are
+ * taken the worker sleeps with growing pauses and tries again.
+ *
+ * If no slot frees up within PASSWORD_SLOT_TIMEOUT, or the slot file
+ * cannot be opened, the hash runs without one rather than failing the
+ * login.
+ *
+ * @return RecordLockGuard Holds the slot; releases it when it goes out of scope
+ */
+static RecordLockGuard admitHashing() {
+    off_t slots = max<unsigned>(1, thread::hardware_concurrency());
+    auto deadline = chrono::steady_clock::now() + PASSWORD_SLOT_TIMEOUT;
+    chrono::milliseconds pause(1);
+    while (true) {
+        for (off_t slot = 0; slot < slots; slot++) {
+            RecordLockGuard guard(PASSWORD_SLOT_FILE, {slot}, chrono::milliseconds(0));
+            if (guard) {
+                return guard;
+            }
+        }
+        if (chrono::steady_clock::now() >= deadline) {
+            cerr << "Warning: no password hashing slot became free; hashing without one" << endl;
+            return RecordLockGuard(PASSWORD_SLOT_FILE, {}, chrono::milliseconds(0));
+        }
+        this_thread::sleep_for(pause);
+        pause = min(pause * 2, PASSWORD_SLOT_PAUSE_MAX);
+    }
+}
+
+/**
+ * Run a balloon hash on the worker pool, inside a machine-wide slot
+ *
+ * @param password Password to hash
+ * @param salt Salt bytes
+ * @param cost Space and time cost
+ * @return string Raw hash
+ */
+static string admittedHash(const string& password, const string& salt, const PasswordCost& cost) {
+    return workerPool().run<string>([&] {
+        RecordLockGuard slot = admitHashing();
+        return balloonHash(password, salt, cost);
+    });
+}
+
+/**
+ * Encode bytes as lowercase hex
+ *
+ * @param bytes Bytes to encode
+ * @return string Two hex digits per byte
+ */
+string toHex(const string& bytes) {
+    static const char digits[] = "0123456789abcdef";
+    string hex;
+    hex.reserve(bytes.size() * 2);
+    for (unsigned char c : bytes) {
+        hex += digits[c >> 4];
+        hex += digits[c & 0x0f];
+    }
+    return hex;
+}
+
+/**
+ * Decode lowercase or uppercase hex
+ *
+ * @param hex Hex digits
+ * @param bytes Receives the decoded bytes
+ * @return bool False if the input is not valid hex
+ */
+static bool fromHex(const string& hex, string& bytes) {
+    if (hex.size() % 2 != 0) {
+        return false;
+    }
+    bytes.clear();
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        int value = 0;
+        for (size_t j = i; j < i + 2; j++) {
+            char c = hex[j];
+            int digit = isdigit(static_cast<unsigned char>(c)) ? c - '0'
+                      : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                      : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+            if (digit < 0) {
+                return false;
+            }
+            value = value * 16 + digit;
+        }
+        bytes += static_cast<char>(value);
+    }
+    return true;
+}
+
+/**
+ * Compare two strings without stopping at the first difference
+ *
+ * @param a First string
+ * @param b Second string
+ * @return bool True if the strings are equal
+ */
+static bool constantTimeEquals(const string& a, const string& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    unsigned char difference = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        difference |= a[i] ^ b[i];
+    }
+    return difference == 0;
+}
+
+/**
+ * Generate random bytes for salts and tokens
+ *
+ * @param count Number of bytes
+ * @return string count random bytes
+ */
+string randomBytes(size_t count) {
+    string salt(count, '\0');
+    size_t filled = 0;
+    while (filled < salt.size()) {
+        ssize_t bytes = getrandom(&salt[filled], salt.size() - filled, 0);
+        if (bytes <= 0) {
+            break;
+        }
+        filled += bytes;
+    }
+    if (filled < salt.size()) {
+        // Fall back to mixing the clock if the kernel offers no randomness
+        uint64_t seed = chrono::high_resolution_clock::now().time_since_epoch().count();
+        for (size_t i = filled; i < salt.size(); i++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            salt[i] = static_cast<char>(seed >> 56);
+        }
+    }
+    return salt;
+}
+
+/**
+ * Hash a password for storage
+ *
+ * The work runs on the worker pool, in a machine-wide hashing slot.
+ *
+ * @param password Password to hash
+ * @return string Stored form with cost, salt and hash
+ */
+string hashPassword(const string& password) {
+    PasswordCost cost = passwordCost();
+    string salt = randomBytes(PASSWORD_SALT_SIZE);
+    string hash = admittedHash(password, salt, cost);
+
+    return PASSWORD_HASH_PREFIX + "$" + to_string(cost.spaceCost) + "$" + to_string(cost.timeCost) +
+           "$" + toHex(salt) + "$" + toHex(hash);
+}
+
+/**
+ * Check a password against its stored hash
+ *
+ * Accepts balloon hashes and the DJB2 hashes written by earlier
+ * versions. Either is reported as needing a rehash when it does not
+ * match the current scheme and cost.
+ *
+ * A stored hash claiming a cost above MAX_PASSWORD_COST is rejected
+ * before any hashing, so a tampered users file cannot make a login
+ * allocate and churn unbounded memory. The work runs on the worker
+ * pool, in a machine-wide hashing slot.
+ *
+ * @param password Password entered
+ * @param storedHash Stored form of the user's password
+ * @return PasswordCheck Whether the password matches and should be rehashed
+ */
+PasswordCheck verifyPassword(const string& password, const string& storedHash) {
+    PasswordCheck check;
+
+    vector<string> fields;
+    istringstream stream(storedHash);
+    for (string field; getline(stream, field, '$');) {
+        fields.push_back(field);
+    }
+
+    if (fields.size() != 5 || fields[0] != PASSWORD_HASH_PREFIX) {
+        // DJB2 hash from before balloon hashing
+        check.valid = !storedHash.empty() &&
+                      constantTimeEquals(simpleHash(password), storedHash);
+        check.needsRehash = true;
+        return check;
+    }
+
+    unsigned long spaceCost, timeCost;
+    string salt, expected;
+    try {
+        spaceCost = stoul(fields[1]);
+        timeCost = stoul(fields[2]);
+    } catch (const exception&) {
+        return check;
+    }
+    if (spaceCost == 0 || timeCost == 0 || !fromHex(fields[3], salt) ||
+        !fromHex(fields[4], expected)) {
+        return check;
+    }
+    if (spaceCost > MAX_PASSWORD_COST.spaceCost || timeCost > MAX_PASSWORD_COST.timeCost) {
+        cerr << "Error: stored password hash exceeds the highest accepted cost; rejected" << endl;
+        return check;
+    }
+    PasswordCost cost = {static_cast<uint32_t>(spaceCost), static_cast<uint32_t>(timeCost)};
+
+    string actual = admittedHash(password, salt, cost);
+    PasswordCost current = passwordCost();
+    check.valid = constantTimeEquals(actual, expected);
+    check.needsRehash = cost.spaceCost != current.spaceCost || cost.timeCost != current.timeCost;
+    return check;
+}
+
+/**
+ * Benchmark concurrent login verification
+ *
+ * Process:
+ * 1. Hash a password once at the current cost
+ * 2. Start the given number of clients, each verifying its share
+ *    of the logins back to back
+ * 3. Print throughput and latency percentiles, queueing included
+ *
+ * @param logins Total number of verifications
+ * @param clients Number of concurrent clients
+ */
+void runLoginBenchmark(size_t logins, size_t clients) {
+    clients = max<size_t>(1, clients);
+    PasswordCost cost = passwordCost();
+    string stored = hashPassword("benchmark-password");
+
+    vector<double> latencies(logins);
+    atomic<size_t> next{0};
+    atomic<size_t> failures{0};
+    auto start = chrono::steady_clock::now();
+
+    vector<thread> threads;
+    for (size_t c = 0; c < clients; c++) {
+        threads.emplace_back([&] {
+            for (size_t i = next++; i < logins; i = next++) {
+                auto begin = chrono::steady_clock::now();
+                if (!verifyPassword("benchmark-password", stored).valid) {
+                    failures++;
+                }
+                latencies[i] = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+            }
+        });
+    }
+    for (auto& client : threads) {
+        client.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies.empty() ? 0.0 : latencies[min(latencies.size() - 1, size_t(p * latencies.size()))];
+    };
+
+    cout << fixed << setprecision(2);
+    cout << "Login benchmark: " << logins << " logins, " << clients << " clients, cost "
+         << cost.spaceCost << "/" << cost.timeCost << endl;
+    cout << "Throughput: " << (seconds > 0 ? logins / seconds : 0.0) << " logins/s" << endl;
+    cout << "Latency ms: p50 " << percentile(0.50) << ", p99 " << percentile(0.99)
+         << ", max " << (latencies.empty() ? 0.0 : latencies.back()) << endl;
+    if (failures > 0) {
+        cout << "Failed verifications: " << failures << endl;
+    }
+}
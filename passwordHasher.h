@@ -0,0 +1,72 @@
+/**
+ * Password Hasher Header
+ *
+ * Purpose:
+ * Hashes and verifies passwords with a memory-hard function whose cost
+ * can be tuned, on a small fixed pool of worker threads.
+ *
+ * Features:
+ * - Balloon hashing over SHA-256 with a random salt per password
+ * - Cost parameters stored with each hash, so the cost can be raised
+ *   without invalidating existing passwords
+ * - Verification reports hashes made with an older cost or with the
+ *   previous DJB2 scheme, so they can be replaced on the next login
+ * - A bounded queue in front of the workers, so a burst of logins
+ *   cannot start unbounded hashing work
+ * - One hashing slot per CPU shared by all sessions on the machine, so
+ *   many sessions logging in at once do not oversubscribe the CPUs
+ *
+ * Stored Format:
+ * bh1$<spaceCost>$<timeCost>$<salt hex>$<hash hex>
+ */
+
+#ifndef PASSWORD_HASHER_H
+#define PASSWORD_HASHER_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// Cost parameters of the password hash
+struct PasswordCost {
+    uint32_t spaceCost;     // 32-byte blocks of memory filled per hash
+    uint32_t timeCost;      // Mixing rounds over that memory
+};
+
+// Default cost: 128 KiB of memory and two rounds, tens of milliseconds of CPU per hash
+const PasswordCost DEFAULT_PASSWORD_COST = {4096, 2};
+
+// Highest cost accepted: 32 MiB of memory and 16 rounds
+// Stored hashes above it are rejected without hashing
+const PasswordCost MAX_PASSWORD_COST = {1u << 20, 16};
+
+// Result of checking a password
+struct PasswordCheck {
+    bool valid = false;
+    bool needsRehash = false;   // Stored hash uses an older scheme or cost
+};
+
+// Sets the cost used for new hashes, limited to MAX_PASSWORD_COST; stored hashes keep their own cost
+void setPasswordCost(const PasswordCost& cost);
+
+// Returns the cost used for new hashes
+PasswordCost passwordCost();
+
+// Hashes a password with a new salt at the current cost
+string hashPassword(const string& password);
+
+// Checks a password against a stored hash
+PasswordCheck verifyPassword(const string& password, const string& storedHash);
+
+// Returns count random bytes from the kernel, for salts and tokens
+string randomBytes(size_t count);
+
+// Encodes bytes as lowercase hex
+string toHex(const string& bytes);
+
+// Verifies logins from several concurrent clients and prints throughput and latency
+void runLoginBenchmark(size_t logins, size_t clients);
+
+#endif // PASSWORD_HASHER_H
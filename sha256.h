@@ -0,0 +1,40 @@
+/**
+ * SHA-256 Header
+ *
+ * Purpose:
+ * Provides the SHA-256 hash function (FIPS 180-4) used by password
+ * hashing, without an external crypto library.
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+const size_t SHA256_DIGEST_SIZE = 32;
+
+// Incremental SHA-256 computation
+class Sha256 {
+public:
+    Sha256();
+
+    // Adds bytes to the message
+    void update(const void* data, size_t length);
+
+    // Finishes the message and writes the 32-byte digest
+    void finish(uint8_t digest[SHA256_DIGEST_SIZE]);
+
+private:
+    void compress(const uint8_t block[64]);
+
+    uint32_t state[8];
+    uint8_t buffer[64];
+    size_t buffered = 0;
+    uint64_t totalLength = 0;
+};
+
+#endif // SHA256_H
@@ -3,18 +3,22 @@
  * 
  * This file implements basic encryption functionality:
  * - String hashing for passwords
- * - File content encryption/decryption
- * - Simple XOR-based encryption
+ * - Buffer and streaming file decryption
+ * - Simple XOR-based encryption with SSE2/AVX2 kernels
+ *   selected at runtime
  */
 
 #include "simpleEncryption.h"
-#include <fstream>
-#include <sstream>
+#include "parallelTasks.h"
 #include <iostream>
-#include <filesystem>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
-namespace fs = std::filesystem;
 
 /**
  * Create a simple hash of an input string
@@ -40,87 +44,319 @@ string simpleHash(const string& input) {
 }
 
 /**
- * Encrypt/Decrypt a string using XOR
+ * Expand a key for the XOR kernels
  * 
- * Process:
- * 1. XOR each character with corresponding key character
- * 2. Key is repeated if shorter than input
- * 
- * Features:
- * - Symmetric encryption (same operation encrypts and decrypts)
- * - Key-based encryption
+ * The pattern holds the key repeated to keyLength + XOR_BLOCK_SIZE
+ * bytes, so a full vector of key stream starting at any key position
+ * can be loaded with one unaligned load.
  * 
- * @param input String to encrypt/decrypt
  * @param key Encryption key
- * @return string Encrypted/decrypted result
+ * @return ExpandedKey Key length and repeating pattern
  */
-string encryptDecrypt(const string& input, const string& key) {
-    string output = input;
-    for (size_t i = 0; i < input.size(); i++) {
-        output[i] = input[i] ^ key[i % key.length()];
+ExpandedKey expandKey(const string& key) {
+    ExpandedKey expanded;
+    expanded.keyLength = key.length();
+    if (!key.empty()) {
+        expanded.pattern.reserve(key.length() + XOR_BLOCK_SIZE);
+        while (expanded.pattern.size() < key.length() + XOR_BLOCK_SIZE) {
+            expanded.pattern += key;
+        }
     }
-    return output;
+    return expanded;
 }
 
 /**
- * Encrypt a file
+ * Scalar XOR kernel
  * 
- * Process:
- * 1. Read content from temporary file
- * 2. Encrypt content
- * 3. Write encrypted content to main file
+ * @param data Buffer to transform
+ * @param length Number of bytes
+ * @param key Expanded key
+ * @param keyPos Key position of the first byte
+ */
+static void xorScalar(char* data, size_t length, const ExpandedKey& key, size_t keyPos) {
+    const char* pattern = key.pattern.data();
+    for (size_t i = 0; i < length; i++) {
+        data[i] ^= pattern[keyPos];
+        if (++keyPos == key.keyLength) {
+            keyPos = 0;
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * SSE2 XOR kernel, 16 bytes per step
  * 
- * Error Handling:
- * - Checks file accessibility
- * - Reports file operation errors
+ * @param data Buffer to transform
+ * @param length Number of bytes
+ * @param key Expanded key
+ * @param keyPos Key position of the first byte
+ */
+__attribute__((target("sse2")))
+static void xorSse2(char* data, size_t length, const ExpandedKey& key, size_t keyPos) {
+    const char* pattern = key.pattern.data();
+    size_t step = 16 % key.keyLength;
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i stream = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + keyPos));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_xor_si128(block, stream));
+        keyPos += step;
+        if (keyPos >= key.keyLength) {
+            keyPos -= key.keyLength;
+        }
+    }
+    xorScalar(data + i, length - i, key, keyPos);
+}
+
+/**
+ * AVX2 XOR kernel, 32 bytes per step
  * 
- * @param filename File to encrypt
- * @param key Encryption key
+ * @param data Buffer to transform
+ * @param length Number of bytes
+ * @param key Expanded key
+ * @param keyPos Key position of the first byte
  */
-void encryptFile(const string& filename, const string& key) {
-    ifstream tempFile("temp_accounts.txt");
-    if (!tempFile) {
-        cerr << "Error: Unable to open temp_accounts.txt for reading" << endl;
+__attribute__((target("avx2")))
+static void xorAvx2(char* data, size_t length, const ExpandedKey& key, size_t keyPos) {
+    const char* pattern = key.pattern.data();
+    size_t step = 32 % key.keyLength;
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i stream = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern + keyPos));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_xor_si256(block, stream));
+        keyPos += step;
+        if (keyPos >= key.keyLength) {
+            keyPos -= key.keyLength;
+        }
+    }
+    xorScalar(data + i, length - i, key, keyPos);
+}
+
+#endif
+
+using XorKernel = void (*)(char*, size_t, const ExpandedKey&, size_t);
+
+/**
+ * Check whether the processor can run an XOR kernel
+ * 
+ * @param type Kernel to check
+ * @return bool True if the kernel can be used
+ */
+bool xorKernelSupported(XorKernelType type) {
+    if (type == XorKernelType::SCALAR) {
+        return true;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    return type == XorKernelType::AVX2 ? __builtin_cpu_supports("avx2") != 0
+                                       : __builtin_cpu_supports("sse2") != 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Look up the function of an XOR kernel
+ * 
+ * @param type Kernel to look up
+ * @return XorKernel The kernel, the scalar one if the type has no vector build here
+ */
+static XorKernel xorKernel(XorKernelType type) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (type == XorKernelType::AVX2) {
+        return xorAvx2;
+    }
+    if (type == XorKernelType::SSE2) {
+        return xorSse2;
+    }
+#endif
+    return xorScalar;
+}
+
+/**
+ * Pick the widest XOR kernel the processor supports
+ * 
+ * @return XorKernel AVX2, SSE2 or scalar kernel
+ */
+static XorKernel selectXorKernel() {
+    for (XorKernelType type : {XorKernelType::AVX2, XorKernelType::SSE2}) {
+        if (xorKernelSupported(type)) {
+            return xorKernel(type);
+        }
+    }
+    return xorScalar;
+}
+
+/**
+ * Encrypt/Decrypt a buffer in place with a chosen XOR kernel
+ * 
+ * Used by tests to check the vector kernels against the scalar one.
+ * 
+ * @param type Kernel to use; must be supported by the processor
+ * @param data Buffer to transform
+ * @param length Number of bytes in the buffer
+ * @param key Expanded encryption key
+ * @param offset Position of the first byte within the file
+ */
+void encryptDecryptWithKernel(XorKernelType type, char* data, size_t length,
+                              const ExpandedKey& key, size_t offset) {
+    if (key.keyLength == 0 || length == 0) {
+        return;
+    }
+    xorKernel(type)(data, length, key, offset % key.keyLength);
+}
+
+/**
+ * Encrypt/Decrypt a buffer in place using XOR
+ * 
+ * The key position is derived from the byte's position in the file,
+ * so a record can be decrypted without touching the bytes before it.
+ * The work is done by the widest vector kernel the processor supports,
+ * chosen once on first use.
+ * 
+ * @param data Buffer to transform
+ * @param length Number of bytes in the buffer
+ * @param key Expanded encryption key
+ * @param offset Position of the first byte within the file
+ */
+void encryptDecryptInPlace(char* data, size_t length, const ExpandedKey& key, size_t offset) {
+    if (key.keyLength == 0 || length == 0) {
         return;
     }
-    string content((istreambuf_iterator<char>(tempFile)), istreambuf_iterator<char>());
-    tempFile.close();
+    static const XorKernel kernel = selectXorKernel();
+    kernel(data, length, key, offset % key.keyLength);
+}
 
-    string encrypted = encryptDecrypt(content, key);
+/**
+ * Encrypt/Decrypt a buffer in place using XOR
+ * 
+ * Expands the key on every call; callers that reuse a key should
+ * expand it once and use the ExpandedKey overload.
+ * 
+ * @param data Buffer to transform
+ * @param length Number of bytes in the buffer
+ * @param key Encryption key
+ * @param offset Position of the first byte within the file
+ */
+void encryptDecryptInPlace(char* data, size_t length, const string& key, size_t offset) {
+    if (key.empty() || length == 0) {
+        return;
+    }
+    encryptDecryptInPlace(data, length, expandKey(key), offset);
+}
 
-    ofstream outFile(filename, ios::binary);
-    if (!outFile) {
-        cerr << "Error: Unable to open " << filename << " for writing" << endl;
+/**
+ * Encrypt/Decrypt a large buffer on several threads
+ * 
+ * The key stream depends only on the byte position, so the buffer is
+ * cut into PARALLEL_CHUNK_SIZE slices that are processed independently.
+ * Buffers below PARALLEL_MIN_SIZE are processed on the calling thread.
+ * 
+ * @param data Buffer to transform
+ * @param length Number of bytes in the buffer
+ * @param key Expanded key
+ * @param offset Position of the first byte within the file
+ */
+void encryptDecryptParallel(char* data, size_t length, const ExpandedKey& key, size_t offset) {
+    if (length < PARALLEL_MIN_SIZE) {
+        encryptDecryptInPlace(data, length, key, offset);
         return;
     }
-    outFile.write(encrypted.c_str(), encrypted.size());
-    outFile.close();
+
+    size_t chunks = (length + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+    runInParallel(chunks, [&](size_t chunk) {
+        size_t start = chunk * PARALLEL_CHUNK_SIZE;
+        size_t bytes = min(PARALLEL_CHUNK_SIZE, length - start);
+        encryptDecryptInPlace(data + start, bytes, key, offset + start);
+    });
+}
+
+/**
+ * Read part of an open file and decrypt it in place
+ * 
+ * Process:
+ * 1. Read with pread until the buffer is full or the file ends
+ * 2. Decrypt the bytes read, using their position in the file
+ * 
+ * The caller owns the buffer and can reuse it across calls, so no
+ * intermediate copies are made.
+ * 
+ * @param fd Open file descriptor
+ * @param buffer Receives the decrypted bytes
+ * @param length Size of the buffer
+ * @param key Expanded decryption key
+ * @param offset Position in the file to read from
+ * @return ssize_t Bytes read and decrypted, 0 at end of file, -1 on a read error
+ */
+ssize_t decryptInto(int fd, char* buffer, size_t length, const ExpandedKey& key, size_t offset) {
+    size_t total = 0;
+    while (total < length) {
+        ssize_t bytes = pread(fd, buffer + total, length - total, offset + total);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (bytes == 0) {
+            break;
+        }
+        total += bytes;
+    }
+    encryptDecryptParallel(buffer, total, key, offset);
+    return total;
 }
 
 /**
- * Decrypt a file
+ * Decrypt a file in fixed-size chunks
  * 
  * Process:
- * 1. Read encrypted content
- * 2. Decrypt using key
- * 3. Return decrypted content
+ * 1. Read the next chunk into a reused buffer
+ * 2. Decrypt it using its position in the file
+ * 3. Pass it on before reading the next one
  * 
- * Error Handling:
- * - Verifies file existence
- * - Handles read errors
+ * Memory use is one chunk, independent of the file size.
  * 
  * @param filename File to decrypt
  * @param key Decryption key
- * @return string Decrypted content
+ * @param consume Called with each decrypted chunk, in file order
+ * @param chunkSize Bytes per chunk
+ * @return bool False if the file cannot be opened or read
+ */
+bool decryptFileChunks(const string& filename, const string& key,
+                       const function<void(const char*, size_t)>& consume,
+                       size_t chunkSize) {
+    return decryptFileChunks(filename, expandKey(key), consume, chunkSize);
+}
+
+/**
+ * Decrypt a file in fixed-size chunks with an already expanded key
+ * 
+ * @param filename File to decrypt
+ * @param key Expanded decryption key
+ * @param consume Called with each decrypted chunk, in file order
+ * @param chunkSize Bytes per chunk
+ * @return bool False if the file cannot be opened or read
  */
-string decryptFile(const string& filename, const string& key) {
-    ifstream inFile(filename, ios::binary);
-    if (!inFile) {
+bool decryptFileChunks(const string& filename, const ExpandedKey& key,
+                       const function<void(const char*, size_t)>& consume,
+                       size_t chunkSize) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
         cerr << "Error: Unable to open file for reading: " << filename << endl;
-        return "";
+        return false;
     }
-    string content((istreambuf_iterator<char>(inFile)), istreambuf_iterator<char>());
-    inFile.close();
 
-    return encryptDecrypt(content, key);
+    string buffer(chunkSize, '\0');
+    size_t offset = 0;
+    ssize_t bytes;
+    while ((bytes = decryptInto(fd, &buffer[0], chunkSize, key, offset)) > 0) {
+        consume(buffer.data(), bytes);
+        offset += bytes;
+    }
+    close(fd);
+    return bytes == 0;
 }
@@ -9,8 +9,10 @@
  * 
  * Features:
  * - String hashing
- * - File encryption/decryption
- * - XOR-based encryption
+ * - Buffer encryption/decryption
+ * - Streaming decryption in fixed-size chunks
+ * - XOR-based encryption with SSE2/AVX2 kernels chosen at runtime
+ * - Multi-threaded processing of large buffers
  * 
  * Note: This is a basic encryption system for demonstration.
  * Production systems should use standard crypto libraries.
@@ -20,19 +22,68 @@
 #define SIMPLE_ENCRYPTION_H
 
 #include <string>
+#include <cstddef>
+#include <functional>
+#include <sys/types.h>
 
 using namespace std;
 
 // Creates a hash of the input string for password storage
 string simpleHash(const string& input);
 
-// Encrypts/decrypts a string using XOR with a key
-string encryptDecrypt(const string& input, const string& key);
+// Widest vector the XOR kernels load at once
+const size_t XOR_BLOCK_SIZE = 32;
 
-// Encrypts a file using the provided key
-void encryptFile(const string& filename, const string& key);
+// Key prepared for the XOR kernels: the key repeated so that XOR_BLOCK_SIZE
+// bytes of key stream can be loaded from any key position
+struct ExpandedKey {
+    size_t keyLength = 0;
+    string pattern;
+};
 
-// Decrypts a file using the provided key
-string decryptFile(const string& filename, const string& key);
+// Expands a key once so that it can be reused across calls
+ExpandedKey expandKey(const string& key);
+
+// Encrypts/decrypts a buffer in place; offset is the buffer's position in the file,
+// so any slice of a file can be processed on its own
+void encryptDecryptInPlace(char* data, size_t length, const string& key, size_t offset = 0);
+void encryptDecryptInPlace(char* data, size_t length, const ExpandedKey& key, size_t offset = 0);
+
+// XOR kernels encryptDecryptInPlace chooses from, widest first
+enum class XorKernelType { AVX2, SSE2, SCALAR };
+
+// Returns true if the processor can run the given kernel
+bool xorKernelSupported(XorKernelType type);
+
+// Same as encryptDecryptInPlace, but with the given kernel instead of the widest one;
+// lets tests compare the kernels. The kernel must be supported.
+void encryptDecryptWithKernel(XorKernelType type, char* data, size_t length,
+                              const ExpandedKey& key, size_t offset = 0);
+
+// Slice of a buffer handed to one thread by encryptDecryptParallel; sized to stay in cache
+const size_t PARALLEL_CHUNK_SIZE = 256 * 1024;
+
+// Buffers smaller than this are not worth starting threads for
+const size_t PARALLEL_MIN_SIZE = 4 * 1024 * 1024;
+
+// Same as encryptDecryptInPlace, but large buffers are split into chunks
+// that are processed on several threads
+void encryptDecryptParallel(char* data, size_t length, const ExpandedKey& key, size_t offset = 0);
+
+// Reads up to length bytes of an open file, starting at offset, into the caller's
+// buffer and decrypts them there; returns the bytes read, 0 at end of file or -1 on error
+ssize_t decryptInto(int fd, char* buffer, size_t length, const ExpandedKey& key, size_t offset = 0);
+
+// Size of the chunks read by decryptFileChunks
+const size_t DECRYPT_CHUNK_SIZE = 64 * 1024;
+
+// Decrypts a file chunk by chunk and hands each decrypted chunk to consume
+// Only one chunk is held in memory; returns false if the file cannot be read
+bool decryptFileChunks(const string& filename, const string& key,
+                       const function<void(const char*, size_t)>& consume,
+                       size_t chunkSize = DECRYPT_CHUNK_SIZE);
+bool decryptFileChunks(const string& filename, const ExpandedKey& key,
+                       const function<void(const char*, size_t)>& consume,
+                       size_t chunkSize = DECRYPT_CHUNK_SIZE);
 
 #endif // SIMPLE_ENCRYPTION_H
@@ -0,0 +1,174 @@
+/**
+ * Commit Conflict and Retry Test
+ *
+ * Checks that commitBalanceChange re-applies a change to the current
+ * state of an account when another writer changed it first:
+ * - A deposit that conflicts is applied again on the new balance and
+ *   committed, so neither change is lost
+ * - A withdrawal that no longer fits the new balance is refused on the
+ *   retry, and nothing is written
+ * - A change that keeps conflicting gives up with CONFLICT
+ *
+ * The competing writer changes the account through the store from
+ * inside the change, between the read and the write of an attempt.
+ *
+ * Build and run from the repository root:
+ *   g++ -std=c++17 -I. tests/commitRetryTest.cpp $(ls *.cpp | grep -v main.cpp) -o commitRetryTest -pthread
+ *   ./commitRetryTest
+ */
+
+#include "accountDatabase.h"
+#include "accountStore.h"
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * Report a failed check
+ *
+ * @param ok Outcome of the check
+ * @param what Description of the check
+ * @return bool The outcome
+ */
+static bool check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAILED: " << what << endl;
+    }
+    return ok;
+}
+
+/**
+ * Change the balance of an account behind the caller's back
+ *
+ * @param accountNumber Account to change
+ * @param balance New balance in dollars
+ * @return bool True if the change was written
+ */
+static bool competingUpdate(int accountNumber, double balance) {
+    AccountStore& store = AccountStore::instance();
+    optional<AccountRecord> current = store.findAccount(accountNumber);
+    return current && store.updateBalances({{accountNumber, current->lsn, toCents(balance)}}) ==
+                      UpdateResult::UPDATED;
+}
+
+/**
+ * Read the stored balance of an account
+ *
+ * @param accountNumber Account to read
+ * @return double Balance in dollars, -1 if the account does not exist
+ */
+static double storedBalance(int accountNumber) {
+    optional<AccountRecord> record = AccountStore::instance().findAccount(accountNumber);
+    return record ? fromCents(record->balanceCents) : -1;
+}
+
+/**
+ * A conflicting deposit is applied again and committed
+ *
+ * 1. Account 3000 is read at 100.00
+ * 2. While the deposit of 50.00 is first applied, another writer sets
+ *    the balance to 200.00
+ * 3. The commit must retry on 200.00 and write 250.00
+ *
+ * @return bool True if every check passed
+ */
+static bool depositRetried() {
+    vector<unique_ptr<bankAccountType>> accounts = findAccountsInDatabase({3000});
+    if (!check(accounts.size() == 1, "account 3000 is read")) {
+        return false;
+    }
+    int calls = 0;
+    CommitStatus status = commitBalanceChange(accounts, [&](vector<unique_ptr<bankAccountType>>& current) {
+        if (calls++ == 0 && !competingUpdate(3000, 200.00)) {
+            return false;
+        }
+        current[0]->deposit(50.00);
+        return true;
+    });
+    return check(status == CommitStatus::COMMITTED, "deposit is committed after a conflict") &&
+           check(calls == 2, "deposit is applied a second time") &&
+           check(storedBalance(3000) == 250.00, "deposit is added to the competing balance") &&
+           check(accounts[0]->getBalance() == 250.00, "caller holds the committed state");
+}
+
+/**
+ * A withdrawal the new balance cannot cover is refused on the retry
+ *
+ * 1. Account 3001 is read at 300.00
+ * 2. While the withdrawal of 250.00 is first applied, another writer
+ *    sets the balance to 100.00
+ * 3. The retry must refuse, and the balance must stay 100.00
+ *
+ * @return bool True if every check passed
+ */
+static bool withdrawalRefused() {
+    vector<unique_ptr<bankAccountType>> accounts = findAccountsInDatabase({3001});
+    if (!check(accounts.size() == 1, "account 3001 is read")) {
+        return false;
+    }
+    int calls = 0;
+    CommitStatus status = commitBalanceChange(accounts, [&](vector<unique_ptr<bankAccountType>>& current) {
+        if (calls++ == 0 && !competingUpdate(3001, 100.00)) {
+            return false;
+        }
+        if (current[0]->getBalance() < 250.00) {
+            return false;
+        }
+        current[0]->withdraw(250.00);
+        return true;
+    });
+    return check(status == CommitStatus::REJECTED, "withdrawal is refused on the new balance") &&
+           check(calls == 2, "withdrawal is checked a second time") &&
+           check(storedBalance(3001) == 100.00, "refused withdrawal writes nothing");
+}
+
+/**
+ * A change that always loses the race gives up
+ *
+ * 1. Account 3002 is read
+ * 2. Every time the deposit is applied, another writer changes the
+ *    balance first
+ * 3. The commit must end with CONFLICT after more than one attempt,
+ *    leaving the last competing balance
+ *
+ * @return bool True if every check passed
+ */
+static bool persistentConflict() {
+    vector<unique_ptr<bankAccountType>> accounts = findAccountsInDatabase({3002});
+    if (!check(accounts.size() == 1, "account 3002 is read")) {
+        return false;
+    }
+    int calls = 0;
+    CommitStatus status = commitBalanceChange(accounts, [&](vector<unique_ptr<bankAccountType>>& current) {
+        calls++;
+        if (!competingUpdate(3002, 1000.00 + calls)) {
+            return false;
+        }
+        current[0]->deposit(1.00);
+        return true;
+    });
+    return check(status == CommitStatus::CONFLICT, "endless conflicts give up") &&
+           check(calls > 1, "conflicting change is retried") &&
+           check(storedBalance(3002) == 1000.00 + calls, "only the competing balances are written");
+}
+
+int main() {
+    char directory[] = "/tmp/commitRetryTestXXXXXX";
+    if (!mkdtemp(directory) || chdir(directory) != 0) {
+        cerr << "Unable to create a working directory" << endl;
+        return 1;
+    }
+    AccountStore& store = AccountStore::instance();
+    bool ok = check(store.insert({3000, "Deposit", AccountTypeTag::SAVINGS, toCents(100.00)}) &&
+                    store.insert({3001, "Withdrawal", AccountTypeTag::CHECKING, toCents(300.00)}) &&
+                    store.insert({3002, "Contended", AccountTypeTag::SAVINGS, toCents(10.00)}),
+                    "accounts created");
+    ok = ok && depositRetried();
+    ok = ok && withdrawalRefused();
+    ok = ok && persistentConflict();
+
+    cout << (ok ? "commitRetryTest passed" : "commitRetryTest failed") << endl;
+    return ok ? 0 : 1;
+}
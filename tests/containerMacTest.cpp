@@ -0,0 +1,184 @@
+/**
+ * Block Container MAC Test
+ *
+ * Checks that a container block is only accepted with the MAC it was
+ * written with:
+ * - Intact blocks decode to the original stream
+ * - A flipped payload bit and a changed payload length, block index
+ *   or MAC each fail only the block they are in
+ * - A block read at another index or with another key fails
+ * - A block changed through updateContainerRange gets a valid MAC, and
+ *   a flipped bit in its ciphertext afterwards is caught again
+ *
+ * Build and run from the repository root:
+ *   g++ -std=c++17 -I. tests/containerMacTest.cpp $(ls *.cpp | grep -v main.cpp) -o containerMacTest -pthread
+ *   ./containerMacTest
+ */
+
+#include "blockContainer.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * Report a failed check
+ *
+ * @param ok Outcome of the check
+ * @param what Description of the check
+ * @return bool The outcome
+ */
+static bool check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAILED: " << what << endl;
+    }
+    return ok;
+}
+
+/**
+ * Build a stream that fills two blocks and part of a third
+ *
+ * @return string Stream contents
+ */
+static string sampleStream() {
+    string plain(2 * CONTAINER_PAYLOAD_SIZE + 100, '\0');
+    for (size_t i = 0; i < plain.size(); i++) {
+        plain[i] = static_cast<char>(i * 7 + i / 251);
+    }
+    return plain;
+}
+
+/**
+ * Decode one block of a container
+ *
+ * @param container Container bytes
+ * @param blockIndex Block to decode
+ * @param key Container key
+ * @return bool True if the block authenticated
+ */
+static bool blockValid(const string& container, size_t blockIndex, const ContainerKey& key) {
+    char payload[CONTAINER_PAYLOAD_SIZE];
+    size_t length;
+    return decodeContainerBlock(container.data() + blockIndex * CONTAINER_BLOCK_SIZE, blockIndex,
+                                key, payload, length);
+}
+
+/**
+ * Damage to one block fails that block and no other
+ *
+ * 1. A stream is encoded into three blocks, which must all decode
+ *    back to the stream
+ * 2. A copy with one bit of the middle block's payload flipped must
+ *    fail the middle block only
+ * 3. The same for a changed payload length, block index and MAC in
+ *    the middle block's header
+ *
+ * @return bool True if every check passed
+ */
+static bool damagedBlock() {
+    ContainerKey key = makeContainerKey("container test key");
+    string plain = sampleStream();
+    string container = encodeContainer(plain, key);
+
+    string decoded(3 * CONTAINER_PAYLOAD_SIZE, '\0');
+    bool ok = check(container.size() == 3 * CONTAINER_BLOCK_SIZE, "stream fills three blocks") &&
+              check(decodeContainerBlocks(container.data(), 0, 3, key, &decoded[0]) == 0,
+                    "intact blocks authenticate") &&
+              check(decoded.compare(0, plain.size(), plain) == 0, "intact blocks decode to the stream");
+
+    // Header layout: magic (4), payload length (4), block index (8), MAC (8)
+    const struct { size_t position; const char* what; } damage[] = {
+        {CONTAINER_HEADER_SIZE + 1000, "flipped payload bit"},
+        {4, "changed payload length"},
+        {8, "changed block index"},
+        {16, "changed MAC"},
+    };
+    for (const auto& d : damage) {
+        string copy = container;
+        copy[CONTAINER_BLOCK_SIZE + d.position] ^= 0x04;
+        ok = check(!blockValid(copy, 1, key), d.what + string(" fails its block")) &&
+             check(blockValid(copy, 0, key) && blockValid(copy, 2, key),
+                   d.what + string(" leaves the other blocks valid")) &&
+             check(decodeContainerBlocks(copy.data(), 0, 3, key, &decoded[0]) == 1,
+                   d.what + string(" is counted once")) && ok;
+    }
+    return ok;
+}
+
+/**
+ * A block is bound to its position and key
+ *
+ * 1. The first block of a container is decoded as if it were the
+ *    second, which must fail
+ * 2. It is decoded with a key derived from another string, which must
+ *    fail
+ *
+ * @return bool True if every check passed
+ */
+static bool movedBlock() {
+    ContainerKey key = makeContainerKey("container test key");
+    string container = encodeContainer(sampleStream(), key);
+    char payload[CONTAINER_PAYLOAD_SIZE];
+    size_t length;
+    return check(!decodeContainerBlock(container.data(), 1, key, payload, length),
+                 "block read at another index fails") &&
+           check(!blockValid(container, 0, makeContainerKey("another key")),
+                 "block read with another key fails");
+}
+
+/**
+ * An in-place update rewrites the MAC of its block
+ *
+ * 1. A container is written to a file
+ * 2. updateContainerRange changes 32 bytes in the second block
+ * 3. The block must authenticate and hold the change
+ * 4. A flipped bit in the changed ciphertext must fail the block again
+ *
+ * @return bool True if every check passed
+ */
+static bool updatedBlock() {
+    ContainerKey key = makeContainerKey("container test key");
+    string plain = sampleStream();
+    string container = encodeContainer(plain, key);
+
+    char path[] = "/tmp/containerMacTestXXXXXX";
+    int fd = mkstemp(path);
+    if (!check(fd >= 0 && write(fd, container.data(), container.size()) ==
+                              static_cast<ssize_t>(container.size()), "container file written")) {
+        return false;
+    }
+
+    size_t offset = CONTAINER_PAYLOAD_SIZE + 64;
+    ContainerUpdate result = updateContainerRange(fd, offset, 32, key, [](char* range) {
+        fill(range, range + 32, 'U');
+        return true;
+    });
+    string updated(container.size(), '\0');
+    bool readBack = pread(fd, &updated[0], updated.size(), 0) == static_cast<ssize_t>(updated.size());
+    close(fd);
+    unlink(path);
+
+    char payload[CONTAINER_PAYLOAD_SIZE];
+    size_t length;
+    bool ok = check(result == ContainerUpdate::WRITTEN && readBack, "range updated in place") &&
+              check(decodeContainerBlock(updated.data() + CONTAINER_BLOCK_SIZE, 1, key, payload, length),
+                    "updated block authenticates") &&
+              check(string(payload + 64, 32) == string(32, 'U'), "updated block holds the change") &&
+              check(string(payload, 64) == plain.substr(CONTAINER_PAYLOAD_SIZE, 64),
+                    "rest of the updated block is unchanged");
+
+    updated[CONTAINER_BLOCK_SIZE + CONTAINER_HEADER_SIZE + 64] ^= 0x01;
+    return check(!blockValid(updated, 1, key), "damage after an update fails the block") && ok;
+}
+
+int main() {
+    bool ok = damagedBlock();
+    ok = movedBlock() && ok;
+    ok = updatedBlock() && ok;
+
+    cout << (ok ? "containerMacTest passed" : "containerMacTest failed") << endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+/**
+ * CRC-32C Kernel Test
+ *
+ * Checks that the SSE4.2 and table-driven CRC-32C kernels agree with a
+ * bit-at-a-time reference:
+ * - The standard check value of "123456789"
+ * - Every length from 0 to a few 8-byte steps, from unaligned start
+ *   addresses, so the 8-, 4- and 1-byte tails are covered
+ * - Checksums extended piece by piece equal the checksum of the whole
+ *
+ * Kernels the processor does not support are reported and skipped.
+ *
+ * Build and run from the repository root:
+ *   g++ -std=c++17 -I. tests/crc32cTest.cpp $(ls *.cpp | grep -v main.cpp) -o crc32cTest -pthread
+ *   ./crc32cTest
+ */
+
+#include "crc32c.h"
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+/**
+ * Report a failed check
+ *
+ * @param ok Outcome of the check
+ * @param what Description of the check
+ * @return bool The outcome
+ */
+static bool check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAILED: " << what << endl;
+    }
+    return ok;
+}
+
+/**
+ * Bit-at-a-time CRC-32C, the reference the kernels are checked against
+ *
+ * @param data Buffer to checksum
+ * @param length Number of bytes
+ * @return uint32_t Checksum of the buffer
+ */
+static uint32_t referenceCrc32c(const char* data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= static_cast<unsigned char>(data[i]);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78 : 0);
+        }
+    }
+    return ~crc;
+}
+
+/**
+ * Check one kernel against the reference
+ *
+ * 1. "123456789" must give the standard check value 0xE3069283
+ * 2. Every length and start misalignment must match the reference
+ * 3. Every split of a buffer into two pieces, the second extending the
+ *    checksum of the first, must match the checksum of the whole
+ *
+ * @param type Kernel to test
+ * @param name Name of the kernel in reports
+ * @return bool True if every check passed
+ */
+static bool matchesReference(Crc32cKernelType type, const string& name) {
+    if (!crc32cKernelSupported(type)) {
+        cout << name << " is not supported here, skipped" << endl;
+        return true;
+    }
+
+    bool ok = check(crc32cWithKernel(type, "123456789", 9) == 0xE3069283, name + " check value");
+
+    string input(80, '\0');
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = static_cast<char>(i * 151 + 3);
+    }
+    for (size_t misalign = 0; ok && misalign < 8; misalign++) {
+        for (size_t length = 0; ok && misalign + length <= input.size(); length++) {
+            const char* data = input.data() + misalign;
+            uint32_t expected = referenceCrc32c(data, length);
+            string where = name + " on " + to_string(length) + " bytes misaligned by " + to_string(misalign);
+            ok = check(crc32cWithKernel(type, data, length) == expected, where);
+            for (size_t split = 0; ok && split <= length; split++) {
+                uint32_t head = crc32cWithKernel(type, data, split);
+                ok = check(crc32cWithKernel(type, data + split, length - split, head) == expected,
+                           where + " extended after " + to_string(split));
+            }
+        }
+    }
+    return ok;
+}
+
+int main() {
+    bool ok = matchesReference(Crc32cKernelType::TABLE, "table");
+    ok = matchesReference(Crc32cKernelType::SSE42, "SSE4.2") && ok;
+    string text = "The quick brown fox jumps over the lazy dog";
+    ok = check(crc32c(text.data(), text.size()) == referenceCrc32c(text.data(), text.size()),
+               "crc32c uses a matching kernel") && ok;
+
+    cout << (ok ? "crc32cTest passed" : "crc32cTest failed") << endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+/**
+ * In-Place Balance Update Test
+ *
+ * Checks that balance changes to accounts already in accounts.dat are
+ * written straight into their records, and that the lsn compare-and-swap
+ * still guards them:
+ * - An update to a checkpointed account does not grow accounts.wal
+ * - An update computed from a stale lsn is refused with CONFLICT and
+ *   leaves the balance alone
+ * - A new session sees the written balance and its lsn
+ *
+ * Every step runs in its own process, so each one starts from the files
+ * on disk like a restarted program.
+ *
+ * Build and run from the repository root:
+ *   g++ -std=c++17 -I. tests/inPlaceUpdateTest.cpp $(ls *.cpp | grep -v main.cpp) -o inPlaceUpdateTest -pthread
+ *   ./inPlaceUpdateTest
+ */
+
+#include "accountStore.h"
+#include <iostream>
+#include <functional>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+ * Run a step in a child process, like a separate session
+ *
+ * @param step Returns false if the step failed
+ * @return bool True if the child exited successfully
+ */
+static bool inNewSession(const function<bool()>& step) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(step() ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Report a failed check
+ *
+ * @param ok Outcome of the check
+ * @param what Description of the check
+ * @return bool The outcome
+ */
+static bool check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAILED: " << what << endl;
+    }
+    return ok;
+}
+
+/**
+ * Get the size of the live log
+ *
+ * @return off_t Size in bytes, 0 if it does not exist
+ */
+static off_t logSize() {
+    struct stat st;
+    return stat("accounts.wal", &st) == 0 ? st.st_size : 0;
+}
+
+/**
+ * Update checkpointed balances in place, then try a stale update
+ *
+ * 1. A session creates two accounts and checkpoints them into accounts.dat
+ * 2. A new session moves money between them with updateBalances; the
+ *    log must not grow
+ * 3. The same session retries the change with the lsns it started from,
+ *    which must conflict
+ * 4. A third session must see the new balances, and only their new
+ *    lsns may update them
+ *
+ * @return bool True if every check passed
+ */
+static bool inPlaceUpdate() {
+    bool ok = inNewSession([] {
+        AccountStore& store = AccountStore::instance();
+        bool created = store.insert({2000, "First", AccountTypeTag::SAVINGS, 10000}) &&
+                       store.insert({2001, "Second", AccountTypeTag::CHECKING, 5000});
+        store.checkpoint();
+        return check(created, "accounts created");
+    });
+
+    off_t before = logSize();
+    ok = ok && inNewSession([] {
+        AccountStore& store = AccountStore::instance();
+        optional<AccountRecord> first = store.findAccount(2000);
+        optional<AccountRecord> second = store.findAccount(2001);
+        if (!check(first && second, "checkpointed accounts are loaded")) {
+            return false;
+        }
+        vector<BalanceUpdate> transfer{{2000, first->lsn, 7500}, {2001, second->lsn, 7500}};
+        if (!check(store.updateBalances(transfer) == UpdateResult::UPDATED, "in-place update")) {
+            return false;
+        }
+        optional<AccountRecord> changed = store.findAccount(2000);
+        return check(changed && changed->balanceCents == 7500 && changed->lsn > first->lsn,
+                     "update gives the account a new lsn") &&
+               check(store.updateBalances(transfer) == UpdateResult::CONFLICT,
+                     "update from a stale lsn conflicts") &&
+               check(store.findAccount(2000)->balanceCents == 7500,
+                     "conflicting update leaves the balance alone");
+    });
+    ok = ok && check(logSize() == before, "in-place update did not grow the log");
+
+    return ok && inNewSession([] {
+        AccountStore& store = AccountStore::instance();
+        optional<AccountRecord> first = store.findAccount(2000);
+        optional<AccountRecord> second = store.findAccount(2001);
+        return check(first && first->balanceCents == 7500 && second && second->balanceCents == 7500,
+                     "in-place balances survive a restart") &&
+               check(store.updateBalances({{2001, second->lsn - 1, 0}}) == UpdateResult::CONFLICT,
+                     "lsn written in place is the account's version after a restart") &&
+               check(store.updateBalances({{2000, first->lsn, 8000}}) == UpdateResult::UPDATED,
+                     "update from the current lsn after a restart");
+    });
+}
+
+int main() {
+    char directory[] = "/tmp/inPlaceUpdateTestXXXXXX";
+    if (!mkdtemp(directory) || chdir(directory) != 0) {
+        cerr << "Unable to create a working directory" << endl;
+        return 1;
+    }
+    bool ok = inPlaceUpdate();
+
+    cout << (ok ? "inPlaceUpdateTest passed" : "inPlaceUpdateTest failed") << endl;
+    return ok ? 0 : 1;
+}
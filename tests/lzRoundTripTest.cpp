@@ -0,0 +1,202 @@
+/**
+ * LZ Round-Trip Test
+ *
+ * Checks that compressed frames decode to the bytes they were made from,
+ * and that damage costs no more than the damaged frame:
+ * - Empty, short, repetitive, incompressible and multi-frame inputs
+ *   round-trip, fed to the reader whole, byte by byte and in odd pieces
+ * - The streaming writer produces a stream the reader decodes
+ * - A frame whose body is damaged fails its checksum and is skipped,
+ *   and the frames around it still decode
+ * - A damaged frame header or a stream cut inside a frame is reported
+ *
+ * Build and run from the repository root:
+ *   g++ -std=c++17 -I. tests/lzRoundTripTest.cpp $(ls *.cpp | grep -v main.cpp) -o lzRoundTripTest -pthread
+ *   ./lzRoundTripTest
+ */
+
+#include "lzCompressor.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * Report a failed check
+ *
+ * @param ok Outcome of the check
+ * @param what Description of the check
+ * @return bool The outcome
+ */
+static bool check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAILED: " << what << endl;
+    }
+    return ok;
+}
+
+/**
+ * Decode a stream of frames, fed in pieces of a given size
+ *
+ * @param stream Compressed stream
+ * @param pieceSize Bytes per feed call
+ * @param out Receives the decoded bytes; skipped frames become '?' bytes
+ * @param skipped Receives the number of frames that failed their checksum
+ * @return bool True if every header was intact and the stream ended on a frame boundary
+ */
+static bool decode(const string& stream, size_t pieceSize, string& out, size_t& skipped) {
+    out.clear();
+    LzStreamReader reader([&](const char* data, size_t length) { out.append(data, length); },
+                          [&](size_t length) { out.append(length, '?'); });
+    bool ok = true;
+    for (size_t i = 0; ok && i < stream.size(); i += pieceSize) {
+        ok = reader.feed(stream.data() + i, min(pieceSize, stream.size() - i));
+    }
+    skipped = reader.skippedFrames;
+    return ok && reader.finish();
+}
+
+// Input for a round trip
+struct Sample {
+    string data;
+    bool compressible;          // Long and repetitive enough to shrink by half
+};
+
+/**
+ * Build text that fills three frames and part of a fourth
+ *
+ * @return string CSV-like account lines
+ */
+static string sampleText() {
+    string text;
+    for (int i = 0; text.size() < 3 * LZ_BLOCK_SIZE + 1234; i++) {
+        text += to_string(1000 + i % 500) + ",Account Holder " + to_string(i % 37) + ",Savings,125.50\n";
+    }
+    return text;
+}
+
+/**
+ * Build the inputs for the round trips
+ *
+ * @return vector<Sample> Inputs of several shapes and sizes
+ */
+static vector<Sample> sampleInputs() {
+    string noise(LZ_BLOCK_SIZE + 99, '\0');
+    uint32_t state = 12345;
+    for (char& c : noise) {
+        state = state * 1103515245 + 12345;
+        c = static_cast<char>(state >> 24);
+    }
+    return {{string(), false}, {string("a"), false}, {string("abcabcabcabcabcabcab"), false},
+            {string(5000, 'x'), true}, {sampleText(), true}, {noise, false}};
+}
+
+/**
+ * Every input survives compression and decompression
+ *
+ * 1. Each input is compressed with compressFrames and with the
+ *    streaming writer fed in uneven pieces
+ * 2. Both streams are decoded whole, in 1000-byte pieces and, when
+ *    short, byte by byte; each must equal the input with no frame skipped
+ * 3. Repetitive input must come out smaller than it went in
+ *
+ * @return bool True if every check passed
+ */
+static bool roundTrip() {
+    bool ok = true;
+    for (const Sample& sample : sampleInputs()) {
+        const string& input = sample.data;
+        string name = "input of " + to_string(input.size()) + " bytes";
+        string framed = compressFrames(input.data(), input.size());
+
+        string streamed;
+        LzStreamWriter writer([&](const char* data, size_t length) { streamed.append(data, length); });
+        for (size_t i = 0; i < input.size(); i += 777) {
+            writer.write(input.data() + i, min<size_t>(777, input.size() - i));
+        }
+        writer.finish();
+
+        for (const string* stream : {&framed, &streamed}) {
+            for (size_t pieceSize : {max<size_t>(stream->size(), 1), size_t(1), size_t(1000)}) {
+                if (pieceSize == 1 && stream->size() > 20000) {
+                    continue;
+                }
+                string out;
+                size_t skipped = 0;
+                ok = check(decode(*stream, pieceSize, out, skipped) && skipped == 0 && out == input,
+                           name + " round-trips in pieces of " + to_string(pieceSize)) && ok;
+            }
+        }
+        if (sample.compressible) {
+            ok = check(framed.size() < input.size() / 2, name + " is compressed") && ok;
+        }
+    }
+    return ok;
+}
+
+/**
+ * A damaged frame body is skipped without losing its neighbours
+ *
+ * 1. Text filling three frames and part of a fourth is compressed
+ * 2. One byte in the body of the second frame is changed
+ * 3. Decoding must skip exactly that frame, give LZ_BLOCK_SIZE
+ *    placeholder bytes for it, and decode the other frames intact
+ *
+ * @return bool True if every check passed
+ */
+static bool corruptFrame() {
+    string input = sampleText();
+    string stream = compressFrames(input.data(), input.size());
+
+    uint32_t firstStored;
+    memcpy(&firstStored, stream.data() + 8, 4);
+    size_t second = LZ_FRAME_HEADER_SIZE + firstStored;
+    stream[second + LZ_FRAME_HEADER_SIZE + 50] ^= 0x20;
+
+    string expected = input;
+    expected.replace(LZ_BLOCK_SIZE, LZ_BLOCK_SIZE, string(LZ_BLOCK_SIZE, '?'));
+    string out;
+    size_t skipped = 0;
+    return check(decode(stream, 4096, out, skipped), "stream with a damaged body is read to the end") &&
+           check(skipped == 1, "one frame is skipped") &&
+           check(out == expected, "frames around the damaged one decode intact");
+}
+
+/**
+ * A damaged header or a truncated stream is reported
+ *
+ * 1. The magic number of the second frame is changed; feeding the
+ *    stream must fail
+ * 2. The stream is cut in the middle of its last frame; finishing
+ *    must fail
+ *
+ * @return bool True if every check passed
+ */
+static bool damagedHeader() {
+    string input = sampleText();
+    string stream = compressFrames(input.data(), input.size());
+
+    uint32_t firstStored;
+    memcpy(&firstStored, stream.data() + 8, 4);
+    string badMagic = stream;
+    badMagic[LZ_FRAME_HEADER_SIZE + firstStored] ^= 0x01;
+
+    string out;
+    size_t skipped = 0;
+    return check(!decode(badMagic, 4096, out, skipped), "damaged frame header is reported") &&
+           check(!decode(stream.substr(0, stream.size() - 10), 4096, out, skipped),
+                 "stream cut inside a frame is reported");
+}
+
+int main() {
+    bool ok = roundTrip();
+    ok = corruptFrame() && ok;
+    ok = damagedHeader() && ok;
+
+    cout << (ok ? "lzRoundTripTest passed" : "lzRoundTripTest failed") << endl;
+    return ok ? 0 : 1;
+}
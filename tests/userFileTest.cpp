@@ -0,0 +1,156 @@
+/**
+ * User File Slot Test
+ *
+ * Checks the in-place changes to users.dat:
+ * - Updating a user rewrites only that user's slot; the other users,
+ *   their order and the file size stay the same
+ * - An update is refused when the slot no longer holds the expected user
+ * - Appending users fills new slots, across a block boundary, and keeps
+ *   the users already there
+ * - Every change raises the generation in the header
+ *
+ * Build and run from the repository root:
+ *   g++ -std=c++17 -I. tests/userFileTest.cpp $(ls *.cpp | grep -v main.cpp) -o userFileTest -pthread
+ *   ./userFileTest
+ */
+
+#include "userFile.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+ * Report a failed check
+ *
+ * @param ok Outcome of the check
+ * @param what Description of the check
+ * @return bool The outcome
+ */
+static bool check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAILED: " << what << endl;
+    }
+    return ok;
+}
+
+/**
+ * Compare two users field by field
+ *
+ * @param a First user
+ * @param b Second user
+ * @return bool True if they are equal
+ */
+static bool sameUser(const User& a, const User& b) {
+    return a.username == b.username && a.passwordHash == b.passwordHash &&
+           a.role == b.role && a.accountNumbers == b.accountNumbers;
+}
+
+/**
+ * Read the user file and compare it with the expected users
+ *
+ * @param filename User file
+ * @param keys Key material
+ * @param expected Users in slot order
+ * @param contents Receives what was read
+ * @param what Description of the check
+ * @return bool True if the file holds exactly the expected users
+ */
+static bool holds(const string& filename, const KeyContext& keys, const vector<User>& expected,
+                  UserFileContents& contents, const string& what) {
+    contents = UserFileContents();
+    if (!check(readUserFile(filename, keys, contents) == UserFileStatus::OK, what + ": file is read") ||
+        !check(contents.users.size() == expected.size(), what + ": user count")) {
+        return false;
+    }
+    for (size_t i = 0; i < expected.size(); i++) {
+        if (!check(sameUser(contents.users[i], expected[i]), what + ": user " + to_string(i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Get the size of a file
+ *
+ * @param filename File to check
+ * @return off_t Size in bytes, 0 if it does not exist
+ */
+static off_t fileSize(const string& filename) {
+    struct stat st;
+    return stat(filename.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+/**
+ * Update one slot, then append until a second block is needed
+ *
+ * 1. A file with a manager and two clients is written
+ * 2. The second client's hash and accounts are changed in place; the
+ *    file must hold the change, keep the others and not grow
+ * 3. An update naming a user the slot does not hold must be refused
+ * 4. Clients are appended until the slots spill into a new block; after
+ *    every append the file must hold all users in order
+ * 5. The generation must have risen with every change
+ *
+ * @return bool True if every check passed
+ */
+static bool slotUpdateAndAppend() {
+    char directory[] = "/tmp/userFileTestXXXXXX";
+    if (!mkdtemp(directory)) {
+        cerr << "Unable to create a working directory" << endl;
+        return false;
+    }
+    string filename = string(directory) + "/users.dat";
+    const KeyContext& keys = keyContextFor("user file test key");
+
+    vector<User> users{
+        {"admin", "hash-admin", UserRole::MANAGER, {}},
+        {"alice", "hash-alice", UserRole::CLIENT, {1000, 1001}},
+        {"bob", "hash-bob", UserRole::CLIENT, {1002}},
+    };
+    UserFileContents contents;
+    bool ok = check(writeUserFile(filename, keys, users, 5), "user file written") &&
+              holds(filename, keys, users, contents, "after writing");
+    if (!ok) {
+        return false;
+    }
+    uint32_t generation = contents.generation;
+    off_t size = fileSize(filename);
+
+    size_t bobSlot = contents.positions[2];
+    User changedBob{"bob", "new-hash-bob", UserRole::CLIENT, {1002, 1003, 1004}};
+    ok = check(updateUserInFile(filename, keys, bobSlot, "bob", changedBob), "slot updated in place");
+    users[2] = changedBob;
+    ok = ok && holds(filename, keys, users, contents, "after the update") &&
+         check(contents.generation > generation, "update raises the generation") &&
+         check(fileSize(filename) == size, "update does not grow the file");
+    generation = contents.generation;
+
+    User intruder{"mallory", "hash-mallory", UserRole::MANAGER, {}};
+    ok = ok && check(!updateUserInFile(filename, keys, bobSlot, "alice", intruder),
+                     "update of a slot holding another user is refused") &&
+         holds(filename, keys, users, contents, "after the refused update") &&
+         check(contents.generation == generation, "refused update keeps the generation");
+
+    for (int i = 0; ok && i < 10; i++) {
+        User client{"client" + to_string(i), "hash-" + to_string(i), UserRole::CLIENT, {2000 + i}};
+        ok = check(appendUserToFile(filename, keys, client), "append of " + client.username);
+        users.push_back(client);
+        ok = ok && holds(filename, keys, users, contents, "after appending " + client.username) &&
+             check(contents.generation > generation, "append raises the generation");
+        generation = contents.generation;
+    }
+    return ok && check(fileSize(filename) > size, "appends spilled into a new block");
+}
+
+int main() {
+    bool ok = slotUpdateAndAppend();
+
+    cout << (ok ? "userFileTest passed" : "userFileTest failed") << endl;
+    return ok ? 0 : 1;
+}
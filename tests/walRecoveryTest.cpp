@@ -0,0 +1,210 @@
+/**
+ * Write-Ahead Log Recovery Test
+ *
+ * Checks that damage to accounts.wal costs no more than the damaged
+ * records:
+ * - A torn tail, as left by an interrupted append, is cut off and does
+ *   not swallow the records appended after it
+ * - A damaged record in the middle of the log is skipped, and the
+ *   committed records after it survive a restart
+ * - A damaged end longer than one record is not cut off, and nothing
+ *   is appended after it
+ *
+ * Every step runs in its own process, so each one starts from the files
+ * on disk like a restarted program.
+ *
+ * Build and run from the repository root:
+ *   g++ -std=c++17 -I. tests/walRecoveryTest.cpp $(ls *.cpp | grep -v main.cpp) -o walRecoveryTest -pthread
+ *   ./walRecoveryTest
+ */
+
+#include "accountStore.h"
+#include "writeAheadLog.h"
+#include <iostream>
+#include <fstream>
+#include <functional>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+ * Run a step in a child process, like a separate session
+ *
+ * @param step Returns false if the step failed
+ * @return bool True if the child exited successfully
+ */
+static bool inNewSession(const function<bool()>& step) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(step() ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Report a failed check
+ *
+ * @param ok Outcome of the check
+ * @param what Description of the check
+ * @return bool The outcome
+ */
+static bool check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAILED: " << what << endl;
+    }
+    return ok;
+}
+
+/**
+ * Move into a fresh, empty working directory
+ *
+ * @return bool False if the directory could not be created
+ */
+static bool enterNewDirectory() {
+    char directory[] = "/tmp/walRecoveryTestXXXXXX";
+    if (!mkdtemp(directory) || chdir(directory) != 0) {
+        cerr << "Unable to create a working directory" << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Get the size of the live log
+ *
+ * @return off_t Size in bytes, 0 if it does not exist
+ */
+static off_t logSize() {
+    struct stat st;
+    return stat("accounts.wal", &st) == 0 ? st.st_size : 0;
+}
+
+/**
+ * Create an account in a session of its own
+ *
+ * @param accountNumber Account to create
+ * @return bool True if the account was created
+ */
+static bool insertInNewSession(int accountNumber) {
+    return inNewSession([accountNumber] {
+        AccountRecord record{accountNumber, "Holder", AccountTypeTag::SAVINGS, 10000};
+        return check(AccountStore::instance().insert(record),
+                     "insert of " + to_string(accountNumber));
+    });
+}
+
+/**
+ * A torn tail is cut off before the next append
+ *
+ * 1. A session creates an account
+ * 2. Garbage is appended to the log, as left by an interrupted append
+ * 3. A new session creates a second account and updates the first
+ * 4. A third session must see both accounts and the update, and the
+ *    garbage must be gone from the log
+ *
+ * @return bool True if every check passed
+ */
+static bool tornTail() {
+    bool ok = insertInNewSession(1000);
+
+    off_t before = logSize();
+    ofstream("accounts.wal", ios::binary | ios::app) << string(50, '\x5a');
+
+    ok = ok && inNewSession([] {
+        AccountStore& store = AccountStore::instance();
+        AccountRecord second{1001, "Second", AccountTypeTag::CHECKING, 500};
+        optional<AccountRecord> first = store.findAccount(1000);
+        return check(first.has_value(), "account from before the damage is loaded") &&
+               check(store.insert(second), "insert after the damage") &&
+               check(store.updateBalances({{1000, first->lsn, 25000}}) == UpdateResult::UPDATED,
+                     "update after the damage");
+    });
+
+    ok = ok && inNewSession([] {
+        AccountStore& store = AccountStore::instance();
+        optional<AccountRecord> first = store.findAccount(1000);
+        return check(first && first->balanceCents == 25000, "update survives a restart") &&
+               check(store.findAccount(1001).has_value(), "insert survives a restart");
+    });
+
+    return ok && check(logSize() == before + 2 * static_cast<off_t>(WAL_RECORD_SIZE),
+                       "torn tail was cut off");
+}
+
+/**
+ * A damaged record in the middle of the log costs only that record
+ *
+ * 1. Accounts 1000 to 1003 are created in separate sessions
+ * 2. One bit of the second log record, account 1001, is flipped
+ * 3. After a restart, accounts 1000, 1002 and 1003 must still exist,
+ *    and a new account is appended behind them without cutting the log
+ *
+ * @return bool True if every check passed
+ */
+static bool damagedRecord() {
+    bool ok = true;
+    for (int accountNumber = 1000; accountNumber <= 1003; accountNumber++) {
+        ok = ok && insertInNewSession(accountNumber);
+    }
+
+    fstream log("accounts.wal", ios::binary | ios::in | ios::out);
+    log.seekg(WAL_RECORD_SIZE + 40);
+    char byte = static_cast<char>(log.get() ^ 0x10);
+    log.seekp(WAL_RECORD_SIZE + 40);
+    log.put(byte);
+    log.close();
+    off_t before = logSize();
+
+    ok = ok && insertInNewSession(1004);
+    ok = ok && inNewSession([] {
+        AccountStore& store = AccountStore::instance();
+        return check(store.findAccount(1000).has_value(), "account before the damage survives") &&
+               check(!store.findAccount(1001).has_value(), "damaged record is skipped") &&
+               check(store.findAccount(1002).has_value() && store.findAccount(1003).has_value(),
+                     "accounts after the damage survive") &&
+               check(store.findAccount(1004).has_value(), "account appended after the damage survives");
+    });
+
+    return ok && check(logSize() == before + static_cast<off_t>(WAL_RECORD_SIZE),
+                       "log was not cut at the damaged record");
+}
+
+/**
+ * A damaged end longer than a torn tail is left for inspection
+ *
+ * 1. A session creates an account
+ * 2. Two records' worth of garbage are appended to the log
+ * 3. A new session must fail to create an account, and the log must
+ *    be unchanged
+ *
+ * @return bool True if every check passed
+ */
+static bool damagedEnd() {
+    bool ok = insertInNewSession(1000);
+
+    ofstream("accounts.wal", ios::binary | ios::app) << string(2 * WAL_RECORD_SIZE, '\x5a');
+    off_t before = logSize();
+
+    ok = ok && inNewSession([] {
+        AccountStore& store = AccountStore::instance();
+        AccountRecord second{1001, "Second", AccountTypeTag::CHECKING, 500};
+        return check(store.findAccount(1000).has_value(), "account from before the damage is loaded") &&
+               check(!store.insert(second), "insert after a damaged end is refused");
+    });
+
+    return ok && check(logSize() == before, "damaged end was left in place");
+}
+
+int main() {
+    bool ok = enterNewDirectory() && tornTail();
+    ok = enterNewDirectory() && damagedRecord() && ok;
+    ok = enterNewDirectory() && damagedEnd() && ok;
+
+    cout << (ok ? "walRecoveryTest passed" : "walRecoveryTest failed") << endl;
+    return ok ? 0 : 1;
+}
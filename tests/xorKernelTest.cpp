@@ -0,0 +1,123 @@
+/**
+ * XOR Kernel Test
+ *
+ * Checks that the SSE2 and AVX2 XOR kernels produce the same bytes as
+ * the scalar kernel:
+ * - For every length from 0 to a few vector widths, so the scalar tail
+ *   after the last full vector is covered
+ * - From unaligned start addresses and from every key position
+ * - For keys shorter than, equal to and longer than a vector
+ * - Applying a kernel twice restores the original bytes
+ *
+ * Kernels the processor does not support are reported and skipped.
+ *
+ * Build and run from the repository root:
+ *   g++ -std=c++17 -I. tests/xorKernelTest.cpp $(ls *.cpp | grep -v main.cpp) -o xorKernelTest -pthread
+ *   ./xorKernelTest
+ */
+
+#include "simpleEncryption.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Report a failed check
+ *
+ * @param ok Outcome of the check
+ * @param what Description of the check
+ * @return bool The outcome
+ */
+static bool check(bool ok, const string& what) {
+    if (!ok) {
+        cerr << "FAILED: " << what << endl;
+    }
+    return ok;
+}
+
+/**
+ * Compare one vector kernel with the scalar kernel
+ *
+ * 1. A buffer of varied bytes is transformed by the scalar kernel and
+ *    by the kernel under test, for every combination of length, start
+ *    misalignment, key and key position
+ * 2. The results must match byte for byte
+ * 3. The kernel under test is applied again and must restore the input
+ *
+ * @param type Kernel to test
+ * @param name Name of the kernel in reports
+ * @return bool True if every check passed
+ */
+static bool matchesScalar(XorKernelType type, const string& name) {
+    if (!xorKernelSupported(type)) {
+        cout << name << " is not supported here, skipped" << endl;
+        return true;
+    }
+
+    const size_t maxLength = 4 * XOR_BLOCK_SIZE + 7;
+    string input(maxLength + 16, '\0');
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = static_cast<char>(i * 131 + 17);
+    }
+
+    for (const string& rawKey : {string("k"), string("0123456789abcdef"),
+                                 string(XOR_BLOCK_SIZE, 'K'), string("a key longer than one vector width")}) {
+        ExpandedKey key = expandKey(rawKey);
+        for (size_t misalign = 0; misalign < 16; misalign += 3) {
+            for (size_t length = 0; length <= maxLength; length++) {
+                for (size_t offset = 0; offset < rawKey.length() + 2; offset++) {
+                    string expected = input;
+                    string actual = input;
+                    encryptDecryptWithKernel(XorKernelType::SCALAR, &expected[misalign], length, key, offset);
+                    encryptDecryptWithKernel(type, &actual[misalign], length, key, offset);
+                    string where = name + " with a key of " + to_string(rawKey.length()) + " bytes, length " +
+                                   to_string(length) + ", offset " + to_string(offset) +
+                                   ", misaligned by " + to_string(misalign);
+                    if (!check(actual == expected, where + " matches scalar")) {
+                        return false;
+                    }
+                    encryptDecryptWithKernel(type, &actual[misalign], length, key, offset);
+                    if (!check(actual == input, where + " round-trips")) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * The scalar kernel follows the key from the file position
+ *
+ * Byte i of a buffer at file offset o is XORed with key[(o + i) % key length].
+ *
+ * @return bool True if every check passed
+ */
+static bool scalarFollowsKey() {
+    const string rawKey = "secret";
+    ExpandedKey key = expandKey(rawKey);
+    string data = "The quick brown fox jumps over the lazy dog";
+    for (size_t offset = 0; offset < 10; offset++) {
+        string actual = data;
+        encryptDecryptWithKernel(XorKernelType::SCALAR, &actual[0], actual.size(), key, offset);
+        for (size_t i = 0; i < data.size(); i++) {
+            if (!check(actual[i] == static_cast<char>(data[i] ^ rawKey[(offset + i) % rawKey.length()]),
+                       "scalar byte " + to_string(i) + " at offset " + to_string(offset))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main() {
+    bool ok = scalarFollowsKey();
+    ok = matchesScalar(XorKernelType::SSE2, "SSE2") && ok;
+    ok = matchesScalar(XorKernelType::AVX2, "AVX2") && ok;
+
+    cout << (ok ? "xorKernelTest passed" : "xorKernelTest failed") << endl;
+    return ok ? 0 : 1;
+}
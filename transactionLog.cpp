@@ -9,7 +9,7 @@
 
 #include "transactionLog.h"
 #include "utilityFunctions.h"
-#include <fstream>
+#include "logArchive.h"
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -41,6 +41,8 @@ string transactionTypeToString(TransactionType type) {
  * Format:
  * datetime,type,accountNumber,amount,username,status,secondAccount,details
  * 
+ * Older entries are compressed into transactions.txt.lz (see logArchive.h).
+ * 
  * @param type Transaction type (DEPOSIT, WITHDRAW, TRANSFER)
  * @param accountNumber Primary account involved
  * @param amount Transaction amount
@@ -57,18 +59,16 @@ void logTransaction(TransactionType type,
                    const string& details,
                    int secondAccountNumber) {
     
-    ofstream logFile(TRANSACTION_LOG_FILE, ios::app);
-    if (logFile.is_open()) {
-        logFile << getCurrentDate() << ","
-                << transactionTypeToString(type) << ","
-                << accountNumber << ","
-                << fixed << setprecision(2) << amount << ","
-                << username << ","
-                << (status == TransactionStatus::SUCCESS ? "Success" : "Failed") << ","
-                << (secondAccountNumber != -1 ? to_string(secondAccountNumber) : "") << ","
-                << details << endl;
-        logFile.close();
-    }
+    ostringstream entry;
+    entry << getCurrentDate() << ","
+          << transactionTypeToString(type) << ","
+          << accountNumber << ","
+          << fixed << setprecision(2) << amount << ","
+          << username << ","
+          << (status == TransactionStatus::SUCCESS ? "Success" : "Failed") << ","
+          << (secondAccountNumber != -1 ? to_string(secondAccountNumber) : "") << ","
+          << details;
+    appendLogLine(TRANSACTION_LOG_FILE, entry.str());
 }
 
 /**
@@ -83,8 +83,6 @@ void logTransaction(TransactionType type,
  * @param accountNumber Account to show (-1 for all accounts)
  */
 void viewTransactionHistory(int accountNumber) {
-    ifstream logFile(TRANSACTION_LOG_FILE);
-    string line;
     bool found = false;
     
     clearScreen();
@@ -102,9 +100,9 @@ void viewTransactionHistory(int accountNumber) {
          << "Details" << endl;
     cout << setfill('-') << setw(100) << "-" << setfill(' ') << endl;
 
-    // Process each transaction
-    while (getline(logFile, line)) {
-        istringstream iss(line);
+    // Process each transaction, archived ones first
+    forEachLogLine(TRANSACTION_LOG_FILE, [&](string_view line) {
+        istringstream iss{string(line)};
         string datetime, type, accNum, amount, user, status, secAccNum, details;
         
         getline(iss, datetime, ',');
@@ -136,7 +134,7 @@ void viewTransactionHistory(int accountNumber) {
             cout << endl;
             found = true;
         }
-    }
+    });
 
     // Display message if no transactions found
     if (!found) {
@@ -139,11 +139,25 @@ void transferFunds(int clientAccountNumber) {
         return;
     }
 
-    sourceAccount->withdraw(transferAmount);
-    destAccount->deposit(transferAmount);
-
-    if (updateAccountInDatabase(*sourceAccount) && 
-        updateAccountInDatabase(*destAccount)) {
+    // Both balances are written together, and only if neither account
+    // changed since it was selected; otherwise the transfer is checked
+    // and made again on their current balances
+    vector<unique_ptr<bankAccountType>> accounts;
+    accounts.push_back(move(sourceAccount));
+    accounts.push_back(move(destAccount));
+    CommitStatus status = commitBalanceChange(accounts,
+        [&](vector<unique_ptr<bankAccountType>>& current) {
+            if (transferAmount > current[0]->getBalance()) {
+                return false;
+            }
+            current[0]->withdraw(transferAmount);
+            current[1]->deposit(transferAmount);
+            return true;
+        });
+    sourceAccount = move(accounts[0]);
+    destAccount = move(accounts[1]);
+
+    if (status == CommitStatus::COMMITTED) {
         cout << "\n=== Transfer Receipt ===" << endl;
         cout << "Date: " << getCurrentDate() << endl;
         cout << "From Account: " << sourceAccount->getType() 
@@ -167,13 +181,15 @@ void transferFunds(int clientAccountNumber) {
                       transferDetails,
                       destAccount->getAccountNumber());
     } else {
-        cout << "Error: Failed to update accounts in database." << endl;
+        string reason = status == CommitStatus::REJECTED ? "Insufficient funds"
+                                                         : describeCommitStatus(status);
+        cout << "Error: " << reason << ". Transfer not made." << endl;
         logTransaction(TransactionType::TRANSFER, 
                       sourceAccount->getAccountNumber(),
                       transferAmount, 
                       username, 
                       TransactionStatus::FAILED,
-                      "Database update failed",
+                      reason,
                       destAccount->getAccountNumber());
     }
 }
@@ -0,0 +1,410 @@
+/**
+ * User File Format Implementation
+ *
+ * This file implements reading and writing of the user list:
+ * - Encoding users into fixed-size slots with keyed checksums
+ * - Whole-file reads and atomic rewrites of the block container
+ * - In-place updates and appends of single slots
+ */
+
+#include "userFile.h"
+#include "blockContainer.h"
+#include "atomicFile.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+const uint32_t USER_FILE_MAGIC = 0x46554B42;        // "BKUF"
+const uint32_t USER_FILE_VERSION = 1;
+const size_t USER_SLOT_SIZE = 508;                  // Eight slots per container block
+const size_t USER_HASH_SIZE = 128;
+
+// Header, stored in slot 0
+struct userFileHeader {
+    uint32_t checksum;          // Keyed checksum, see slotChecksum
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;         // User slots following the header
+    uint32_t slotSize;
+    uint32_t generation;        // Raised by every change to the file
+    char reserved[484];
+};
+
+// One user
+struct userFileSlot {
+    uint32_t checksum;          // Keyed checksum, see slotChecksum
+    uint8_t role;               // 0 = client, 1 = manager
+    uint8_t usernameLength;
+    uint8_t passwordHashLength;
+    uint8_t accountCount;
+    char username[USER_NAME_SIZE];
+    char passwordHash[USER_HASH_SIZE];
+    int32_t accountNumbers[USER_MAX_ACCOUNTS];
+};
+
+static_assert(sizeof(userFileHeader) == USER_SLOT_SIZE, "User file header must fill one slot");
+static_assert(sizeof(userFileSlot) == USER_SLOT_SIZE, "User slots must be fixed-size");
+static_assert(CONTAINER_PAYLOAD_SIZE % USER_SLOT_SIZE == 0, "User slots must not straddle blocks");
+
+/**
+ * Keyed checksum of a slot
+ *
+ * The checksum field is replaced by the slot number before hashing,
+ * so a valid slot copied to another position does not verify.
+ *
+ * @param slot Slot bytes
+ * @param position Slot number, 0 for the header
+ * @param key Container key
+ * @return uint32_t Checksum of the slot
+ */
+static uint32_t slotChecksum(const char* slot, size_t position, const ContainerKey& key) {
+    char copy[USER_SLOT_SIZE];
+    memcpy(copy, slot, USER_SLOT_SIZE);
+    uint32_t number = position;
+    memcpy(copy, &number, sizeof(number));
+    return static_cast<uint32_t>(sipHash(key.macKey, copy, USER_SLOT_SIZE));
+}
+
+/**
+ * Logical offset of a user's slot
+ *
+ * @param position User number in file order
+ * @return size_t Offset of the slot in the container stream
+ */
+static size_t slotOffset(size_t position) {
+    return (position + 1) * USER_SLOT_SIZE;
+}
+
+/**
+ * Check whether a user fits in a slot
+ *
+ * @param user User to check
+ * @return bool True if the name, hash and account list are short enough
+ */
+bool userFits(const User& user) {
+    return user.username.size() <= USER_NAME_SIZE &&
+           user.passwordHash.size() <= USER_HASH_SIZE &&
+           user.accountNumbers.size() <= USER_MAX_ACCOUNTS;
+}
+
+/**
+ * Encode a user into a slot
+ *
+ * @param user User to encode (must fit a slot)
+ * @param position Slot number of the user
+ * @param key Container key
+ * @param bytes Receives USER_SLOT_SIZE bytes
+ */
+static void encodeUserSlot(const User& user, size_t position, const ContainerKey& key, char* bytes) {
+    userFileSlot slot;
+    memset(&slot, 0, sizeof(slot));
+    slot.role = user.role == UserRole::MANAGER ? 1 : 0;
+    slot.usernameLength = user.username.size();
+    slot.passwordHashLength = user.passwordHash.size();
+    slot.accountCount = user.accountNumbers.size();
+    memcpy(slot.username, user.username.data(), user.username.size());
+    memcpy(slot.passwordHash, user.passwordHash.data(), user.passwordHash.size());
+    for (size_t i = 0; i < user.accountNumbers.size(); i++) {
+        slot.accountNumbers[i] = user.accountNumbers[i];
+    }
+    memcpy(bytes, &slot, sizeof(slot));
+    slot.checksum = slotChecksum(bytes, position + 1, key);
+    memcpy(bytes, &slot, sizeof(slot));
+}
+
+/**
+ * Decode a user's slot
+ *
+ * @param bytes Decrypted slot
+ * @param position Slot number of the user
+ * @param key Container key
+ * @param user Receives the user
+ * @return bool False if the slot fails its checksum or bounds
+ */
+static bool decodeUserSlot(const char* bytes, size_t position, const ContainerKey& key, User& user) {
+    userFileSlot slot;
+    memcpy(&slot, bytes, sizeof(slot));
+    if (slot.checksum != slotChecksum(bytes, position + 1, key) ||
+        slot.usernameLength > USER_NAME_SIZE || slot.passwordHashLength > USER_HASH_SIZE ||
+        slot.accountCount > USER_MAX_ACCOUNTS) {
+        return false;
+    }
+    user.username.assign(slot.username, slot.usernameLength);
+    user.passwordHash.assign(slot.passwordHash, slot.passwordHashLength);
+    user.role = slot.role == 1 ? UserRole::MANAGER : UserRole::CLIENT;
+    user.accountNumbers.assign(slot.accountNumbers, slot.accountNumbers + slot.accountCount);
+    return true;
+}
+
+/**
+ * Encode the header slot
+ *
+ * @param slotCount Number of user slots
+ * @param generation Change counter of the file
+ * @param key Container key
+ * @param bytes Receives USER_SLOT_SIZE bytes
+ */
+static void encodeUserHeader(uint32_t slotCount, uint32_t generation, const ContainerKey& key,
+                             char* bytes) {
+    userFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = USER_FILE_MAGIC;
+    header.version = USER_FILE_VERSION;
+    header.slotCount = slotCount;
+    header.generation = generation;
+    header.slotSize = USER_SLOT_SIZE;
+    memcpy(bytes, &header, sizeof(header));
+    header.checksum = slotChecksum(bytes, 0, key);
+    memcpy(bytes, &header, sizeof(header));
+}
+
+/**
+ * Decode and validate the header slot
+ *
+ * @param bytes Decrypted header slot
+ * @param key Container key
+ * @param header Receives the header
+ * @return bool False if the header is damaged or of another format
+ */
+static bool decodeUserHeader(const char* bytes, const ContainerKey& key, userFileHeader& header) {
+    memcpy(&header, bytes, sizeof(header));
+    return header.checksum == slotChecksum(bytes, 0, key) && header.magic == USER_FILE_MAGIC &&
+           header.version == USER_FILE_VERSION && header.slotSize == USER_SLOT_SIZE;
+}
+
+/**
+ * Read the user file
+ *
+ * Process:
+ * 1. Read the container and decrypt all of its blocks
+ * 2. Validate the header
+ * 3. Decode every user slot in order
+ *
+ * Error Handling:
+ * - A missing file is reported as MISSING
+ * - A file that is not a container or has a bad header is INVALID
+ * - A user slot failing its checksum is reported and skipped
+ *
+ * @param filename User file
+ * @param keys Decryption key material
+ * @param contents Receives the users, their slot numbers and the generation
+ * @return UserFileStatus Outcome of the read
+ */
+UserFileStatus readUserFile(const string& filename, const KeyContext& keys, UserFileContents& contents) {
+    contents = UserFileContents();
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return errno == ENOENT ? UserFileStatus::MISSING : UserFileStatus::INVALID;
+    }
+
+    struct stat st;
+    string file;
+    bool readOk = fstat(fd, &st) == 0;
+    if (readOk) {
+        file.resize(st.st_size);
+        readOk = pread(fd, &file[0], file.size(), 0) == static_cast<ssize_t>(file.size());
+    }
+    close(fd);
+    if (!readOk || !isContainer(file.data(), file.size())) {
+        return UserFileStatus::INVALID;
+    }
+
+    const ContainerKey& containerKey = keys.container;
+    size_t blocks = file.size() / CONTAINER_BLOCK_SIZE;
+    string stream(blocks * CONTAINER_PAYLOAD_SIZE, '\0');
+    size_t damaged = decodeContainerBlocks(file.data(), 0, blocks, containerKey, &stream[0]);
+
+    userFileHeader header;
+    if (!decodeUserHeader(stream.data(), containerKey, header) ||
+        slotOffset(header.slotCount) > stream.size()) {
+        return UserFileStatus::INVALID;
+    }
+
+    contents.generation = header.generation;
+    contents.users.reserve(header.slotCount);
+    contents.positions.reserve(header.slotCount);
+    for (uint32_t i = 0; i < header.slotCount; i++) {
+        User user;
+        if (!decodeUserSlot(stream.data() + slotOffset(i), i, containerKey, user)) {
+            cerr << "Error: " << filename << " has a damaged user record at position " << i << endl;
+            continue;
+        }
+        contents.users.push_back(user);
+        contents.positions.push_back(i);
+    }
+
+    if (damaged > 0) {
+        cerr << "Warning: " << filename << " has " << damaged
+             << " block(s) from an interrupted update; their records passed their checksums" << endl;
+    }
+    return UserFileStatus::OK;
+}
+
+/**
+ * Read only the generation of the user file
+ *
+ * Reads and decrypts the first block alone, so the cost does not
+ * depend on the number of users.
+ *
+ * @param filename User file
+ * @param keys Decryption key material
+ * @param generation Receives the change counter
+ * @return UserFileStatus MISSING if the file does not exist, INVALID if the header is unreadable
+ */
+UserFileStatus readUserFileGeneration(const string& filename, const KeyContext& keys, uint32_t& generation) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return errno == ENOENT ? UserFileStatus::MISSING : UserFileStatus::INVALID;
+    }
+
+    char headerBytes[USER_SLOT_SIZE];
+    userFileHeader header;
+    bool ok = readContainerRange(fd, 0, USER_SLOT_SIZE, keys.container, headerBytes) &&
+              decodeUserHeader(headerBytes, keys.container, header);
+    close(fd);
+    if (!ok) {
+        return UserFileStatus::INVALID;
+    }
+    generation = header.generation;
+    return UserFileStatus::OK;
+}
+
+/**
+ * Replace the user file
+ *
+ * @param filename User file to replace
+ * @param keys Encryption key material
+ * @param users Users to write, in slot order
+ * @param generation Change counter to store; must differ from the file being replaced
+ * @return bool True if the file was written completely
+ */
+bool writeUserFile(const string& filename, const KeyContext& keys, const vector<User>& users,
+                   uint32_t generation) {
+    const ContainerKey& containerKey = keys.container;
+    string stream(slotOffset(users.size()), '\0');
+    encodeUserHeader(users.size(), generation, containerKey, &stream[0]);
+    for (size_t i = 0; i < users.size(); i++) {
+        if (!userFits(users[i])) {
+            cerr << "Error: User " << users[i].username << " does not fit in a user record" << endl;
+            return false;
+        }
+        encodeUserSlot(users[i], i, containerKey, &stream[slotOffset(i)]);
+    }
+    return replaceFileAtomically(filename, encodeContainer(stream, containerKey));
+}
+
+/**
+ * Rewrite one user's slot in place
+ *
+ * The slot must still hold an intact record for expectedUsername, so
+ * a slot moved by a concurrent rewrite of the file is never overwritten.
+ * The header's generation is raised after the slot is written.
+ *
+ * @param filename User file
+ * @param keys Encryption key material
+ * @param position Slot number of the user
+ * @param expectedUsername Username the slot must currently hold
+ * @param user New contents of the slot
+ * @return bool True if the slot was written and synced
+ */
+bool updateUserInFile(const string& filename, const KeyContext& keys, size_t position,
+                      const string& expectedUsername, const User& user) {
+    if (!userFits(user)) {
+        return false;
+    }
+    int fd = open(filename.c_str(), O_RDWR);
+    if (fd == -1) {
+        return false;
+    }
+
+    const ContainerKey& containerKey = keys.container;
+    char headerBytes[USER_SLOT_SIZE];
+    userFileHeader header;
+    bool ok = readContainerRange(fd, 0, USER_SLOT_SIZE, containerKey, headerBytes) &&
+              decodeUserHeader(headerBytes, containerKey, header) && position < header.slotCount;
+
+    if (ok) {
+        ContainerUpdate result = updateContainerRange(fd, slotOffset(position), USER_SLOT_SIZE,
+                                                      containerKey, [&](char* bytes) {
+            User current;
+            if (!decodeUserSlot(bytes, position, containerKey, current) ||
+                current.username != expectedUsername) {
+                return false;
+            }
+            encodeUserSlot(user, position, containerKey, bytes);
+            return true;
+        });
+        if (result == ContainerUpdate::WRITTEN) {
+            result = updateContainerRange(fd, 0, USER_SLOT_SIZE, containerKey, [&](char* bytes) {
+                encodeUserHeader(header.slotCount, header.generation + 1, containerKey, bytes);
+                return true;
+            });
+        }
+        ok = result == ContainerUpdate::WRITTEN && fdatasync(fd) == 0;
+        if (result == ContainerUpdate::FAILED) {
+            cerr << "Error: Unable to write to " << filename << endl;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+/**
+ * Append a user in a new slot
+ *
+ * Process:
+ * 1. Read the slot count from the header
+ * 2. Write the new slot after the last one and sync it
+ * 3. Raise the slot count and generation in the header and sync again
+ *
+ * A crash before step 3 leaves the file as it was.
+ *
+ * @param filename User file
+ * @param keys Encryption key material
+ * @param user User to add
+ * @return bool True if the user was written and synced
+ */
+bool appendUserToFile(const string& filename, const KeyContext& keys, const User& user) {
+    if (!userFits(user)) {
+        return false;
+    }
+    int fd = open(filename.c_str(), O_RDWR);
+    if (fd == -1) {
+        return false;
+    }
+
+    const ContainerKey& containerKey = keys.container;
+    char headerBytes[USER_SLOT_SIZE];
+    userFileHeader header;
+    bool ok = readContainerRange(fd, 0, USER_SLOT_SIZE, containerKey, headerBytes) &&
+              decodeUserHeader(headerBytes, containerKey, header);
+
+    if (ok) {
+        uint32_t position = header.slotCount;
+        ok = updateContainerRange(fd, slotOffset(position), USER_SLOT_SIZE, containerKey,
+                                  [&](char* bytes) {
+            encodeUserSlot(user, position, containerKey, bytes);
+            return true;
+        }) == ContainerUpdate::WRITTEN && fdatasync(fd) == 0;
+
+        ok = ok && updateContainerRange(fd, 0, USER_SLOT_SIZE, containerKey, [&](char* bytes) {
+            userFileHeader current;
+            if (!decodeUserHeader(bytes, containerKey, current) || current.slotCount != position) {
+                return false;
+            }
+            encodeUserHeader(position + 1, current.generation + 1, containerKey, bytes);
+            return true;
+        }) == ContainerUpdate::WRITTEN && fdatasync(fd) == 0;
+
+        if (!ok) {
+            cerr << "Error: Unable to write to " << filename << endl;
+        }
+    }
+    close(fd);
+    return ok;
+}
@@ -0,0 +1,68 @@
+/**
+ * User File Format Header
+ *
+ * Purpose:
+ * Defines the encrypted on-disk format of the user list.
+ *
+ * User File (users.dat):
+ * - Stored in a block container (see blockContainer.h), encrypted and
+ *   authenticated block by block
+ * - Slot 0 holds the header: magic, version, slot count, slot size and
+ *   a generation number raised by every change
+ * - Every further slot holds one user: role, username, password hash
+ *   and account numbers, protected by a keyed checksum
+ * - Slots are 508 bytes, so eight fill a block and none straddles two;
+ *   changing or appending a user rewrites one slot and one block header
+ */
+
+#ifndef USER_FILE_H
+#define USER_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "userManagement.h"
+#include "keyContext.h"
+
+using namespace std;
+
+// Result of reading the user file
+enum class UserFileStatus {
+    OK,
+    MISSING,
+    INVALID
+};
+
+// Longest username and longest account list a slot holds
+const size_t USER_NAME_SIZE = 64;
+const size_t USER_MAX_ACCOUNTS = 77;
+
+// Checks whether a user fits in one fixed-size slot
+bool userFits(const User& user);
+
+// Users read from the user file
+struct UserFileContents {
+    vector<User> users;         // In slot order
+    vector<size_t> positions;   // Slot number of each user
+    uint32_t generation = 0;    // Raised by every change to the file
+};
+
+// Reads every user in slot order; slots that fail their checksum are reported and skipped
+UserFileStatus readUserFile(const string& filename, const KeyContext& keys, UserFileContents& contents);
+
+// Reads only the generation from the header, to check whether a cached copy is current
+UserFileStatus readUserFileGeneration(const string& filename, const KeyContext& keys, uint32_t& generation);
+
+// Replaces the user file with the given users
+bool writeUserFile(const string& filename, const KeyContext& keys, const vector<User>& users,
+                   uint32_t generation);
+
+// Rewrites the slot of one user in place and syncs the file
+// The slot is left alone unless it still holds expectedUsername
+bool updateUserInFile(const string& filename, const KeyContext& keys, size_t position,
+                      const string& expectedUsername, const User& user);
+
+// Appends a user in a new slot and syncs the file
+bool appendUserToFile(const string& filename, const KeyContext& keys, const User& user);
+
+#endif // USER_FILE_H
@@ -10,71 +10,117 @@
  */
 
 #include "userManagement.h"
-#include "simpleEncryption.h"
+#include "userFile.h"
+#include "passwordHasher.h"
 #include "loginLog.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <optional>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
 
 using namespace std;
 
 // File paths and encryption keys for user data storage
-const string USER_FILE = "users.txt";
+const string USER_FILE = "users.dat";
+const string LEGACY_USER_FILE = "users.txt";       // Plain text, imported once
+const string USER_LOCK_FILE = "users.lock";
 const string USER_ENCRYPTION_KEY = "user_file_encryption_key";
 
 // Current user's session information
 User currentUser;
 
+// Opens a session for a user who has just logged in
+// The session keeps its own copy of the user, so later operations
+// need neither the password nor the user file
+static void startSession(const User& user) {
+    currentUser = user;
+}
+
+static bool updateUser(const string& username, const function<bool(User&)>& change);
+static optional<User> findUser(const string& username);
+
+// Replaces a user's stored password hash, unless it changed since it was read
+static bool replacePasswordHash(const string& username, const string& oldHash, const string& newHash) {
+    return updateUser(username, [&](User& user) {
+        if (user.passwordHash != oldHash) {
+            return false;
+        }
+        user.passwordHash = newHash;
+        return true;
+    });
+}
+
 // Authenticates user login attempts and maintains login history
+// Passwords stored with an outdated hash or cost are rehashed on success
 bool authenticateUser(const string& username, const string& password) {
-    vector<User> users = loadUsers();
-    for (const auto& user : users) {
-        if (user.username == username && user.passwordHash == simpleHash(password)) {
-            currentUser = user;
-            logLogin(username, true);  // Log successful login
-            return true;
+    optional<User> user = findUser(username);
+
+    if (!user) {
+        // Spend the same time as for a real user, so logins do not reveal which names exist
+        static const string unknownUserHash = hashPassword("");
+        verifyPassword(password, unknownUserHash);
+        logLogin(username, false);  // Log failed login attempt
+        return false;
+    }
+
+    PasswordCheck check = verifyPassword(password, user->passwordHash);
+    if (!check.valid) {
+        logLogin(username, false);  // Log failed login attempt
+        return false;
+    }
+
+    if (check.needsRehash) {
+        string newHash = hashPassword(password);
+        if (replacePasswordHash(username, user->passwordHash, newHash)) {
+            user->passwordHash = newHash;
         }
     }
-    logLogin(username, false);  // Log failed login attempt
-    return false;
+    startSession(*user);
+    logLogin(username, true);  // Log successful login
+    return true;
 }
 
-// Saves all user data to the users.txt file in the specified format
-void saveUsers(const vector<User>& users) {
-    stringstream ss;
-    for (const auto& user : users) {
-        ss << user.username << "," << user.passwordHash << ","
-           << (user.role == UserRole::MANAGER ? "MANAGER" : "CLIENT");
-        
-        if (user.role == UserRole::MANAGER) {
-            ss << ",-1";  // Managers have -1 as account number
-        } else {
-            // Save all account numbers with | separator for multiple accounts
-            for (size_t i = 0; i < user.accountNumbers.size(); ++i) {
-                ss << "," << user.accountNumbers[i];
-                if (i < user.accountNumbers.size() - 1) {
-                    ss << "|";
-                }
-            }
-        }
-        ss << "\n";
+// Locks the user file; operation is LOCK_SH for reading or LOCK_EX for changes
+static int lockUsers(int operation) {
+    int fd = open(USER_LOCK_FILE.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd != -1 && flock(fd, operation) == -1) {
+        close(fd);
+        fd = -1;
     }
-    
-    string content = ss.str();
-    ofstream outFile(USER_FILE);
-    if (outFile.is_open()) {
-        outFile << content;
-        outFile.close();
-    } else {
+    return fd;
+}
+
+// Releases a lock taken with lockUsers
+static void unlockUsers(int fd) {
+    if (fd != -1) {
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+}
+
+// Replaces the user file with the given users
+void saveUsers(const vector<User>& users) {
+    const KeyContext& keys = keyContextFor(USER_ENCRYPTION_KEY);
+    int lockFd = lockUsers(LOCK_EX);
+    uint32_t generation = 0;
+    readUserFileGeneration(USER_FILE, keys, generation);
+    if (!writeUserFile(USER_FILE, keys, users, generation + 1)) {
         cerr << "Error: Unable to write to " << USER_FILE << endl;
     }
+    unlockUsers(lockFd);
 }
 
-// Loads and parses user data from the users.txt file
-vector<User> loadUsers() {
+// Parses the plain text users.txt file written by earlier versions
+static vector<User> loadLegacyUsers() {
     vector<User> users;
-    ifstream inFile(USER_FILE);
+    ifstream inFile(LEGACY_USER_FILE);
     string line;
     
     while (getline(inFile, line)) {
@@ -121,17 +167,133 @@ vector<User> loadUsers() {
     
     return users;
 }
+
+// Reads the user file, creating it from users.txt first if it does not exist yet
+// The caller holds the exclusive lock
+static UserFileStatus readUsersForUpdate(UserFileContents& contents) {
+    const KeyContext& keys = keyContextFor(USER_ENCRYPTION_KEY);
+    UserFileStatus status = readUserFile(USER_FILE, keys, contents);
+    if (status == UserFileStatus::MISSING) {
+        vector<User> legacyUsers = loadLegacyUsers();
+        auto tooLarge = stable_partition(legacyUsers.begin(), legacyUsers.end(), userFits);
+        for (auto it = tooLarge; it != legacyUsers.end(); ++it) {
+            cerr << "Warning: User " << it->username << " has a username or account list too long for "
+                 << USER_FILE << " and was not imported; it is still in " << LEGACY_USER_FILE << endl;
+        }
+        legacyUsers.erase(tooLarge, legacyUsers.end());
+        if (!legacyUsers.empty() && writeUserFile(USER_FILE, keys, legacyUsers, 1)) {
+            status = readUserFile(USER_FILE, keys, contents);
+        }
+    }
+    if (status == UserFileStatus::INVALID) {
+        cerr << "Error: " << USER_FILE << " is damaged or has an unknown format" << endl;
+    }
+    return status;
+}
+
+// In-memory copy of the user file, indexed by username
+// It is reused for as long as the file's generation does not change
+static mutex directoryMutex;
+static UserFileContents directory;
+static unordered_map<string, size_t> directoryIndex;   // Username -> first user with that name
+static bool directoryLoaded = false;
+
+// Brings the directory up to date with the user file; the caller holds directoryMutex
+static void refreshDirectory() {
+    const KeyContext& keys = keyContextFor(USER_ENCRYPTION_KEY);
+    uint32_t generation;
+    if (directoryLoaded && readUserFileGeneration(USER_FILE, keys, generation) == UserFileStatus::OK &&
+        generation == directory.generation) {
+        return;
+    }
+
+    int lockFd = lockUsers(LOCK_SH);
+    UserFileStatus status = readUserFile(USER_FILE, keys, directory);
+    unlockUsers(lockFd);
+    if (status != UserFileStatus::OK) {
+        lockFd = lockUsers(LOCK_EX);
+        status = readUsersForUpdate(directory);
+        unlockUsers(lockFd);
+    }
+
+    directoryIndex.clear();
+    directoryIndex.reserve(directory.users.size());
+    for (size_t i = 0; i < directory.users.size(); i++) {
+        User& user = directory.users[i];
+        // Managers of older files may have no account number stored
+        if (user.role == UserRole::MANAGER && user.accountNumbers.empty()) {
+            user.accountNumbers.push_back(-1);
+        }
+        directoryIndex.emplace(user.username, i);
+    }
+    directoryLoaded = status == UserFileStatus::OK;
+}
+
+// Looks a user up by name through the directory, without reading the whole file
+static optional<User> findUser(const string& username) {
+    lock_guard<mutex> lock(directoryMutex);
+    refreshDirectory();
+    auto it = directoryIndex.find(username);
+    if (it == directoryIndex.end()) {
+        return nullopt;
+    }
+    return directory.users[it->second];
+}
+
+// Loads all users, reading the user file only if it changed since the last call
+vector<User> loadUsers() {
+    lock_guard<mutex> lock(directoryMutex);
+    refreshDirectory();
+    return directory.users;
+}
+
+// Checks whether any user other than the one at skip has the given name
+static bool usernameTaken(const vector<User>& users, const string& username, size_t skip) {
+    for (size_t i = 0; i < users.size(); i++) {
+        if (i != skip && users[i].username == username) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Changes one user and writes back only that user's record
+// change returns false to leave the user as it is; a change that renames
+// the user to a name already in use, or no longer fits its record, is refused
+static bool updateUser(const string& username, const function<bool(User&)>& change) {
+    UserFileContents contents;
+    int lockFd = lockUsers(LOCK_EX);
+    bool updated = false;
+    if (readUsersForUpdate(contents) == UserFileStatus::OK) {
+        auto& users = contents.users;
+        auto it = find_if(users.begin(), users.end(),
+                          [&username](const User& user) { 
+                              return user.username == username; 
+                          });
+        size_t position = it - users.begin();
+        updated = it != users.end() && change(*it) && userFits(*it) &&
+                  (it->username == username || !usernameTaken(users, it->username, position)) &&
+                  updateUserInFile(USER_FILE, keyContextFor(USER_ENCRYPTION_KEY),
+                                   contents.positions[position], username, *it);
+    }
+    unlockUsers(lockFd);
+    return updated;
+}
 // Adds a new user to the system after checking for duplicates
 bool addUser(const User& newUser) {
-    vector<User> users = loadUsers();
-    for (const auto& user : users) {
-        if (user.username == newUser.username) {
-            return false; // User already exists
-        }
+    UserFileContents contents;
+    int lockFd = lockUsers(LOCK_EX);
+    UserFileStatus status = readUsersForUpdate(contents);
+    bool added = false;
+    if (status != UserFileStatus::INVALID &&
+        none_of(contents.users.begin(), contents.users.end(),
+                [&newUser](const User& user) { return user.username == newUser.username; })) {
+        const KeyContext& keys = keyContextFor(USER_ENCRYPTION_KEY);
+        added = status == UserFileStatus::MISSING ? writeUserFile(USER_FILE, keys, {newUser}, 1)
+                                                  : appendUserToFile(USER_FILE, keys, newUser);
     }
-    users.push_back(newUser);
-    saveUsers(users);
-    return true;
+    unlockUsers(lockFd);
+    return added; // False if the user already exists or could not be stored
 }
 
 // Returns current logged-in user's information
@@ -139,6 +301,11 @@ User getCurrentUser() {
     return currentUser;
 }
 
+// Closes the open session on logout
+void endSession() {
+    currentUser = User();
+}
+
 // Creates the initial admin account if it doesn't exist in the system
 void createInitialAdminAccount() {
     vector<User> users = loadUsers();
@@ -154,138 +321,126 @@ void createInitialAdminAccount() {
     if (!adminExists) {
         User adminUser;
         adminUser.username = "admin";
-        adminUser.passwordHash = simpleHash("admin");
+        adminUser.passwordHash = hashPassword("admin");
         adminUser.role = UserRole::MANAGER;
         adminUser.accountNumbers.push_back(-1);
         
-        users.push_back(adminUser);
-        saveUsers(users);
+        addUser(adminUser);
     }
 }
 
 // Changes a user's username and updates all references
+// Fails if the new name is invalid or already taken
 bool changeUsername(const string& oldUsername, const string& newUsername) {
-    vector<User> users = loadUsers();
-    auto it = find_if(users.begin(), users.end(),
-                      [&oldUsername](const User& user) { 
-                          return user.username == oldUsername; 
-                      });
-    
-    if (it != users.end()) {
-        it->username = newUsername;
-        saveUsers(users);
-        if (currentUser.username == oldUsername) {
-            currentUser.username = newUsername;
-        }
+    if (!isUsernameValid(newUsername)) {
+        return false;
+    }
+    bool changed = updateUser(oldUsername, [&newUsername](User& user) {
+        user.username = newUsername;
         return true;
+    });
+    if (changed && currentUser.username == oldUsername) {
+        currentUser.username = newUsername;
     }
-    return false;
+    return changed;
 }
 
 // Changes a user's password after verifying their old password
 bool changePassword(const string& username, const string& oldPassword, const string& newPassword) {
+    // Verify outside the user file lock, so the slow hash does not hold up other sessions
     vector<User> users = loadUsers();
     auto it = find_if(users.begin(), users.end(),
                       [&username](const User& user) { 
                           return user.username == username; 
                       });
-    
-    if (it != users.end() && it->passwordHash == simpleHash(oldPassword)) {
-        it->passwordHash = simpleHash(newPassword);
-        saveUsers(users);
-        if (currentUser.username == username) {
-            currentUser.passwordHash = simpleHash(newPassword);
-        }
-        return true;
+    if (it == users.end() || !verifyPassword(oldPassword, it->passwordHash).valid) {
+        return false;
     }
-    return false;
+
+    string newHash = hashPassword(newPassword);
+    bool changed = replacePasswordHash(username, it->passwordHash, newHash);
+    if (changed && currentUser.username == username) {
+        currentUser.passwordHash = newHash;
+    }
+    return changed;
 }
 
 // Checks if a username is available for new account creation
 bool isUsernameAvailable(const string& username) {
-    vector<User> users = loadUsers();
-    return find_if(users.begin(), users.end(),
-                   [&username](const User& user) { 
-                       return user.username == username; 
-                   }) == users.end();
+    return !findUser(username);
+}
+
+// Checks that a username can be stored in the user file
+bool isUsernameValid(const string& username) {
+    return !username.empty() && username.size() <= USER_NAME_SIZE;
+}
+
+// Checks that a client exists and can own one more account
+bool hasRoomForAccount(const string& username) {
+    optional<User> user = findUser(username);
+    return user && user->role == UserRole::CLIENT && user->accountNumbers.size() < USER_MAX_ACCOUNTS;
 }
 
-// Returns list of all users in the system
+// Returns list of all users in the system from the in-memory directory
 vector<User> getAllUsers() {
     return loadUsers();
 }
 
 // Changes a user's password directly (manager function, no old password required)
 bool changePasswordDirectly(const string& username, const string& newPassword) {
-    vector<User> users = loadUsers();
-    auto it = find_if(users.begin(), users.end(),
-                      [&username](const User& user) { 
-                          return user.username == username; 
-                      });
-    
-    if (it != users.end()) {
-        it->passwordHash = simpleHash(newPassword);
-        saveUsers(users);
-        if (currentUser.username == username) {
-            currentUser.passwordHash = simpleHash(newPassword);
-        }
+    string newHash = hashPassword(newPassword);
+    bool changed = updateUser(username, [&newHash](User& user) {
+        user.passwordHash = newHash;
         return true;
+    });
+    if (changed && currentUser.username == username) {
+        currentUser.passwordHash = newHash;
     }
-    return false;
+    return changed;
 }
 
 // Adds a new account number to a user's list of accounts
 bool addAccountToUser(const string& username, int accountNumber) {
-    vector<User> users = loadUsers();
-    auto it = find_if(users.begin(), users.end(),
-                      [&username](const User& user) { 
-                          return user.username == username; 
-                      });
-    
-    if (it != users.end() && it->role == UserRole::CLIENT) {
-        it->accountNumbers.push_back(accountNumber);
-        saveUsers(users);
-        if (currentUser.username == username) {
-            currentUser.accountNumbers.push_back(accountNumber);
+    bool added = updateUser(username, [accountNumber](User& user) {
+        if (user.role != UserRole::CLIENT) {
+            return false;
         }
+        user.accountNumbers.push_back(accountNumber);
         return true;
+    });
+    if (added && currentUser.username == username) {
+        currentUser.accountNumbers.push_back(accountNumber);
     }
-    return false;
+    return added;
 }
 
 // Removes an account number from a user's list of accounts
 bool removeAccountFromUser(const string& username, int accountNumber) {
-    vector<User> users = loadUsers();
-    auto it = find_if(users.begin(), users.end(),
-                      [&username](const User& user) { 
-                          return user.username == username; 
-                      });
-
-    if (it != users.end() && it->role == UserRole::CLIENT) {
-        auto& accounts = it->accountNumbers;
+    bool removed = updateUser(username, [accountNumber](User& user) {
+        auto& accounts = user.accountNumbers;
         auto accountIt = find(accounts.begin(), accounts.end(), accountNumber);
+        if (user.role != UserRole::CLIENT || accountIt == accounts.end()) {
+            return false;
+        }
+        accounts.erase(accountIt);
+        return true;
+    });
 
-        if (accountIt != accounts.end()) {
-            accounts.erase(accountIt);
-            saveUsers(users);
-
-            if (currentUser.username == username) {
-                auto& currentAccounts = currentUser.accountNumbers;
-                currentAccounts.erase(
-                    find(currentAccounts.begin(), currentAccounts.end(), accountNumber)
-                );
-            }
-            return true;
+    if (removed && currentUser.username == username) {
+        auto& currentAccounts = currentUser.accountNumbers;
+        auto accountIt = find(currentAccounts.begin(), currentAccounts.end(), accountNumber);
+        if (accountIt != currentAccounts.end()) {
+            currentAccounts.erase(accountIt);
         }
     }
-    return false;
+    return removed;
 }
 
 // Resets the system to only have the admin account
 void resetSystemToAdminOnly() {
     User adminUser;
     adminUser.username = "admin";
-    adminUser.passwordHash = simpleHash("admin");
+    adminUser.passwordHash = hashPassword("admin");
     adminUser.role = UserRole::MANAGER;
     adminUser.accountNumbers.push_back(-1);
     
@@ -297,7 +452,7 @@ void resetSystemToAdminOnly() {
 bool createManagerAccount(const string& username, const string& password) {
     User newManager;
     newManager.username = username;
-    newManager.passwordHash = simpleHash(password);
+    newManager.passwordHash = hashPassword(password);
     newManager.role = UserRole::MANAGER;
     newManager.accountNumbers.push_back(-1);
     
@@ -9,9 +9,16 @@
  * Handles both client and manager roles, their permissions, and their account associations.
  *
  * File Structure:
- * - Users stored in users.txt
- * - Data format: username,passwordHash,role,accountNumbers
- * - Account numbers separated by | for multiple accounts
+ * - Users stored encrypted in users.dat, one fixed-size record per user
+ *   (see userFile.h), so a change rewrites only that user's record
+ * - Older plain text users.txt files are imported on first use:
+ *   username,passwordHash,role,accountNumbers
+ *   with account numbers separated by | for multiple accounts
+ *
+ * Users are kept in an in-memory directory indexed by username, which is
+ * reloaded only when the file's generation number changes. A login opens
+ * a session that holds the user, so later operations need neither the
+ * password nor the user file.
  */
 
 #include <string>
@@ -36,10 +43,10 @@ struct User {
 // Verifies user credentials during login attempt
 bool authenticateUser(const string& username, const string& password);
 
-// Saves all user data to the users.txt file
+// Replaces all user data in the users.dat file
 void saveUsers(const vector<User>& users);
 
-// Loads all user data from the users.txt file
+// Loads all user data from the users.dat file
 vector<User> loadUsers();
 
 // Creates a new user in the system
@@ -48,6 +55,9 @@ bool addUser(const User& newUser);
 // Returns the currently logged-in user's information
 User getCurrentUser();
 
+// Closes the open session on logout
+void endSession();
+
 // Creates the initial admin account if it doesn't exist
 void createInitialAdminAccount();
 
@@ -60,6 +70,12 @@ bool changePassword(const string& username, const string& oldPassword, const str
 // Checks if a username is available for new accounts
 bool isUsernameAvailable(const string& username);
 
+// Checks that a username is not empty and fits the user file
+bool isUsernameValid(const string& username);
+
+// Checks that a client's account list has room for one more account
+bool hasRoomForAccount(const string& username);
+
 // Returns a list of all users in the system
 vector<User> getAllUsers();
 
@@ -29,7 +29,7 @@ using namespace std;
  * Process Flow:
  * 1. Locate the account (lookup or direct)
  * 2. Verify sufficient balance
- * 3. Process withdrawal
+ * 3. Take it from the balance, checking again if the account changed
  * 4. Generate receipt
  * 5. Log transaction
  * 
@@ -55,14 +55,8 @@ void withdraw(int accountNumber) {
         }
     } else {
         // Client operation - direct account access
-        vector<unique_ptr<bankAccountType>> accounts = loadAccounts();
-        auto it = find_if(accounts.begin(), accounts.end(),
-                      [accountNumber](const unique_ptr<bankAccountType>& acc) {
-                          return acc->getAccountNumber() == accountNumber;
-                      });
-        if (it != accounts.end()) {
-            account = move(*it);
-        } else {
+        account = findAccountInDatabase(accountNumber);
+        if (!account) {
             cout << "Error: Account not found." << endl;
             return;
         }
@@ -107,10 +101,23 @@ void withdraw(int accountNumber) {
     cin >> confirm;
     cin.ignore(numeric_limits<streamsize>::max(), '\n');
 
-    // Process withdrawal if confirmed
+    // Process withdrawal if confirmed; no lock was held while the user
+    // decided, so if another session changed the account meanwhile the
+    // withdrawal is checked against its current balance again
     if (toupper(confirm) == 'Y') {
-        account->setBalance(newBalance);
-        if (updateAccountInDatabase(*account)) {
+        vector<unique_ptr<bankAccountType>> accounts;
+        accounts.push_back(move(account));
+        CommitStatus status = commitBalanceChange(accounts,
+            [&](vector<unique_ptr<bankAccountType>>& current) {
+                if (withdrawalAmount > current[0]->getBalance()) {
+                    return false;
+                }
+                current[0]->setBalance(current[0]->getBalance() - withdrawalAmount);
+                return true;
+            });
+        account = move(accounts[0]);
+        newBalance = account->getBalance();
+        if (status == CommitStatus::COMMITTED) {
             // Generate receipt
             cout << "\n=== Withdrawal Receipt ===" << endl;
             cout << "Transaction Date: " << getCurrentDate() << endl;
@@ -126,10 +133,15 @@ void withdraw(int accountNumber) {
             string details = isManager ? "Withdrawn by manager" : "Withdrawn by account holder";
             logTransaction(TransactionType::WITHDRAW, account->getAccountNumber(), 
                          withdrawalAmount, username, TransactionStatus::SUCCESS, details);
+        } else if (status == CommitStatus::REJECTED) {
+            // The balance went down in another session after it was shown
+            cout << "Insufficient funds. Withdrawal not made." << endl;
+            logTransaction(TransactionType::WITHDRAW, account->getAccountNumber(), 
+                         withdrawalAmount, username, TransactionStatus::FAILED, "Insufficient funds");
         } else {
-            cout << "Error: Failed to update account in database." << endl;
+            cout << "Error: " << describeCommitStatus(status) << ". Withdrawal not made." << endl;
             logTransaction(TransactionType::WITHDRAW, account->getAccountNumber(), 
-                         withdrawalAmount, username, TransactionStatus::FAILED, "Database update failed");
+                         withdrawalAmount, username, TransactionStatus::FAILED, describeCommitStatus(status));
         }
     } else {
         cout << "Withdrawal cancelled." << endl;
@@ -0,0 +1,263 @@
+/**
+ * Write-Ahead Log Implementation
+ *
+ * This file implements the account mutation log:
+ * - Encoding entries into fixed-size encrypted records
+ * - Durable batched appends with one fdatasync per batch
+ * - Replay with detection of torn or corrupted records
+ * - Cutting a torn tail off before new records are appended
+ */
+
+#include "writeAheadLog.h"
+#include "simpleEncryption.h"
+#include "crc32c.h"
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+const uint32_t WAL_MAGIC = 0x334C5742;          // "BWL3"
+const size_t WAL_NAME_SIZE = 96;
+
+// On-disk layout of one log record
+struct walRecordDisk {
+    uint32_t magic;
+    uint32_t checksum;          // CRC-32C over everything after this field
+    uint64_t lsn;
+    int32_t accountNumber;
+    uint8_t operation;
+    uint8_t nameLength;
+    uint8_t typeTag;
+    uint8_t reserved;
+    int64_t balanceCents;
+    char name[WAL_NAME_SIZE];
+};
+
+static_assert(sizeof(walRecordDisk) == WAL_RECORD_SIZE, "WAL record must be fixed-size");
+
+/**
+ * Checksum of a record's payload
+ *
+ * @param record Decrypted record bytes
+ * @return uint32_t CRC-32C of the bytes following the checksum field
+ */
+static uint32_t walChecksum(const char* record) {
+    size_t start = offsetof(walRecordDisk, lsn);
+    return crc32c(record + start, WAL_RECORD_SIZE - start);
+}
+
+/**
+ * Check whether an account fits in a fixed-size log record
+ *
+ * @param account Account to check
+ * @return bool True if the name is short enough
+ */
+bool walEntryFits(const AccountRecord& account) {
+    return account.name.size() <= WAL_NAME_SIZE;
+}
+
+/**
+ * Encode and encrypt one entry as a fixed-size record
+ *
+ * @param entry Entry to encode (must fit a record)
+ * @param keys Encryption key material
+ * @return string Encrypted record of WAL_RECORD_SIZE bytes
+ */
+static string encodeWalEntry(const WalEntry& entry, const KeyContext& keys) {
+    walRecordDisk record;
+    memset(&record, 0, sizeof(record));
+    record.magic = WAL_MAGIC;
+    record.lsn = entry.lsn;
+    record.accountNumber = entry.account.accountNumber;
+    record.operation = static_cast<uint8_t>(entry.operation);
+    record.nameLength = static_cast<uint8_t>(entry.account.name.size());
+    record.typeTag = static_cast<uint8_t>(entry.account.type);
+    record.balanceCents = entry.account.balanceCents;
+    memcpy(record.name, entry.account.name.data(), entry.account.name.size());
+    record.checksum = walChecksum(reinterpret_cast<const char*>(&record));
+
+    string encoded(reinterpret_cast<const char*>(&record), sizeof(record));
+    encryptDecryptInPlace(&encoded[0], encoded.size(), keys.stream());
+    return encoded;
+}
+
+/**
+ * Append a batch of entries to the log
+ *
+ * Process:
+ * 1. Encode and encrypt every entry into a fixed-size record
+ * 2. Append all records with a single write
+ * 3. Sync the log to disk once for the whole batch
+ *
+ * @param logFile Log file to append to (created if missing)
+ * @param entries Entries to record, in commit order
+ * @param keys Encryption key material
+ * @return bool True if every entry is durable
+ */
+bool appendWalEntries(const string& logFile, const vector<WalEntry>& entries, const KeyContext& keys) {
+    string buffer;
+    buffer.reserve(entries.size() * WAL_RECORD_SIZE);
+    for (const auto& entry : entries) {
+        if (!walEntryFits(entry.account)) {
+            return false;
+        }
+        buffer += encodeWalEntry(entry, keys);
+    }
+
+    int fd = open(logFile.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0600);
+    if (fd == -1) {
+        cerr << "Error: Unable to open " << logFile << " for appending" << endl;
+        return false;
+    }
+    bool ok = write(fd, buffer.data(), buffer.size()) == static_cast<ssize_t>(buffer.size())
+              && fdatasync(fd) == 0;
+    close(fd);
+
+    if (!ok) {
+        cerr << "Error: Unable to write to " << logFile << endl;
+    }
+    return ok;
+}
+
+/**
+ * Decode one decrypted record
+ *
+ * @param buffer Decrypted record bytes
+ * @param entry Receives the decoded entry
+ * @return bool False if the record is torn or corrupted
+ */
+static bool decodeWalRecord(const char* buffer, WalEntry& entry) {
+    walRecordDisk record;
+    memcpy(&record, buffer, sizeof(record));
+    if (record.magic != WAL_MAGIC || record.checksum != walChecksum(buffer) ||
+        record.nameLength > WAL_NAME_SIZE) {
+        return false;
+    }
+    entry.operation = static_cast<WalOperation>(record.operation);
+    entry.lsn = record.lsn;
+    entry.account.accountNumber = record.accountNumber;
+    entry.account.name.assign(record.name, record.nameLength);
+    entry.account.type = static_cast<AccountTypeTag>(record.typeTag);
+    entry.account.balanceCents = record.balanceCents;
+    entry.account.lsn = record.lsn;
+    return true;
+}
+
+/**
+ * Check whether an intact record follows a damaged one
+ *
+ * @param fd Open log file
+ * @param offset Offset of the damaged record
+ * @param keys Decryption key material
+ * @return off_t Offset of the next intact record, or -1 if none follows
+ */
+static off_t nextIntactRecord(int fd, off_t offset, const KeyContext& keys) {
+    char buffer[WAL_RECORD_SIZE];
+    WalEntry entry;
+    for (offset += sizeof(buffer);
+         pread(fd, buffer, sizeof(buffer), offset) == static_cast<ssize_t>(sizeof(buffer));
+         offset += sizeof(buffer)) {
+        encryptDecryptInPlace(buffer, sizeof(buffer), keys.stream());
+        if (decodeWalRecord(buffer, entry)) {
+            return offset;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Replay the log from a byte offset
+ *
+ * A record that is incomplete or fails its checksum ends the replay
+ * only if no intact record follows it: that is where a crash
+ * interrupted an append, or where an append of another session is
+ * still in progress. Only a session holding the book lock can tell the
+ * two apart and cut a torn tail off with truncateWal.
+ *
+ * Damaged records followed by intact ones cannot be a torn append,
+ * since appends only add to the end. They are reported and skipped,
+ * so the committed records after them are still applied.
+ *
+ * @param logFile Log file to read (a missing file holds no entries)
+ * @param offset Byte offset of the first record to apply
+ * @param keys Decryption key material
+ * @param apply Called for each intact entry in log order
+ * @return off_t Offset just past the last intact record
+ */
+off_t replayWal(const string& logFile, off_t offset, const KeyContext& keys,
+                const function<void(const WalEntry&)>& apply) {
+    int fd = open(logFile.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return offset;
+    }
+
+    char buffer[WAL_RECORD_SIZE];
+    while (pread(fd, buffer, sizeof(buffer), offset) == static_cast<ssize_t>(sizeof(buffer))) {
+        encryptDecryptInPlace(buffer, sizeof(buffer), keys.stream());
+
+        WalEntry entry;
+        if (!decodeWalRecord(buffer, entry)) {
+            off_t next = nextIntactRecord(fd, offset, keys);
+            if (next == -1) {
+                break;
+            }
+            cerr << "Warning: " << logFile << " has " << (next - offset) / WAL_RECORD_SIZE
+                 << " damaged record(s) at offsets " << offset << "-" << next - 1
+                 << "; they were skipped" << endl;
+            offset = next;
+            continue;
+        }
+        apply(entry);
+
+        offset += sizeof(buffer);
+    }
+
+    close(fd);
+    return offset;
+}
+
+/**
+ * Cut a torn tail off the log
+ *
+ * Must only be called while no append can be in progress, so that the
+ * bytes past the last intact record are known to be left over from an
+ * interrupted append. Appends go to the end of the file, so records
+ * appended after a torn tail would otherwise never be replayed.
+ *
+ * An interrupted append leaves at most its last record unfinished, as
+ * the records before it are complete once the next one is written.
+ * A longer damaged end is refused rather than cut, so that it can be
+ * looked at before anything more is appended.
+ *
+ * @param logFile Log file to cut
+ * @param length Offset just past the last intact record, as returned by replayWal
+ * @return off_t Number of bytes cut off; 0 if the log had no torn tail,
+ *         -1 on error or if the damaged end is longer than one record
+ */
+off_t truncateWal(const string& logFile, off_t length) {
+    int fd = open(logFile.c_str(), O_WRONLY);
+    if (fd == -1) {
+        return 0;
+    }
+    struct stat st;
+    off_t cut = 0;
+    if (fstat(fd, &st) != 0) {
+        cut = -1;
+    } else if (st.st_size - length > static_cast<off_t>(WAL_RECORD_SIZE)) {
+        cerr << "Error: " << logFile << " ends with " << st.st_size - length
+             << " damaged bytes after offset " << length
+             << ", more than an interrupted append leaves; nothing is appended until it is repaired" << endl;
+        cut = -1;
+    } else if (st.st_size > length) {
+        cut = st.st_size - length;
+        if (ftruncate(fd, length) != 0 || fdatasync(fd) != 0) {
+            cerr << "Error: Unable to cut the damaged end off " << logFile << endl;
+            cut = -1;
+        }
+    }
+    close(fd);
+    return cut;
+}
@@ -0,0 +1,65 @@
+/**
+ * Write-Ahead Log Header
+ *
+ * Purpose:
+ * Records account mutations as fixed-size entries appended to a log file,
+ * so that a deposit costs one small append instead of a rewrite of the book.
+ * The log is folded into the accounts file by a periodic checkpoint and
+ * replayed on top of it after a restart.
+ *
+ * Record Layout (128 bytes, encrypted):
+ * - Magic number and CRC-32C checksum for torn-write detection
+ * - Log sequence number
+ * - Operation (create, update, remove)
+ * - Account number, type tag, balance in cents and name
+ */
+
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <sys/types.h>
+#include "accountStore.h"
+#include "keyContext.h"
+
+using namespace std;
+
+// Size of one log record on disk
+const size_t WAL_RECORD_SIZE = 128;
+
+// Mutations that can be recorded in the log
+enum class WalOperation : uint8_t {
+    CREATE = 1,
+    UPDATE = 2,
+    REMOVE = 3
+};
+
+// One decoded log entry; all values are absolute so replay is idempotent
+struct WalEntry {
+    WalOperation operation;
+    uint64_t lsn;               // Log sequence number
+    AccountRecord account;
+};
+
+// Checks whether the account's name fits in a fixed-size record
+bool walEntryFits(const AccountRecord& account);
+
+// Appends a batch of entries with one write and waits until they are on disk
+// Returns false if the batch could not be written or synced
+bool appendWalEntries(const string& logFile, const vector<WalEntry>& entries, const KeyContext& keys);
+
+// Applies every intact entry of the log from the given byte offset onwards,
+// skipping damaged records that are followed by intact ones
+// Returns the offset just past the last intact entry
+off_t replayWal(const string& logFile, off_t offset, const KeyContext& keys,
+                const function<void(const WalEntry&)>& apply);
+
+// Cuts the log back to length, dropping a torn tail left by an interrupted append
+// Call only while holding the book lock; returns the bytes cut off, or -1 on error
+// or if more than one record is damaged
+off_t truncateWal(const string& logFile, off_t length);
+
+#endif // WRITE_AHEAD_LOG_H